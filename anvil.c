@@ -0,0 +1,527 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+#include <sys/stat.h>
+
+#include "anvil.h"
+#include "extract.h"
+#include "nbt.h"
+#include "util.h"
+
+/* ANVIL REGIONS
+
+   a world keeps its chunks (16 x 256 x 16 blocks, in sections 16 blocks
+   high) in region files of 32 x 32 chunks, region/r.<x>.<z>.mca. a region
+   starts with a table of where each chunk is, in 4 KiB sectors, and when it
+   was written, followed by each chunk as zlib-compressed NBT.
+
+   Dewey describes blocks by the ids and data values of Minecraft before
+   1.13, so extractions go into worlds of those versions, whose sections
+   keep a byte per block and a nibble of data. every chunk the extraction
+   covers is read, changed a section at a time, and has its height map
+   redone and its light flagged to be recomputed by the game; every other
+   chunk is copied as it was, still compressed. each region is written to a
+   temporary file that then takes the place of the old one, so that a
+   region is never left half-written. */
+
+#define REGION_CHUNKS 32
+#define CHUNKS_PER_REGION (REGION_CHUNKS * REGION_CHUNKS)
+#define SECTOR_SIZE 4096
+#define SECTION_HEIGHT 16
+#define WORLD_HEIGHT 256
+
+// Minecraft 1.12.2, the last version to keep block ids
+#define CHUNK_DATA_VERSION 1343
+
+#define COMPRESSION_GZIP 1
+#define COMPRESSION_ZLIB 2
+
+#define GRASS 2
+#define BIOME_PLAINS 1
+
+static int floor_div(int a, int b)
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+struct region {
+	int rx, rz;
+
+	// chunks left as they were, still compressed (the compression type
+	// byte first), and chunks being changed, read back
+	unsigned char *raw[CHUNKS_PER_REGION];
+	uint32_t raw_len[CHUNKS_PER_REGION];
+	uint32_t timestamps[CHUNKS_PER_REGION];
+	struct nbt_node *chunks[CHUNKS_PER_REGION];
+};
+
+static uint32_t read_be32(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void write_be32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = (v >> 16) & 0xff;
+	p[2] = (v >> 8) & 0xff;
+	p[3] = v & 0xff;
+}
+
+// read the region file at path into r; a region that does not exist yet
+// has no chunks. returns 0 if the file cannot be read
+static int region_load(struct region *r, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return 1;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	unsigned char *b = malloc(size > 0 ? size : 1);
+	int ok = size >= 0 && fread(b, 1, size, f) == (size_t)size;
+	fclose(f);
+
+	// an empty file is an empty region
+	if (ok && size == 0) {
+		free(b);
+		return 1;
+	}
+
+	if (!ok || size < 2 * SECTOR_SIZE) {
+		printf("[anvil] %s is not a region file\n", path);
+		free(b);
+		return 0;
+	}
+
+	for (int i = 0; i < CHUNKS_PER_REGION; i++) {
+		uint32_t location = read_be32(b + 4 * i);
+		r->timestamps[i] = read_be32(b + SECTOR_SIZE + 4 * i);
+		if (!location)
+			continue;
+
+		size_t offset = (size_t)(location >> 8) * SECTOR_SIZE;
+		if (offset + 5 > (size_t)size) {
+			printf("[anvil] chunk %d of %s lies past the end of the file, dropping it\n", i, path);
+			continue;
+		}
+
+		uint32_t len = read_be32(b + offset);
+		if (len < 1 || offset + 4 + len > (size_t)size) {
+			printf("[anvil] chunk %d of %s is cut short, dropping it\n", i, path);
+			continue;
+		}
+
+		r->raw_len[i] = len;
+		r->raw[i] = malloc(len);
+		memcpy(r->raw[i], b + offset + 4, len);
+	}
+
+	free(b);
+	return 1;
+}
+
+// inflate a chunk, zlib or gzip; NULL if it cannot be
+static unsigned char *inflate_chunk(const unsigned char *b, uint32_t len, size_t *out_len)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (inflateInit2(&zs, 15 + 32) != Z_OK) // detect zlib or gzip
+		return NULL;
+
+	size_t sz = 4 * len + 1024, n = 0;
+	unsigned char *out = malloc(sz);
+	zs.next_in = (unsigned char *)b;
+	zs.avail_in = len;
+
+	int ret;
+	do {
+		if (n == sz) {
+			sz *= 2;
+			out = realloc(out, sz);
+		}
+		zs.next_out = out + n;
+		zs.avail_out = sz - n;
+		ret = inflate(&zs, Z_NO_FLUSH);
+		n = sz - zs.avail_out;
+	} while (ret == Z_OK);
+	inflateEnd(&zs);
+
+	if (ret != Z_STREAM_END) {
+		free(out);
+		return NULL;
+	}
+
+	*out_len = n;
+	return out;
+}
+
+static struct nbt_node *new_chunk(int cx, int cz)
+{
+	struct nbt_node *chunk = calloc(1, sizeof(struct nbt_node));
+	chunk->type = TAG_COMPOUND;
+	chunk->name = calloc(1, 1);
+
+	nbt_add(chunk, TAG_INT, "DataVersion")->i = CHUNK_DATA_VERSION;
+	struct nbt_node *level = nbt_add(chunk, TAG_COMPOUND, "Level");
+	nbt_add(level, TAG_INT, "xPos")->i = cx;
+	nbt_add(level, TAG_INT, "zPos")->i = cz;
+	nbt_add(level, TAG_LONG, "LastUpdate");
+	nbt_add(level, TAG_BYTE, "LightPopulated");
+	// so that the game does not generate terrain over the design
+	nbt_add(level, TAG_BYTE, "TerrainPopulated")->i = 1;
+	nbt_add(level, TAG_BYTE, "V")->i = 1;
+	nbt_add(level, TAG_LONG, "InhabitedTime");
+	memset(nbt_add_array(level, TAG_BYTE_ARRAY, "Biomes", 256)->bytes, BIOME_PLAINS, 256);
+	nbt_add_array(level, TAG_INT_ARRAY, "HeightMap", 256);
+	nbt_add(level, TAG_LIST, "Sections")->list_type = TAG_COMPOUND;
+	nbt_add(level, TAG_LIST, "Entities");
+	nbt_add(level, TAG_LIST, "TileEntities");
+
+	return chunk;
+}
+
+// chunk i of r, read back (or made) to be changed; NULL if it cannot be
+static struct nbt_node *region_chunk(struct region *r, int i)
+{
+	if (r->chunks[i])
+		return r->chunks[i];
+
+	int cx = r->rx * REGION_CHUNKS + i % REGION_CHUNKS;
+	int cz = r->rz * REGION_CHUNKS + i / REGION_CHUNKS;
+
+	if (!r->raw[i]) {
+		r->chunks[i] = new_chunk(cx, cz);
+		return r->chunks[i];
+	}
+
+	if (r->raw[i][0] != COMPRESSION_ZLIB && r->raw[i][0] != COMPRESSION_GZIP) {
+		printf("[anvil] chunk (%d, %d) is compressed in a way this version cannot read\n", cx, cz);
+		return NULL;
+	}
+
+	size_t len;
+	unsigned char *b = inflate_chunk(r->raw[i] + 1, r->raw_len[i] - 1, &len);
+	struct nbt_node *chunk = b ? nbt_read(b, len) : NULL;
+	free(b);
+
+	struct nbt_node *level = nbt_find(chunk, "Level");
+	struct nbt_node *version = nbt_find(chunk, "DataVersion");
+	if (!level || !nbt_find(level, "Sections")) {
+		printf("[anvil] chunk (%d, %d) cannot be read\n", cx, cz);
+		nbt_free(chunk);
+		return NULL;
+	}
+
+	if (version && version->i > CHUNK_DATA_VERSION) {
+		printf("[anvil] chunk (%d, %d) is from Minecraft 1.13 or later, which has no block ids; "
+		       "paste extraction.schem with WorldEdit instead\n", cx, cz);
+		nbt_free(chunk);
+		return NULL;
+	}
+
+	free(r->raw[i]);
+	r->raw[i] = NULL;
+	r->chunks[i] = chunk;
+	return chunk;
+}
+
+// the section of chunk at height sy, made (empty and lit by the sky) if
+// there was none
+static struct nbt_node *chunk_section(struct nbt_node *chunk, int sy)
+{
+	struct nbt_node *sections = nbt_find(nbt_find(chunk, "Level"), "Sections");
+	for (int i = 0; i < sections->n_children; i++) {
+		struct nbt_node *y = nbt_find(sections->children[i], "Y");
+		if (y && y->i == sy)
+			return sections->children[i];
+	}
+
+	struct nbt_node *section = nbt_add(sections, TAG_COMPOUND, NULL);
+	nbt_add(section, TAG_BYTE, "Y")->i = sy;
+	nbt_add_array(section, TAG_BYTE_ARRAY, "Blocks", 4096);
+	nbt_add_array(section, TAG_BYTE_ARRAY, "Data", 2048);
+	nbt_add_array(section, TAG_BYTE_ARRAY, "BlockLight", 2048);
+	memset(nbt_add_array(section, TAG_BYTE_ARRAY, "SkyLight", 2048)->bytes, 0xff, 2048);
+
+	return section;
+}
+
+// the byte array of section named name, or NULL if it is missing or short
+static unsigned char *section_array(struct nbt_node *section, const char *name, int len)
+{
+	struct nbt_node *n = nbt_find(section, name);
+	if (!n || n->type != TAG_BYTE_ARRAY || n->len < len)
+		return NULL;
+
+	return n->bytes;
+}
+
+// the blocks of a box to be written, in world coordinates
+struct block_box {
+	struct coordinate lo, hi; // hi exclusive
+};
+
+static void set_nibble(unsigned char *a, int i, int v)
+{
+	if (i & 1)
+		a[i >> 1] = (a[i >> 1] & 0x0f) | (v & 0xf) << 4;
+	else
+		a[i >> 1] = (a[i >> 1] & 0xf0) | (v & 0xf);
+}
+
+static int get_nibble(unsigned char *a, int i)
+{
+	return i & 1 ? a[i >> 1] >> 4 : a[i >> 1] & 0xf;
+}
+
+/* write into the section at height sy of chunk (cx, cz) the blocks of
+   extraction e (at origin) that fall in it, and, if lay_floor is set, a floor
+   of grass under it. returns 0 if the section cannot be written */
+static int fill_section(struct nbt_node *chunk, int cx, int cz, int sy,
+		struct extraction *e, struct coordinate origin, int lay_floor)
+{
+	struct dimensions d = e->dimensions;
+	struct block_box box = {origin, {origin.y + d.y, origin.z + d.z, origin.x + d.x}};
+
+	int y0 = max(box.lo.y - (lay_floor ? 1 : 0), sy * SECTION_HEIGHT), y1 = min(box.hi.y, (sy + 1) * SECTION_HEIGHT);
+	int z0 = max(box.lo.z, cz * 16), z1 = min(box.hi.z, (cz + 1) * 16);
+	int x0 = max(box.lo.x, cx * 16), x1 = min(box.hi.x, (cx + 1) * 16);
+	if (y0 >= y1 || z0 >= z1 || x0 >= x1)
+		return 1;
+
+	struct nbt_node *section = chunk_section(chunk, sy);
+	unsigned char *blocks = section_array(section, "Blocks", 4096);
+	unsigned char *data = section_array(section, "Data", 2048);
+	if (!blocks || !data) {
+		printf("[anvil] section %d of chunk (%d, %d) cannot be read\n", sy, cx, cz);
+		return 0;
+	}
+
+	for (int y = y0; y < y1; y++) {
+		for (int z = z0; z < z1; z++) {
+			for (int x = x0; x < x1; x++) {
+				int i = ((y - sy * SECTION_HEIGHT) * 16 + (z - cz * 16)) * 16 + (x - cx * 16);
+				if (y < box.lo.y) {
+					blocks[i] = GRASS;
+					set_nibble(data, i, 0);
+					continue;
+				}
+
+				data_t da;
+				blocks[i] = extraction_get(e, (struct coordinate){y - box.lo.y, z - box.lo.z, x - box.lo.x}, &da);
+				set_nibble(data, i, da);
+			}
+		}
+	}
+
+	return 1;
+}
+
+/* redo the height map of chunk (the height of the lowest block in each
+   column with only air above it), light the sky above it, and have the
+   game work out the rest of the light again */
+static void relight_chunk(struct nbt_node *chunk)
+{
+	struct nbt_node *level = nbt_find(chunk, "Level");
+	struct nbt_node *sections = nbt_find(level, "Sections");
+
+	struct nbt_node *by_y[WORLD_HEIGHT / SECTION_HEIGHT] = {NULL};
+	for (int i = 0; i < sections->n_children; i++) {
+		struct nbt_node *y = nbt_find(sections->children[i], "Y");
+		if (y && y->i >= 0 && y->i < WORLD_HEIGHT / SECTION_HEIGHT &&
+		    section_array(sections->children[i], "Blocks", 4096))
+			by_y[y->i] = sections->children[i];
+	}
+
+	struct nbt_node *height_map = nbt_find(level, "HeightMap");
+	if (!height_map || height_map->type != TAG_INT_ARRAY || height_map->len != 256) {
+		if (height_map)
+			nbt_remove(level, height_map);
+		height_map = nbt_add_array(level, TAG_INT_ARRAY, "HeightMap", 256);
+	}
+
+	for (int z = 0; z < 16; z++) {
+		for (int x = 0; x < 16; x++) {
+			int height = 0;
+			for (int y = WORLD_HEIGHT - 1; y >= 0 && !height; y--) {
+				struct nbt_node *s = by_y[y / SECTION_HEIGHT];
+				if (s && section_array(s, "Blocks", 4096)[((y % SECTION_HEIGHT) * 16 + z) * 16 + x])
+					height = y + 1;
+			}
+			write_be32(height_map->bytes + 4 * (z * 16 + x), height);
+
+			for (int sy = 0; sy < WORLD_HEIGHT / SECTION_HEIGHT; sy++) {
+				unsigned char *sky = by_y[sy] ? section_array(by_y[sy], "SkyLight", 2048) : NULL;
+				for (int y = 0; sky && y < SECTION_HEIGHT; y++) {
+					int i = (y * 16 + z) * 16 + x;
+					if (sy * SECTION_HEIGHT + y >= height)
+						set_nibble(sky, i, 15);
+					else if (get_nibble(sky, i) == 15)
+						set_nibble(sky, i, 0);
+				}
+			}
+		}
+	}
+
+	struct nbt_node *lit = nbt_find(level, "LightPopulated");
+	if (!lit)
+		lit = nbt_add(level, TAG_BYTE, "LightPopulated");
+	lit->i = 0;
+}
+
+// compress chunk, and put it (with its length and compression type) into nb
+static int deflate_chunk(struct nbt_node *chunk, struct nbt_buffer *nb)
+{
+	struct nbt_buffer raw;
+	nbt_buffer_init(&raw, 1 << 16);
+	nbt_write(&raw, chunk);
+
+	uLongf len = compressBound(raw.n);
+	unsigned char *z = malloc(len);
+	int ok = compress2(z, &len, raw.b, raw.n, Z_DEFAULT_COMPRESSION) == Z_OK;
+	if (ok) {
+		nbt_int(nb, len + 1);
+		nbt_byte(nb, COMPRESSION_ZLIB);
+		nbt_put(nb, z, len);
+	}
+
+	free(z);
+	free(raw.b);
+	return ok;
+}
+
+// write r to path, by way of a temporary file
+static int region_save(struct region *r, const char *path)
+{
+	unsigned char header[2 * SECTOR_SIZE] = {0};
+	struct nbt_buffer body;
+	nbt_buffer_init(&body, 1 << 20);
+
+	uint32_t now = time(NULL);
+	for (int i = 0; i < CHUNKS_PER_REGION; i++) {
+		size_t start = body.n;
+		if (r->chunks[i]) {
+			if (!deflate_chunk(r->chunks[i], &body)) {
+				free(body.b);
+				return 0;
+			}
+			r->timestamps[i] = now;
+		} else if (r->raw[i]) {
+			nbt_int(&body, r->raw_len[i]);
+			nbt_put(&body, r->raw[i], r->raw_len[i]);
+		} else {
+			continue;
+		}
+
+		// chunks take whole sectors
+		size_t sectors = (body.n - start + SECTOR_SIZE - 1) / SECTOR_SIZE;
+		if (sectors > 255) {
+			printf("[anvil] chunk %d of %s is too large for a region file\n", i, path);
+			free(body.b);
+			return 0;
+		}
+		while (body.n < start + sectors * SECTOR_SIZE)
+			nbt_byte(&body, 0);
+
+		write_be32(header + 4 * i, (uint32_t)(2 + start / SECTOR_SIZE) << 8 | sectors);
+		write_be32(header + SECTOR_SIZE + 4 * i, r->timestamps[i]);
+	}
+
+	char *tmp = malloc(strlen(path) + 5);
+	sprintf(tmp, "%s.tmp", path);
+
+	FILE *f = fopen(tmp, "wb");
+	int ok = f && fwrite(header, 1, sizeof(header), f) == sizeof(header) &&
+		fwrite(body.b, 1, body.n, f) == body.n;
+	if (f)
+		ok = fclose(f) == 0 && ok;
+	ok = ok && rename(tmp, path) == 0;
+	if (!ok) {
+		printf("[anvil] could not write %s\n", path);
+		remove(tmp);
+	}
+
+	free(tmp);
+	free(body.b);
+	return ok;
+}
+
+static void region_free(struct region *r)
+{
+	for (int i = 0; i < CHUNKS_PER_REGION; i++) {
+		free(r->raw[i]);
+		nbt_free(r->chunks[i]);
+	}
+	free(r);
+}
+
+/* insert extraction e into the world in directory world, with its lowest
+   corner at origin (in blocks), laying a floor of grass under it if lay_floor
+   is set; returns 0 if the world could not be written (regions written
+   before the failure keep the design) */
+int anvil_insert(const char *world, struct extraction *e, struct coordinate origin, int lay_floor)
+{
+	struct dimensions d = e->dimensions;
+	int y_lo = origin.y - (lay_floor ? 1 : 0), y_hi = origin.y + d.y;
+	if (y_lo < 0 || y_hi > WORLD_HEIGHT) {
+		printf("[anvil] a design %d blocks high does not fit in the world at y = %d\n", d.y, origin.y);
+		return 0;
+	}
+	if (!d.x || !d.y || !d.z)
+		return 1;
+
+	int cx0 = floor_div(origin.x, 16), cx1 = floor_div(origin.x + d.x - 1, 16);
+	int cz0 = floor_div(origin.z, 16), cz1 = floor_div(origin.z + d.z - 1, 16);
+	int sy0 = y_lo / SECTION_HEIGHT, sy1 = (y_hi - 1) / SECTION_HEIGHT;
+
+	char *region_dir = malloc(strlen(world) + 8);
+	sprintf(region_dir, "%s/region", world);
+	mkdir(region_dir, 0755);
+	free(region_dir);
+
+	int ok = 1, n_chunks = 0;
+	for (int rz = floor_div(cz0, REGION_CHUNKS); ok && rz <= floor_div(cz1, REGION_CHUNKS); rz++) {
+		for (int rx = floor_div(cx0, REGION_CHUNKS); ok && rx <= floor_div(cx1, REGION_CHUNKS); rx++) {
+			char *path = malloc(strlen(world) + 64);
+			sprintf(path, "%s/region/r.%d.%d.mca", world, rx, rz);
+
+			struct region *r = calloc(1, sizeof(struct region));
+			r->rx = rx;
+			r->rz = rz;
+			ok = region_load(r, path);
+
+			for (int cz = max(cz0, rz * REGION_CHUNKS); ok && cz <= min(cz1, rz * REGION_CHUNKS + REGION_CHUNKS - 1); cz++) {
+				for (int cx = max(cx0, rx * REGION_CHUNKS); ok && cx <= min(cx1, rx * REGION_CHUNKS + REGION_CHUNKS - 1); cx++) {
+					int i = (cz - rz * REGION_CHUNKS) * REGION_CHUNKS + (cx - rx * REGION_CHUNKS);
+					struct nbt_node *chunk = region_chunk(r, i);
+					if (!chunk) {
+						ok = 0;
+						break;
+					}
+
+					for (int sy = sy0; ok && sy <= sy1; sy++)
+						ok = fill_section(chunk, cx, cz, sy, e, origin, lay_floor);
+					relight_chunk(chunk);
+					n_chunks++;
+				}
+			}
+
+			if (ok)
+				ok = region_save(r, path);
+
+			region_free(r);
+			free(path);
+		}
+	}
+
+	if (ok)
+		printf("[anvil] wrote %d chunks\n", n_chunks);
+
+	return ok;
+}
@@ -0,0 +1,9 @@
+#ifndef __ANVIL_H__
+#define __ANVIL_H__
+
+#include "coord.h"
+#include "extract.h"
+
+int anvil_insert(const char *, struct extraction *, struct coordinate, int);
+
+#endif /* __ANVIL_H__ */
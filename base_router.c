@@ -1,9 +1,12 @@
 #include "base_router.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "placer.h"
+#include "usage_matrix.h"
 
 struct coordinate disp_backtrace(struct coordinate c, enum backtrace b)
 {
@@ -127,30 +130,341 @@ enum backtrace compute_backtrace(struct coordinate here, struct coordinate there
 	return BT_NONE;
 }
 
+/* per-net storage */
+struct net_pool_chunk {
+	struct net_pool_chunk *next;
+};
+
+// every allocation from a pool is aligned to this
+#define NET_POOL_ALIGN 16
+#define NET_POOL_ROUND(n) (((n) + NET_POOL_ALIGN - 1) & ~(size_t)(NET_POOL_ALIGN - 1))
+
+// chunks start small, as most nets are, and double up to a limit
+#define NET_POOL_FIRST_CHUNK 1024
+#define NET_POOL_MAX_CHUNK 65536
+
+void net_pool_init(struct net_pool *pool)
+{
+	memset(pool, 0, sizeof(struct net_pool));
+	pool->chunk_size = NET_POOL_FIRST_CHUNK;
+}
+
+// free everything allocated from the pool at once
+void net_pool_release(struct net_pool *pool)
+{
+	struct net_pool_chunk *next;
+	for (struct net_pool_chunk *chunk = pool->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	net_pool_init(pool);
+}
+
+static void *net_pool_alloc(struct net_pool *pool, size_t size)
+{
+	size = NET_POOL_ROUND(size);
+	if (pool->top && size <= (size_t)(pool->end - pool->top)) {
+		void *p = pool->top;
+		pool->top += size;
+		return p;
+	}
+
+	if (!pool->chunk_size)
+		pool->chunk_size = NET_POOL_FIRST_CHUNK;
+
+	// something larger than a chunk gets a chunk of its own, behind the
+	// one being bumped through
+	size_t header = NET_POOL_ROUND(sizeof(struct net_pool_chunk));
+	if (size > pool->chunk_size) {
+		struct net_pool_chunk *chunk = malloc(header + size);
+		if (pool->chunks) {
+			chunk->next = pool->chunks->next;
+			pool->chunks->next = chunk;
+		} else {
+			chunk->next = NULL;
+			pool->chunks = chunk;
+		}
+		return (char *)chunk + header;
+	}
+
+	struct net_pool_chunk *chunk = malloc(header + pool->chunk_size);
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+	pool->top = (char *)chunk + header + size;
+	pool->end = (char *)chunk + header + pool->chunk_size;
+	if (pool->chunk_size < NET_POOL_MAX_CHUNK)
+		pool->chunk_size *= 2;
+
+	return (char *)chunk + header;
+}
+
+struct routed_segment_head *net_pool_alloc_rsh(struct net_pool *pool)
+{
+	struct routed_segment_head *rsh = pool->free_rsh;
+	if (rsh)
+		pool->free_rsh = rsh->next;
+	else
+		rsh = net_pool_alloc(pool, sizeof(struct routed_segment_head));
+
+	memset(rsh, 0, sizeof(struct routed_segment_head));
+	return rsh;
+}
+
+void net_pool_free_rsh(struct net_pool *pool, struct routed_segment_head *rsh)
+{
+	rsh->next = pool->free_rsh;
+	pool->free_rsh = rsh;
+}
+
+static struct routed_segment_adjacency *net_pool_alloc_rsa(struct net_pool *pool)
+{
+	struct routed_segment_adjacency *rsa = pool->free_rsa;
+	if (rsa)
+		pool->free_rsa = rsa->next;
+	else
+		rsa = net_pool_alloc(pool, sizeof(struct routed_segment_adjacency));
+
+	return rsa;
+}
+
+static void net_pool_free_rsa(struct net_pool *pool, struct routed_segment_adjacency *rsa)
+{
+	rsa->next = pool->free_rsa;
+	pool->free_rsa = rsa;
+}
+
+// the smallest class holding more than n runs, so that there is always
+// room to append one more
+static int run_class(int n)
+{
+	int class = 0;
+	while ((4 << class) <= n)
+		class++;
+
+	assert(class < NET_POOL_RUN_CLASSES);
+	return class;
+}
+
+// an array for n runs; it is released with net_pool_free_runs given the
+// same n (or one within the same class)
+struct path_run *net_pool_alloc_runs(struct net_pool *pool, int n)
+{
+	int class = run_class(n);
+	struct path_run *runs = pool->free_runs[class];
+	if (runs)
+		pool->free_runs[class] = *(struct path_run **)runs;
+	else
+		runs = net_pool_alloc(pool, (4 << class) * sizeof(struct path_run));
+
+	return runs;
+}
+
+void net_pool_free_runs(struct net_pool *pool, struct path_run *runs, int n)
+{
+	if (!runs)
+		return;
+
+	// the free list is threaded through the arrays themselves
+	int class = run_class(n);
+	*(struct path_run **)runs = pool->free_runs[class];
+	pool->free_runs[class] = runs;
+}
+
+// an array holding the first n runs of runs (which holds n), with room
+// for new_n; runs itself is returned while it is big enough
+struct path_run *net_pool_resize_runs(struct net_pool *pool, struct path_run *runs, int n, int new_n)
+{
+	if (runs && run_class(n) == run_class(new_n))
+		return runs;
+
+	struct path_run *resized = net_pool_alloc_runs(pool, new_n);
+	if (runs) {
+		memcpy(resized, runs, (n < new_n ? n : new_n) * sizeof(struct path_run));
+		net_pool_free_runs(pool, runs, n);
+	}
+
+	return resized;
+}
+
+/* paths */
+// the displacement of one step of bt
+struct coordinate backtrace_step(enum backtrace bt)
+{
+	struct coordinate zero = {0, 0, 0};
+	return disp_backtrace(zero, bt);
+}
+
+// add n steps of bt to the path of rseg, after the steps it already has
+void path_append(struct net_pool *pool, struct routed_segment *rseg, enum backtrace bt, int n)
+{
+	rseg->n_backtraces += n;
+
+	if (rseg->n_runs > 0) {
+		struct path_run *last = &rseg->runs[rseg->n_runs - 1];
+		if (last->bt == bt && last->len + n <= PATH_RUN_MAX_LEN) {
+			last->len += n;
+			return;
+		}
+	}
+
+	while (n > 0) {
+		int len = n < PATH_RUN_MAX_LEN ? n : PATH_RUN_MAX_LEN;
+		rseg->runs = net_pool_resize_runs(pool, rseg->runs, rseg->n_runs, rseg->n_runs + 1);
+		rseg->runs[rseg->n_runs++] = (struct path_run){bt, len};
+		n -= len;
+	}
+}
+
+// reverse the path, so that it leads from seg.start to seg.end instead
+void path_invert(struct routed_segment *rseg)
+{
+	for (int i = 0; i < rseg->n_runs / 2; i++) {
+		struct path_run tmp = rseg->runs[i];
+		rseg->runs[i] = rseg->runs[rseg->n_runs - 1 - i];
+		rseg->runs[rseg->n_runs - 1 - i] = tmp;
+	}
+
+	for (int i = 0; i < rseg->n_runs; i++)
+		rseg->runs[i].bt = invert_backtrace(rseg->runs[i].bt);
+}
+
+// the block n steps of run away from c
+static struct coordinate run_disp(struct coordinate c, struct path_run run, int n)
+{
+	struct coordinate step = backtrace_step(run.bt);
+	struct coordinate d = {step.y * n, step.z * n, step.x * n};
+	return coordinate_add(c, d);
+}
+
+// a straight run is bounded by its two ends, so the bounds of a path only
+// need a look at the end of each run
+void path_compute_bounds(struct routed_segment *rseg)
+{
+	struct coordinate c = rseg->seg.end;
+	rseg->tl = coordinate_piecewise_min(c, rseg->seg.start);
+	rseg->br = coordinate_piecewise_max(c, rseg->seg.start);
+
+	for (int i = 0; i < rseg->n_runs; i++) {
+		c = run_disp(c, rseg->runs[i], rseg->runs[i].len);
+		rseg->tl = coordinate_piecewise_min(rseg->tl, c);
+		rseg->br = coordinate_piecewise_max(rseg->br, c);
+	}
+}
+
+// move the segment, and its bounds, by disp
+void path_displace(struct routed_segment *rseg, struct coordinate disp)
+{
+	rseg->seg.start = coordinate_add(rseg->seg.start, disp);
+	rseg->seg.end = coordinate_add(rseg->seg.end, disp);
+	rseg->tl = coordinate_add(rseg->tl, disp);
+	rseg->br = coordinate_add(rseg->br, disp);
+}
+
+// write out the path one backtrace per step, into bt (of n_backtraces)
+void path_expand(struct routed_segment *rseg, enum backtrace *bt)
+{
+	int k = 0;
+	for (int i = 0; i < rseg->n_runs; i++)
+		for (int j = 0; j < rseg->runs[i].len; j++)
+			bt[k++] = rseg->runs[i].bt;
+}
+
+// whether c is a block of the path (seg.end included), a run at a time
+int path_contains(struct routed_segment *rseg, struct coordinate c)
+{
+	if (c.y < rseg->tl.y || c.z < rseg->tl.z || c.x < rseg->tl.x ||
+	    c.y > rseg->br.y || c.z > rseg->br.z || c.x > rseg->br.x)
+		return 0;
+
+	struct coordinate from = rseg->seg.end;
+	if (coordinate_equal(c, from))
+		return 1;
+
+	for (int i = 0; i < rseg->n_runs; i++) {
+		struct coordinate step = backtrace_step(rseg->runs[i].bt);
+		struct coordinate d = coordinate_sub(c, from);
+		int t = step.x ? d.x / step.x : step.z ? d.z / step.z : step.y ? d.y / step.y : 0;
+		if (t >= 1 && t <= rseg->runs[i].len &&
+		    d.y == step.y * t && d.z == step.z * t && d.x == step.x * t)
+			return 1;
+
+		from = run_disp(from, rseg->runs[i], rseg->runs[i].len);
+	}
+
+	return 0;
+}
+
+/* adjacencies */
+static void link_adjacency(struct routed_net *rn, struct routed_segment_adjacency *rsa)
+{
+	rsa->prev = NULL;
+	rsa->next = rn->adjacencies;
+	if (rn->adjacencies)
+		rn->adjacencies->prev = rsa;
+	rn->adjacencies = rsa;
+
+	rsa->next_sibling = rsa->parent->children;
+	rsa->parent->children = rsa;
+}
+
+// take rsa out of the adjacency list it is in, which may be one set aside
+// from rn->adjacencies while the net is rerouted
+static void unlink_adjacency(struct routed_net *rn, struct routed_segment_adjacency *rsa)
+{
+	if (rsa->prev)
+		rsa->prev->next = rsa->next;
+	else if (rn->adjacencies == rsa)
+		rn->adjacencies = rsa->next;
+	if (rsa->next)
+		rsa->next->prev = rsa->prev;
+
+	struct routed_segment_adjacency **sibling = &rsa->parent->children;
+	while (*sibling != rsa)
+		sibling = &(*sibling)->next_sibling;
+	*sibling = rsa->next_sibling;
+
+	if (rsa->child_type == SEGMENT)
+		rsa->child.rseg->up = NULL;
+
+	net_pool_free_rsa(&rn->pool, rsa);
+}
+
 void add_adjacent_segment(struct routed_net *rn, struct routed_segment *sega, struct routed_segment *segb, struct coordinate at)
 {
 	assert(sega != segb);
 
-	struct routed_segment_adjacency *rsa = malloc(sizeof(struct routed_segment_adjacency));
+	// a segment is only ever joined to one parent
+	assert(!segb->up);
+
+	struct routed_segment_adjacency *rsa = net_pool_alloc_rsa(&rn->pool);
 	rsa->parent = sega;
 	rsa->child_type = SEGMENT;
 	rsa->child.rseg = segb;
 	rsa->at = at;
 
-	rsa->next = rn->adjacencies;
-	rn->adjacencies = rsa;
+	link_adjacency(rn, rsa);
+	segb->up = rsa;
 }
 
 void add_adjacent_pin(struct routed_net *rn, struct routed_segment *seg, struct placed_pin *pin)
 {
-	struct routed_segment_adjacency *rsa = malloc(sizeof(struct routed_segment_adjacency));
+	struct routed_segment_adjacency *rsa = net_pool_alloc_rsa(&rn->pool);
 	rsa->parent = seg;
 	rsa->child_type = PIN;
 	rsa->child.pin = pin;
 	rsa->at = extend_pin(pin);
 
-	rsa->next = rn->adjacencies;
-	rn->adjacencies = rsa;
+	link_adjacency(rn, rsa);
+}
+
+// disconnect rseg from its parent and its children
+void remove_adjacencies(struct routed_net *rn, struct routed_segment *rseg)
+{
+	if (rseg->up)
+		unlink_adjacency(rn, rseg->up);
+	while (rseg->children)
+		unlink_adjacency(rn, rseg->children);
 }
 
 // find the parent of the pin, or the routed segment
@@ -158,12 +472,18 @@ void add_adjacent_pin(struct routed_net *rn, struct routed_segment *seg, struct
 // for a segment, set p to NULL -- if there is no parent, it returns the rseg passed in
 struct routed_segment *find_parent(struct routed_net *rn, struct placed_pin *p, struct routed_segment *rseg)
 {
-	for (struct routed_segment_adjacency *rsa = rn->adjacencies; rsa; rsa = rsa->next) {
-		if ((rseg && rsa->child_type == SEGMENT && rsa->child.rseg == rseg) ||
-		    (!rseg && rsa->child_type == PIN && rsa->child.pin == p))
-			return find_parent(rn, p, rsa->parent);
+	struct routed_segment_adjacency *up = NULL;
+	if (rseg) {
+		up = rseg->up;
+	} else {
+		for (struct routed_segment_adjacency *rsa = rn->adjacencies; rsa && !up; rsa = rsa->next)
+			if (rsa->child_type == PIN && rsa->child.pin == p)
+				up = rsa;
 	}
 
+	for (; up; up = rseg->up)
+		rseg = up->parent;
+
 	return rseg;
 }
 
@@ -224,25 +544,71 @@ int movement_vertical(enum movement m)
 	return (m & MV_VERTICAL_MASK);
 }
 
+// the smallest box (top-left tl, bottom-right br) holding a net's pins,
+// their extensions, and its routed segments
+void compute_net_extent(struct routed_net *rn, struct coordinate *tl, struct coordinate *br)
+{
+	*tl = (struct coordinate){INT_MAX, INT_MAX, INT_MAX};
+	*br = (struct coordinate){INT_MIN, INT_MIN, INT_MIN};
+
+	for (int i = 0; i < rn->n_pins; i++) {
+		struct coordinate c = extend_pin(&rn->pins[i]);
+		*tl = coordinate_piecewise_min(*tl, coordinate_piecewise_min(c, rn->pins[i].coordinate));
+		*br = coordinate_piecewise_max(*br, coordinate_piecewise_max(c, rn->pins[i].coordinate));
+	}
+
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next) {
+		*tl = coordinate_piecewise_min(*tl, rsh->rseg.tl);
+		*br = coordinate_piecewise_max(*br, rsh->rseg.br);
+	}
+}
+
+// start keeping the extents of the segments of every net
+void routings_track_extents(struct routings *rt)
+{
+	extent_tracker_init(&rt->extents, rt->n_routed_nets + 1);
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++)
+		extent_touch(&rt->extents, i);
+}
+
+// note that the segments of rn have changed: some were added, ripped up,
+// or swapped for others
+void routings_net_changed(struct routings *rt, struct routed_net *rn)
+{
+	extent_touch(&rt->extents, rn->net);
+	if (rt->usage)
+		routing_usage_touch(rt->usage, rn->net);
+}
+
+// the extents of every net, brought up to date
+struct extent_tracker *routings_extents(struct routings *rt)
+{
+	int i;
+	while ((i = extent_next_dirty(&rt->extents)) >= 0) {
+		struct routed_segment_head *rsh = rt->routed_nets[i].routed_segments;
+		if (!rsh) {
+			extent_clear(&rt->extents, i);
+			continue;
+		}
+
+		struct coordinate tl = rsh->rseg.tl, br = rsh->rseg.br;
+		for (rsh = rsh->next; rsh; rsh = rsh->next) {
+			tl = coordinate_piecewise_min(tl, rsh->rseg.tl);
+			br = coordinate_piecewise_max(br, rsh->rseg.br);
+		}
+		extent_set(&rt->extents, i, tl, br);
+	}
+
+	return &rt->extents;
+}
+
 struct dimensions compute_routings_dimensions(struct routings *rt)
 {
 	struct coordinate dbr = {0, 0, 0}, dtl = {0, 0, 0}; // bottom-right and top-left
-	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
-		struct routed_net rn = rt->routed_nets[i];
-		for (struct routed_segment_head *rsh = rn.routed_segments; rsh; rsh = rsh->next) {
-			struct routed_segment rseg = rsh->rseg;
-			struct coordinate c = rseg.seg.end;
-			for (int k = 0; k < rseg.n_backtraces; k++) {
-				c = disp_backtrace(c, rseg.bt[k]);
-				dbr = coordinate_piecewise_max(dbr, c);
-				dtl = coordinate_piecewise_min(dtl, c);
-			}
-
-			dbr = coordinate_piecewise_max(dbr, rseg.seg.start);
-			dbr = coordinate_piecewise_max(dbr, rseg.seg.end);
-			dtl = coordinate_piecewise_min(dtl, rseg.seg.start);
-			dtl = coordinate_piecewise_min(dtl, rseg.seg.end);
-		}
+	struct extent_tracker *extents = routings_extents(rt);
+	if (!extent_empty(extents)) {
+		dbr = coordinate_piecewise_max(dbr, extent_br(extents));
+		dtl = coordinate_piecewise_min(dtl, extent_tl(extents));
 	}
 
 	/* the dimension is the highest coordinate , plus 1 on each */
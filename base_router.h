@@ -3,6 +3,7 @@
 
 #include "blif.h"
 #include "coord.h"
+#include "extent.h"
 #include "segment.h"
 
 // base_router.h contains things needed by all router implementations,
@@ -49,26 +50,56 @@ struct cost_coord {
 	unsigned int cost;
 	struct coordinate coord;
 	struct routing_group *rg;
+
+	// index of coord in the usage matrix, for indexed heaps
+	unsigned int key;
 };
 
+struct routing_usage;
+
 struct routings {
 	int n_routed_nets;
 	struct routed_net *routed_nets;
 
 	struct net_pin_map *npm;
+
+	// extent of the segments of each net; a net whose segments change is
+	// touched (see routings_net_changed) and looked at again when next asked
+	struct extent_tracker extents;
+
+	// the usage matrix kept while nets are rerouted one after another (see
+	// routings_usage), or NULL
+	struct routing_usage *usage;
+};
+
+// paths are kept as runs of steps in the same direction
+struct path_run {
+	unsigned int bt : 8; // enum backtrace
+	unsigned int len : 24;
 };
+#define PATH_RUN_MAX_LEN ((1 << 24) - 1)
 
 struct routed_segment {
 	struct segment seg;
 
+	// the path from seg.end back to seg.start, n_backtraces steps in all
 	int n_backtraces;
-	enum backtrace *bt;
+	int n_runs;
+	struct path_run *runs;
+
+	// bounds of every block of the path, seg.end and seg.start included
+	struct coordinate tl, br;
 
 	int score;
 
 	struct routed_net *net;
 
 	int extracted;
+
+	// the adjacency with this segment as its child, if any, and those
+	// with it as their parent (linked through next_sibling)
+	struct routed_segment_adjacency *up;
+	struct routed_segment_adjacency *children;
 };
 
 struct routed_segment_head {
@@ -81,7 +112,8 @@ struct routed_segment_head {
 // b_type determines what's contained in the union
 enum rsa_type { NONE, SEGMENT, PIN };
 struct routed_segment_adjacency {
-	struct routed_segment_adjacency *next;
+	struct routed_segment_adjacency *next, *prev;
+	struct routed_segment_adjacency *next_sibling;
 
 	struct routed_segment *parent;
 	enum rsa_type child_type;
@@ -93,23 +125,76 @@ struct routed_segment_adjacency {
 	struct coordinate at;
 };
 
+// a net owns the memory of its routing: segment heads, adjacencies and
+// backtraces are carved out of chunks that belong to the net, so ripping up
+// the whole net frees a few chunks instead of every node. anything released
+// on its own goes on a free list for the net to reuse.
+// run arrays hold 4 << class runs, for class < NET_POOL_RUN_CLASSES
+#define NET_POOL_RUN_CLASSES 24
+
+struct net_pool_chunk;
+
+struct net_pool {
+	struct net_pool_chunk *chunks;
+	char *top, *end; // unused part of the newest chunk
+	size_t chunk_size;
+
+	struct routed_segment_head *free_rsh;
+	struct routed_segment_adjacency *free_rsa;
+	struct path_run *free_runs[NET_POOL_RUN_CLASSES];
+};
+
+// the search maze_reroute uses to connect a net
+enum net_router {
+	NET_ROUTER_MAZE, // Lee's algorithm wavefronts
+	NET_ROUTER_LINE  // Mikami-Tabuchi line probes, falling back to the maze
+};
+
+struct corridor;
+
 struct routed_net {
 	net_t net;
 
+	enum net_router router;
+
+	// tiles assigned by global routing that detailed routing keeps to,
+	// or NULL to route anywhere
+	struct corridor *corridor;
+
 	/* pins connected by this net;
 	 * pins are references to a struct placed_pins
 	 */
 	int n_pins;
 	struct placed_pin *pins;
 
+	// rectilinear Steiner tree over the (extended) pins, for nets of
+	// three or more pins, or NULL
+	struct steiner_tree *steiner;
+
 	struct routed_segment_head *routed_segments;
 
 	// adjacency list expressing connections between
 	// routed_segments and other segments or pins
 	struct routed_segment_adjacency *adjacencies;
+
+	// where routed_segments and adjacencies live
+	struct net_pool pool;
+
+	// while set, segments between repair_tl and repair_br have been
+	// ripped out of the net, and it is first reconnected around them
+	int repair;
+	struct coordinate repair_tl, repair_br;
+
+	// set while the net keeps the route it was given by a previous run
+	// (see eco.c); its segments are neither ripped up nor rerouted
+	int fixed;
 };
 
 struct dimensions compute_routings_dimensions(struct routings *);
+void routings_track_extents(struct routings *);
+void routings_net_changed(struct routings *, struct routed_net *);
+struct extent_tracker *routings_extents(struct routings *);
+void compute_net_extent(struct routed_net *, struct coordinate *, struct coordinate *);
 
 struct coordinate disp_backtrace(struct coordinate, enum backtrace);
 struct coordinate disp_movement(struct coordinate, enum movement);
@@ -117,8 +202,26 @@ enum backtrace invert_backtrace(enum backtrace);
 void invert_backtrace_sequence(enum backtrace *, int);
 enum backtrace compute_backtrace(struct coordinate, struct coordinate);
 
+void net_pool_init(struct net_pool *);
+void net_pool_release(struct net_pool *);
+struct routed_segment_head *net_pool_alloc_rsh(struct net_pool *);
+void net_pool_free_rsh(struct net_pool *, struct routed_segment_head *);
+struct path_run *net_pool_alloc_runs(struct net_pool *, int);
+struct path_run *net_pool_resize_runs(struct net_pool *, struct path_run *, int, int);
+void net_pool_free_runs(struct net_pool *, struct path_run *, int);
+
+struct coordinate backtrace_step(enum backtrace);
+void path_append(struct net_pool *, struct routed_segment *, enum backtrace, int);
+void path_invert(struct routed_segment *);
+void path_compute_bounds(struct routed_segment *);
+void path_displace(struct routed_segment *, struct coordinate);
+void path_expand(struct routed_segment *, enum backtrace *);
+int path_contains(struct routed_segment *, struct coordinate);
+
 void add_adjacent_segment(struct routed_net *, struct routed_segment *, struct routed_segment *, struct coordinate);
 void add_adjacent_pin(struct routed_net *, struct routed_segment *, struct placed_pin *);
 
+void remove_adjacencies(struct routed_net *, struct routed_segment *);
+
 struct routed_segment *find_parent(struct routed_net *rn, struct placed_pin *p, struct routed_segment *rseg);
 #endif /* __BASE_ROUTER_H__ */
@@ -0,0 +1,92 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "congestion.h"
+#include "util.h"
+
+// blocks added around the requested coordinate whenever the map grows,
+// so that growing one block at a time does not copy the map every time
+#define CONGESTION_GROW_SLACK 16
+
+struct congestion_map *create_congestion_map(double present_factor)
+{
+	struct congestion_map *cm = malloc(sizeof(struct congestion_map));
+	cm->origin = (struct coordinate){0, 0, 0};
+	cm->d = (struct dimensions){0, 0, 0};
+	cm->history = NULL;
+	cm->present_factor = present_factor;
+
+	return cm;
+}
+
+void free_congestion_map(struct congestion_map *cm)
+{
+	free(cm->history);
+	free(cm);
+}
+
+static int in_congestion_bounds(struct congestion_map *cm, struct coordinate c)
+{
+	struct coordinate r = coordinate_sub(c, cm->origin);
+	return r.y >= 0 && r.y < cm->d.y &&
+	       r.z >= 0 && r.z < cm->d.z &&
+	       r.x >= 0 && r.x < cm->d.x;
+}
+
+static int congestion_idx(struct congestion_map *cm, struct coordinate c)
+{
+	struct coordinate r = coordinate_sub(c, cm->origin);
+	return (r.y * cm->d.z * cm->d.x) + (r.z * cm->d.x) + r.x;
+}
+
+unsigned int congestion_history(struct congestion_map *cm, struct coordinate c)
+{
+	if (!in_congestion_bounds(cm, c))
+		return 0;
+
+	return cm->history[congestion_idx(cm, c)];
+}
+
+// enlarge the map, in any direction, so that it covers coordinate c
+static void grow_congestion_map(struct congestion_map *cm, struct coordinate c)
+{
+	struct coordinate slack = {CONGESTION_GROW_SLACK, CONGESTION_GROW_SLACK, CONGESTION_GROW_SLACK};
+	struct coordinate tl = coordinate_sub(c, slack), br = coordinate_add(c, slack);
+
+	if (cm->history) {
+		struct coordinate end = {cm->origin.y + cm->d.y, cm->origin.z + cm->d.z, cm->origin.x + cm->d.x};
+		tl = coordinate_piecewise_min(tl, cm->origin);
+		br = coordinate_piecewise_max(br, end);
+	}
+	tl.y = max(tl.y, 0);
+
+	struct dimensions d = {br.y - tl.y, br.z - tl.z, br.x - tl.x};
+	unsigned int *history = calloc(d.y * d.z * d.x, sizeof(unsigned int));
+	assert(history);
+
+	// copy the old map into place, a row at a time
+	for (int y = 0; y < cm->d.y; y++) {
+		for (int z = 0; z < cm->d.z; z++) {
+			struct coordinate row = {cm->origin.y + y - tl.y, cm->origin.z + z - tl.z, cm->origin.x - tl.x};
+			int idx = (row.y * d.z * d.x) + (row.z * d.x) + row.x;
+			memcpy(&history[idx], &cm->history[(y * cm->d.z * cm->d.x) + (z * cm->d.x)], cm->d.x * sizeof(unsigned int));
+		}
+	}
+
+	free(cm->history);
+	cm->history = history;
+	cm->origin = tl;
+	cm->d = d;
+}
+
+void congestion_add_history(struct congestion_map *cm, struct coordinate c, unsigned int amount)
+{
+	if (c.y < 0)
+		return;
+
+	if (!in_congestion_bounds(cm, c))
+		grow_congestion_map(cm, c);
+
+	cm->history[congestion_idx(cm, c)] += amount;
+}
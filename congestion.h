@@ -0,0 +1,27 @@
+#ifndef __CONGESTION_H__
+#define __CONGESTION_H__
+
+#include "coord.h"
+
+// congestion_map tracks the costs used by negotiated-congestion
+// (PathFinder) routing: a history cost for every block that has been
+// overused in a previous iteration, and a present-congestion factor that
+// grows every iteration so that nets sharing blocks are pushed apart
+struct congestion_map {
+	// coordinate of the first entry in history, and the extent of history;
+	// the map grows as needed to cover any coordinate given to it
+	struct coordinate origin;
+	struct dimensions d;
+	unsigned int *history;
+
+	// multiplier applied to the cost of entering a block in violation
+	double present_factor;
+};
+
+struct congestion_map *create_congestion_map(double);
+void free_congestion_map(struct congestion_map *);
+
+unsigned int congestion_history(struct congestion_map *, struct coordinate);
+void congestion_add_history(struct congestion_map *, struct coordinate, unsigned int);
+
+#endif /* __CONGESTION_H__ */
@@ -8,13 +8,76 @@
 
 #include "blif.h"
 #include "cell.h"
+#include "eco.h"
 #include "extract.h"
+#include "logger.h"
 #include "placer.h"
 #include "router.h"
+#include "schematic.h"
 #include "vis_png.h"
 #include "vis_json.h"
 #include "serializer.h"
 
+enum output_format {
+	FORMAT_YAML,
+	FORMAT_BINARY
+};
+
+enum phase {
+	PHASE_PLACE,
+	PHASE_ROUTE,
+	PHASE_EXTRACT
+};
+
+static const char *format_extensions[] = {"yaml", "bin"};
+
+// write the placements or routings (as name.yaml or name.bin) to dir
+static void write_placements(char *dir, struct cell_placements *cp, struct blif *blif, enum output_format format)
+{
+	char *fn;
+	asprintf(&fn, "%s/placements.%s", dir, format_extensions[format]);
+	FILE *f = fopen(fn, "w");
+	if (format == FORMAT_BINARY)
+		serialize_placements_binary(f, cp, blif);
+	else
+		serialize_placements(f, cp, blif);
+	fclose(f);
+	free(fn);
+}
+
+static void write_routings(char *dir, struct routings *rt, struct blif *blif, enum output_format format)
+{
+	char *fn;
+	asprintf(&fn, "%s/routings.%s", dir, format_extensions[format]);
+	FILE *f = fopen(fn, "w");
+	if (format == FORMAT_BINARY)
+		serialize_routings_binary(f, rt, blif);
+	else
+		serialize_routings(f, rt, blif);
+	fclose(f);
+	free(fn);
+}
+
+// open name.yaml or name.bin in dir, whichever was written last
+static FILE *open_previous(char *dir, char *name)
+{
+	char *fn[2];
+	struct stat sb[2];
+	int found[2];
+	for (int i = 0; i < 2; i++) {
+		asprintf(&fn[i], "%s/%s.%s", dir, name, format_extensions[i]);
+		found[i] = stat(fn[i], &sb[i]) == 0;
+	}
+
+	int newer = found[FORMAT_BINARY] && (!found[FORMAT_YAML] || sb[FORMAT_BINARY].st_mtime > sb[FORMAT_YAML].st_mtime);
+	FILE *f = fopen(fn[newer], "rb");
+
+	free(fn[0]);
+	free(fn[1]);
+
+	return f;
+}
+
 void usage(char *argv0)
 {
 	printf("dewey -- a placer and router tool for Minecraft redstone circuits\n");
@@ -24,6 +87,29 @@ void usage(char *argv0)
 //	printf("  -l, --library=<yaml>       Cell library YAML file\n");
 	printf("  -o, --output=<dir>         Directory to place output files\n");
 	printf("  -s, --seed=<number>        Seed the random number generator\n");
+	printf("  -r, --router=<mode>        Routing mode: rip-up (default) or negotiated\n");
+	printf("  -j, --route-threads=<n>    Route and extract up to n nets at once (default 1)\n");
+	printf("  -p, --line-probe           Try line-probe routing before maze routing\n");
+	printf("  -g, --global-route         Confine each net to a corridor found by global routing\n");
+	printf("  -L, --local-repair         Reconnect nets around the segments ripped out of them\n");
+	printf("  -t, --route-time-limit=<s> Stop routing after s seconds, keeping the best routings found\n");
+	printf("  -n, --route-iteration-limit=<n>\n");
+	printf("                             Stop routing after n iterations, keeping the best routings found\n");
+	printf("  -v, --log=<module[:level],...>\n");
+	printf("                             Set what is logged to router.log (\"none\" for nothing); modules are\n");
+	printf("                             router, negotiate, optimize, natural_selection, crv, violation, or all,\n");
+	printf("                             and levels off, info (the default), debug or trace (if not given)\n");
+	printf("  -e, --eco=<dir>            Keep the placements and routings of a previous run, in dir, for the\n");
+	printf("                             cells and nets that have not changed, placing and routing only the rest\n");
+	printf("  -f, --format=<format>      Write placements and routings as yaml (default) or binary (.bin)\n");
+	printf("  -P, --from-placement=<file>\n");
+	printf("                             Take the placements in file (yaml or binary) instead of placing\n");
+	printf("  -R, --from-routing=<file>  Take the routings in file instead of routing; needs the placements\n");
+	printf("                             written with them, given with --from-placement\n");
+	printf("  -S, --stop-after=<phase>   Stop after the place or route phase, writing only its outputs\n");
+	printf("\n");
+	printf("Exits with status 4 if routing stopped at a limit with violations left;\n");
+	printf("the nets still in violation are listed in violations.yaml.\n");
 }
 
 int main(int argc, char **argv)
@@ -41,17 +127,40 @@ int main(int argc, char **argv)
 	// random seed
 	int seed = 0;
 
+	// routing options
+	struct routing_options ro = {ROUTING_RIP_UP, 1, NET_ROUTER_MAZE, 0, 0, 0, 0, NULL, NULL};
+
+	// directory of a previous run to start from, if any
+	char *eco_dir = NULL;
+
+	// placements and routings to start from, if any, and where to stop
+	char *from_placement = NULL, *from_routing = NULL;
+	enum phase stop_after = PHASE_EXTRACT;
+	enum output_format format = FORMAT_YAML;
+
 	// process long options
 	static struct option longopts[] = {
 		// {"library", optional_argument, NULL, 'l'},
 		{"output" , optional_argument, NULL, 'o'},
 		{"seed"   , optional_argument, NULL, 's'},
+		{"router" , required_argument, NULL, 'r'},
+		{"route-threads", required_argument, NULL, 'j'},
+		{"line-probe", no_argument, NULL, 'p'},
+		{"global-route", no_argument, NULL, 'g'},
+		{"local-repair", no_argument, NULL, 'L'},
+		{"route-time-limit", required_argument, NULL, 't'},
+		{"route-iteration-limit", required_argument, NULL, 'n'},
+		{"log", required_argument, NULL, 'v'},
+		{"eco", required_argument, NULL, 'e'},
+		{"format", required_argument, NULL, 'f'},
+		{"from-placement", required_argument, NULL, 'P'},
+		{"from-routing", required_argument, NULL, 'R'},
+		{"stop-after", required_argument, NULL, 'S'},
 		{NULL,                      0, NULL,   0}
 	};
 
-	char c;
-	int options_supplied = 0;
-	while ((c = getopt_long(argc, argv, "i:o:s:", longopts, NULL)) != -1) {
+	int c;
+	while ((c = getopt_long(argc, argv, "i:o:s:r:j:pgLt:n:v:e:f:P:R:S:", longopts, NULL)) != -1) {
 		switch (c) {
 		case 'o':
 			realpath(optarg, output_dir);
@@ -59,19 +168,114 @@ int main(int argc, char **argv)
 		case 's':
 			seed = atoi(optarg);
 			break;
+		case 'r':
+			if (strcmp(optarg, "rip-up") == 0) {
+				ro.mode = ROUTING_RIP_UP;
+			} else if (strcmp(optarg, "negotiated") == 0 || strcmp(optarg, "pathfinder") == 0) {
+				ro.mode = ROUTING_NEGOTIATED;
+			} else {
+				printf("[dewey] unknown routing mode %s\n", optarg);
+				usage(argv0);
+				return 1;
+			}
+			break;
+		case 'j':
+			ro.threads = atoi(optarg);
+			if (ro.threads < 1) {
+				printf("[dewey] route threads must be at least 1\n");
+				usage(argv0);
+				return 1;
+			}
+			break;
+		case 'p':
+			ro.net_router = NET_ROUTER_LINE;
+			break;
+		case 'g':
+			ro.global_route = 1;
+			break;
+		case 'L':
+			ro.local_repair = 1;
+			break;
+		case 't':
+			ro.time_limit = atoi(optarg);
+			if (ro.time_limit < 1) {
+				printf("[dewey] route time limit must be at least 1 second\n");
+				usage(argv0);
+				return 1;
+			}
+			break;
+		case 'n':
+			ro.iteration_limit = atoi(optarg);
+			if (ro.iteration_limit < 1) {
+				printf("[dewey] route iteration limit must be at least 1\n");
+				usage(argv0);
+				return 1;
+			}
+			break;
+		case 'v':
+			if (!log_set_levels(optarg)) {
+				usage(argv0);
+				return 1;
+			}
+			break;
+		case 'e':
+			eco_dir = optarg;
+			break;
+		case 'f':
+			if (strcmp(optarg, "yaml") == 0) {
+				format = FORMAT_YAML;
+			} else if (strcmp(optarg, "binary") == 0) {
+				format = FORMAT_BINARY;
+			} else {
+				printf("[dewey] unknown format %s\n", optarg);
+				usage(argv0);
+				return 1;
+			}
+			break;
+		case 'P':
+			from_placement = optarg;
+			break;
+		case 'R':
+			from_routing = optarg;
+			break;
+		case 'S':
+			if (strcmp(optarg, "place") == 0) {
+				stop_after = PHASE_PLACE;
+			} else if (strcmp(optarg, "route") == 0) {
+				stop_after = PHASE_ROUTE;
+			} else {
+				printf("[dewey] unknown phase %s\n", optarg);
+				usage(argv0);
+				return 1;
+			}
+			break;
 		default:
 			usage(argv0);
 			return 1;
 		}
-		argc -= optind;
-		argv += optind;
-		options_supplied++;
 	}
 
-	if (!options_supplied && argc == 2)
-		input_blif = argv[1];
-	else if (options_supplied && argc == 1)
-		input_blif = argv[0];
+	if (optind == argc - 1)
+		input_blif = argv[optind];
+
+	// routings only make sense on the placements they were routed on
+	if (from_routing && !from_placement) {
+		printf("[dewey] --from-routing needs the placements it was routed with, given with --from-placement\n");
+		usage(argv0);
+		return 1;
+	}
+
+	if (eco_dir && from_placement) {
+		printf("[dewey] --eco and --from-placement cannot be used together\n");
+		usage(argv0);
+		return 1;
+	}
+
+	if (from_routing && stop_after == PHASE_PLACE) {
+		printf("[dewey] --from-routing has nothing to do if stopping after placement\n");
+		usage(argv0);
+		return 1;
+	}
 
 	// process output dir
 	strncat(output_dir, "/", MAXPATHLEN-1);
@@ -97,7 +301,7 @@ int main(int argc, char **argv)
 	blif_file = fopen(input_blif, "r");
 
         if (!blif_file) {
-                printf("[dewey] could not read %s: %s\n", argv[1], strerror(errno));
+                printf("[dewey] could not read %s: %s\n", input_blif, strerror(errno));
                 return 2;
         }
 
@@ -132,48 +336,184 @@ int main(int argc, char **argv)
 	printf("[dewey] intial dimensions: {x: %d, y: %d, z: %d}\n",
 		initial_dimensions.x, initial_dimensions.y, initial_dimensions.z);
 
+	// read the previous run to start from, before anything in output_dir
+	// (which may be the same directory) is written over
+	struct serialized_placements *previous_placements = NULL;
+	if (eco_dir) {
+		FILE *f = open_previous(eco_dir, "placements");
+		if (f) {
+			previous_placements = load_placements(f);
+			fclose(f);
+		}
+
+		f = open_previous(eco_dir, "routings");
+		if (f) {
+			ro.previous = load_routings(f);
+			fclose(f);
+		}
+
+		if (!previous_placements || !ro.previous) {
+			printf("[dewey] could not read the placements and routings in %s\n", eco_dir);
+			return 2;
+		}
+	}
+
+	struct serialized_placements *given_placements = NULL;
+	if (from_placement) {
+		FILE *f = fopen(from_placement, "rb");
+		if (f) {
+			given_placements = load_placements(f);
+			fclose(f);
+		}
+
+		if (!given_placements) {
+			printf("[dewey] could not read placements from %s\n", from_placement);
+			return 2;
+		}
+	}
+
+	struct serialized_routings *given_routings = NULL;
+	if (from_routing) {
+		FILE *f = fopen(from_routing, "rb");
+		if (f) {
+			given_routings = load_routings(f);
+			fclose(f);
+		}
+
+		if (!given_routings) {
+			printf("[dewey] could not read routings from %s\n", from_routing);
+			return 2;
+		}
+	}
+
 	// perform actual placement
 	printf("[dewey] beginning placement...\n");
-	struct cell_placements *new_placements;
-	new_placements = simulated_annealing_placement(initial_placement, &initial_dimensions, 100, 100, 100);
+	struct cell_placements *new_placements = NULL;
+	if (given_placements) {
+		int placed = eco_restore_placements(initial_placement, blif, given_placements);
+		free_serialized_placements(given_placements);
+		if (!placed) {
+			printf("[dewey] the placements in %s are not of this design\n", from_placement);
+			return 2;
+		}
+		new_placements = initial_placement;
+		printf("[dewey] took placements from %s\n", from_placement);
+	} else if (eco_dir) {
+		ro.fixed_nets = eco_place(initial_placement, blif, previous_placements, ro.previous);
+		if (ro.fixed_nets) {
+			new_placements = initial_placement;
+		} else {
+			free_serialized_routings(ro.previous);
+			ro.previous = NULL;
+		}
+		free_serialized_placements(previous_placements);
+	}
+	if (!new_placements)
+		new_placements = simulated_annealing_placement(initial_placement, &initial_dimensions, 100, 100, 100);
 	// struct cell_placements *new_placements = initial_placement;
 	// print_cell_placements(new_placements);
 
 	vis_png_draw_placements(output_dir, blif, new_placements, NULL, 0);
 
 	// write placements to file
-	char *pfn;
-	asprintf(&pfn, "%s/placements.yaml", output_dir);
-	FILE *pf = fopen(pfn, "w");
-	serialize_placements(pf, new_placements, blif);
-	fclose(pf);
-	free(pfn);
+	write_placements(output_dir, new_placements, blif, format);
 
 	struct dimensions placement_dimensions = compute_placement_dimensions(new_placements);
 	printf("[dewey] placement dimensions: {x: %d, y: %d, z: %d}\n",
 		placement_dimensions.x, placement_dimensions.y, placement_dimensions.z);
 
-	printf("[dewey] beginning routing...\n");
-	struct routings *routings = route(blif, new_placements);
+	if (stop_after == PHASE_PLACE) {
+		free_blif(blif);
+		free_cell_library(cl);
+
+		printf("[dewey] stopped after placement\n");
+		return 0;
+	}
+
+	enum routing_status status;
+	struct routings *routings;
+	if (given_routings) {
+		routings = load_serialized_routings(blif, new_placements, given_routings, &status);
+		free_serialized_routings(given_routings);
+		if (!routings) {
+			printf("[dewey] the routings in %s are not of this design\n", from_routing);
+			return 2;
+		}
+		printf("[dewey] took routings from %s\n", from_routing);
+	} else {
+		printf("[dewey] beginning routing...\n");
+		char *lfn;
+		asprintf(&lfn, "%s/router.log", output_dir);
+		if (!log_open(lfn))
+			printf("[dewey] could not open %s: %s\n", lfn, strerror(errno));
+		free(lfn);
+
+		routings = route(blif, new_placements, &ro, &status);
+		log_close();
+
+		if (ro.previous) {
+			free_serialized_routings(ro.previous);
+			free(ro.fixed_nets);
+		}
+	}
+
+	// routing moves the design to non-negative coordinates; write the
+	// placements again, so that they are where the routings are
+	write_placements(output_dir, new_placements, blif, format);
 
 	// write routings to file
-	char *rfn;
-	asprintf(&rfn, "%s/routings.yaml", output_dir);
-	FILE *rf = fopen(rfn, "w");
-	serialize_routings(rf, routings, blif);
-	fclose(rf);
-	free(rfn);
+	write_routings(output_dir, routings, blif, format);
+
+	// write where the router spent its effort, per iteration and per net
+	if (!given_routings) {
+		char *sfn;
+		asprintf(&sfn, "%s/router_stats.json", output_dir);
+		FILE *sf = fopen(sfn, "w");
+		report_routing_effort(sf, routings, blif);
+		fclose(sf);
+		free(sfn);
+	}
+
+	// list the nets left in violation, for deciding whether to try again
+	// with another placement
+	if (status == ROUTING_INCOMPLETE) {
+		char *vfn;
+		asprintf(&vfn, "%s/violations.yaml", output_dir);
+		FILE *vf = fopen(vfn, "w");
+		report_routing_violations(vf, new_placements, routings, blif);
+		fclose(vf);
+		free(vfn);
+		printf("[dewey] wrote the nets left in violation to violations.yaml\n");
+	}
+
+	if (stop_after == PHASE_ROUTE) {
+		free_blif(blif);
+		free_cell_library(cl);
+
+		printf("[dewey] stopped after routing\n");
+		return status == ROUTING_INCOMPLETE ? 4 : 0;
+	}
 
 	// write extraction to file
 	printf("[dewey] beginning extraction...\n");
 	char *efn;
 	asprintf(&efn, "%s/extraction.yaml", output_dir);
+	struct extraction *extraction = extract(new_placements, routings, ro.threads);
 	FILE *ef = fopen(efn, "w");
-	serialize_extraction(ef, extract(new_placements, routings));
+	serialize_extraction(ef, extraction);
 	fclose(ef);
 	free(efn);
 	printf("[dewey] wrote extraction to extraction.yaml\n");
 
+	// and as a schematic, to be pasted into a world with WorldEdit
+	asprintf(&efn, "%s/extraction.schem", output_dir);
+	if (write_schematic(efn, extraction))
+		printf("[dewey] wrote extraction to extraction.schem\n");
+	else
+		printf("[dewey] could not write %s\n", efn);
+	free(efn);
+	free_extraction(extraction);
+
 	// draw placements
 	vis_png_draw_placements(output_dir, blif, new_placements, routings, 2);
 
@@ -182,5 +522,5 @@ int main(int argc, char **argv)
 
 	printf("[dewey] done!\n");
 
-	return 0;
+	return status == ROUTING_INCOMPLETE ? 4 : 0;
 }
@@ -0,0 +1,97 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+
+#include "anvil.h"
+#include "extract.h"
+#include "serializer.h"
+
+// dewey-insert writes an extraction straight into the region files of a
+// world, taking the place of scripts/inserter.py
+
+void usage(char *argv0)
+{
+	printf("dewey-insert -- place a design extracted by dewey into a Minecraft world\n");
+	printf("\n");
+	printf("Usage: %s [options] <extraction.yaml> <world folder>\n", argv0);
+	printf("Options:\n");
+	printf("  -x, --x=<n>                Put the design's lowest corner at x = n (default 0)\n");
+	printf("  -y, --y=<n>                ... at y = n (default 4)\n");
+	printf("  -z, --z=<n>                ... at z = n (default 0)\n");
+	printf("  -F, --no-floor             Do not lay a floor of grass under the design\n");
+	printf("\n");
+	printf("The world must be from Minecraft 1.12 or earlier; for later versions, paste\n");
+	printf("extraction.schem with WorldEdit instead.\n");
+}
+
+int main(int argc, char **argv)
+{
+	char *argv0 = argv[0];
+
+	// where the design goes, as scripts/inserter.py put it
+	struct coordinate origin = {4, 0, 0};
+	int lay_floor = 1;
+
+	static struct option longopts[] = {
+		{"x", required_argument, NULL, 'x'},
+		{"y", required_argument, NULL, 'y'},
+		{"z", required_argument, NULL, 'z'},
+		{"no-floor", no_argument, NULL, 'F'},
+		{NULL,    0, NULL,   0}
+	};
+
+	int c;
+	while ((c = getopt_long(argc, argv, "x:y:z:F", longopts, NULL)) != -1) {
+		switch (c) {
+		case 'x':
+			origin.x = atoi(optarg);
+			break;
+		case 'y':
+			origin.y = atoi(optarg);
+			break;
+		case 'z':
+			origin.z = atoi(optarg);
+			break;
+		case 'F':
+			lay_floor = 0;
+			break;
+		default:
+			usage(argv0);
+			return 1;
+		}
+	}
+
+	if (optind != argc - 2) {
+		usage(argv0);
+		return 1;
+	}
+
+	char *extraction_fn = argv[optind];
+	char *world = argv[optind + 1];
+
+	FILE *f = fopen(extraction_fn, "r");
+	if (!f) {
+		printf("[dewey-insert] could not read %s: %s\n", extraction_fn, strerror(errno));
+		return 2;
+	}
+
+	printf("[dewey-insert] reading in extraction\n");
+	struct extraction *e = deserialize_extraction(f);
+	fclose(f);
+	if (!e)
+		return 2;
+
+	struct dimensions d = e->dimensions;
+	printf("[dewey-insert] inserting %d x %d x %d blocks at (%d, %d, %d)\n",
+	       d.y, d.z, d.x, origin.y, origin.z, origin.x);
+	int ok = anvil_insert(world, e, origin, lay_floor);
+	free_extraction(e);
+
+	if (!ok)
+		return 3;
+
+	printf("[dewey-insert] inserted extraction into %s\n", world);
+	return 0;
+}
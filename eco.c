@@ -0,0 +1,576 @@
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base_router.h"
+#include "blif.h"
+#include "eco.h"
+#include "placer.h"
+#include "router.h"
+#include "serializer.h"
+#include "util.h"
+
+// further from the origin than any design reaches; placements given from
+// a file are checked against it before anything is made of them
+#define ECO_MAX_SPAN 4096
+
+/* ENGINEERING CHANGE ORDERS
+
+   an ECO run starts from the placements and routings of a previous run
+   of a slightly different netlist. cells carry no names of their own in a
+   BLIF, so a cell is the same as a previous one if it maps to the same
+   logic cell and its pins connect to nets of the same names; such cells
+   are put back where they were. a net keeps its previous route if every
+   cell on it was kept and it has as many pins as it did, so that its route
+   still joins exactly its pins. the remaining cells are placed, one at a
+   time, where they fit among everything kept for the least wire length,
+   and only the remaining nets are routed. */
+
+// names, sorted for lookup, each with an index
+struct name_index {
+	const char *name;
+	int i;
+};
+
+static int name_index_cmp(const void *a, const void *b)
+{
+	return strcmp(((struct name_index *)a)->name, ((struct name_index *)b)->name);
+}
+
+static struct name_index *index_net_names(struct blif *blif)
+{
+	struct name_index *ni = malloc(blif->n_nets * sizeof(struct name_index));
+	for (net_t i = 1; i < blif->n_nets; i++)
+		ni[i - 1] = (struct name_index){blif->net_names[i], i};
+	qsort(ni, blif->n_nets - 1, sizeof(struct name_index), name_index_cmp);
+
+	return ni;
+}
+
+// the net named name, or 0 if there is none
+static net_t find_net(struct name_index *ni, struct blif *blif, const char *name)
+{
+	struct name_index key = {name, 0};
+	struct name_index *found = bsearch(&key, ni, blif->n_nets - 1, sizeof(struct name_index), name_index_cmp);
+
+	return found ? found->i : 0;
+}
+
+// a cell is identified by its logic cell and the names of its nets, in
+// pin order, joined as "cell net net ..."
+static char *cell_key(const char *cell, int n_nets, char **nets)
+{
+	size_t len = strlen(cell) + 1;
+	for (int i = 0; i < n_nets; i++)
+		len += strlen(nets[i]) + 1;
+
+	char *key = malloc(len);
+	strcpy(key, cell);
+	for (int i = 0; i < n_nets; i++) {
+		strcat(key, " ");
+		strcat(key, nets[i]);
+	}
+
+	return key;
+}
+
+static char *placement_key(struct placement *p, struct blif *blif)
+{
+	char **nets = malloc(p->cell->n_pins * sizeof(char *));
+	for (int i = 0; i < p->cell->n_pins; i++)
+		nets[i] = get_net_name(blif, p->nets[i]);
+
+	char *key = cell_key(p->cell->name, p->cell->n_pins, nets);
+	free(nets);
+
+	return key;
+}
+
+// put each cell that was in the previous placements back where it was;
+// returns whether each cell was kept
+static unsigned char *keep_previous_cells(struct cell_placements *cp, struct blif *blif, struct serialized_placements *sp)
+{
+	struct name_index *previous = malloc(sp->n_placements * sizeof(struct name_index));
+	for (int j = 0; j < sp->n_placements; j++) {
+		struct serialized_placement *s = &sp->placements[j];
+		previous[j] = (struct name_index){cell_key(s->cell, s->n_nets, s->nets), j};
+	}
+	qsort(previous, sp->n_placements, sizeof(struct name_index), name_index_cmp);
+
+	unsigned char *used = calloc(sp->n_placements, sizeof(unsigned char));
+	unsigned char *kept = calloc(cp->n_placements, sizeof(unsigned char));
+
+	for (int i = 0; i < cp->n_placements; i++) {
+		struct placement *p = &cp->placements[i];
+		struct name_index key = {placement_key(p, blif), 0};
+
+		// identical cells on identical nets are matched in any order
+		struct name_index *found = bsearch(&key, previous, sp->n_placements, sizeof(struct name_index), name_index_cmp);
+		while (found && found > previous && strcmp((found - 1)->name, key.name) == 0)
+			found--;
+		while (found && found < previous + sp->n_placements && strcmp(found->name, key.name) == 0 && used[found->i])
+			found++;
+
+		if (found && found < previous + sp->n_placements && strcmp(found->name, key.name) == 0) {
+			struct serialized_placement *s = &sp->placements[found->i];
+			used[found->i] = 1;
+			kept[i] = 1;
+			p->placement = s->placement;
+			p->turns = s->turns;
+		}
+
+		free((char *)key.name);
+	}
+
+	for (int j = 0; j < sp->n_placements; j++)
+		free((char *)previous[j].name);
+	free(previous);
+	free(used);
+
+	return kept;
+}
+
+// the nets whose previous routes can be kept: every cell on them was kept,
+// and they have as many pins as they did
+static unsigned char *find_fixed_nets(struct cell_placements *cp, struct blif *blif, struct name_index *ni,
+		struct serialized_placements *sp, struct serialized_routings *sr, unsigned char *kept)
+{
+	int *n_pins = calloc(blif->n_nets, sizeof(int));
+	int *n_previous_pins = calloc(blif->n_nets, sizeof(int));
+	unsigned char *fixed = calloc(blif->n_nets, sizeof(unsigned char));
+
+	for (int j = 0; j < sr->n_nets; j++) {
+		net_t net = find_net(ni, blif, sr->nets[j].name);
+		if (net && sr->nets[j].n_segments > 0)
+			fixed[net] = 1;
+	}
+
+	for (int i = 0; i < cp->n_placements; i++) {
+		struct placement *p = &cp->placements[i];
+		for (int k = 0; k < p->cell->n_pins; k++) {
+			n_pins[p->nets[k]]++;
+			if (!kept[i])
+				fixed[p->nets[k]] = 0;
+		}
+	}
+
+	for (int j = 0; j < sp->n_placements; j++)
+		for (int k = 0; k < sp->placements[j].n_nets; k++)
+			n_previous_pins[find_net(ni, blif, sp->placements[j].nets[k])]++;
+
+	fixed[0] = 0;
+	for (net_t i = 1; i < blif->n_nets; i++)
+		if (n_pins[i] != n_previous_pins[i])
+			fixed[i] = 0;
+
+	free(n_pins);
+	free(n_previous_pins);
+
+	return fixed;
+}
+
+/* a map, in x and z, of the blocks taken by kept cells and routes, with
+   a table of sums over it so that whether a rectangle is free is found in
+   constant time */
+struct free_space {
+	struct coordinate origin; // y unused
+	int d_z, d_x;
+	unsigned char *taken;
+	int *sums; // (d_z + 1) * (d_x + 1), sums[z][x] counts taken blocks above and left
+};
+
+static void take_block(struct free_space *fs, int z, int x)
+{
+	z -= fs->origin.z;
+	x -= fs->origin.x;
+	if (z >= 0 && z < fs->d_z && x >= 0 && x < fs->d_x)
+		fs->taken[z * fs->d_x + x] = 1;
+}
+
+static void take_cell(struct free_space *fs, struct placement *p)
+{
+	struct dimensions pd = p->cell->dimensions[p->turns];
+	for (int z = 0; z < pd.z; z++)
+		for (int x = 0; x < pd.x; x++)
+			take_block(fs, p->placement.z + z, p->placement.x + x);
+}
+
+static void sum_free_space(struct free_space *fs)
+{
+	int w = fs->d_x + 1;
+	memset(fs->sums, 0, (fs->d_z + 1) * w * sizeof(int));
+	for (int z = 0; z < fs->d_z; z++)
+		for (int x = 0; x < fs->d_x; x++)
+			fs->sums[(z + 1) * w + x + 1] = fs->taken[z * fs->d_x + x] +
+				fs->sums[z * w + x + 1] + fs->sums[(z + 1) * w + x] - fs->sums[z * w + x];
+}
+
+// whether the blocks from (z1, x1) up to (z2, x2) are all free and in the map
+static int rectangle_free(struct free_space *fs, int z1, int x1, int z2, int x2)
+{
+	z1 -= fs->origin.z;
+	z2 -= fs->origin.z;
+	x1 -= fs->origin.x;
+	x2 -= fs->origin.x;
+	if (z1 < 0 || x1 < 0 || z2 > fs->d_z || x2 > fs->d_x)
+		return 0;
+
+	int w = fs->d_x + 1;
+	return fs->sums[z2 * w + x2] - fs->sums[z1 * w + x2] - fs->sums[z2 * w + x1] + fs->sums[z1 * w + x1] == 0;
+}
+
+// where the cells of each net are, on average, among those placed so far
+struct net_centers {
+	long *z, *x;
+	int *n;
+};
+
+static void add_to_centers(struct net_centers *nc, struct placement *p)
+{
+	struct dimensions pd = p->cell->dimensions[p->turns];
+	for (int k = 0; k < p->cell->n_pins; k++) {
+		nc->z[p->nets[k]] += p->placement.z + pd.z / 2;
+		nc->x[p->nets[k]] += p->placement.x + pd.x / 2;
+		nc->n[p->nets[k]]++;
+	}
+}
+
+// bounds (in x) of the cells kept left and right, which new cells stay
+// between
+struct eco_columns {
+	int left, left_end;   // x of the left column, and one past its cells
+	int right;            // x of the right column
+	int have_left, have_right;
+};
+
+// place cell p, which was not kept, where it fits among what has been
+// placed so far for the least distance to the other cells on its nets,
+// and then the least growth of the design
+static void place_new_cell(struct placement *p, struct free_space *fs, struct net_centers *nc,
+		struct eco_columns *cols, struct coordinate *tl, struct coordinate *br)
+{
+	long best_cost = LONG_MAX;
+	struct coordinate best = {0, 0, 0};
+	unsigned long best_turns = 0;
+	int m = p->margin;
+
+	int n_turns = p->constraints & CONSTR_NO_ROTATE ? 1 : 4;
+	for (unsigned long t = 0; t < n_turns; t++) {
+		struct dimensions pd = p->cell->dimensions[t];
+
+		// cells kept to a side stay in that side's column
+		int x_lo = fs->origin.x, x_hi = fs->origin.x + fs->d_x - 1;
+		if (p->constraints & CONSTR_KEEP_LEFT) {
+			x_lo = x_hi = cols->left;
+		} else if (p->constraints & CONSTR_KEEP_RIGHT) {
+			x_lo = x_hi = cols->right;
+		} else {
+			if (cols->have_left)
+				x_lo = max(x_lo, cols->left_end + m);
+			if (cols->have_right)
+				x_hi = min(x_hi, cols->right - m - pd.x);
+		}
+
+		for (int z = fs->origin.z; z < fs->origin.z + fs->d_z; z++) {
+			for (int x = x_lo; x <= x_hi; x++) {
+				if (!rectangle_free(fs, z - m, x - m, z + pd.z + m, x + pd.x + m))
+					continue;
+
+				long cz = z + pd.z / 2, cx = x + pd.x / 2;
+				long cost = 0;
+				for (int k = 0; k < p->cell->n_pins; k++) {
+					net_t net = p->nets[k];
+					if (nc->n[net])
+						cost += labs(cz - nc->z[net] / nc->n[net]) + labs(cx - nc->x[net] / nc->n[net]);
+				}
+
+				int grow_z = max(tl->z - z, 0) + max(z + (int)pd.z - 1 - br->z, 0);
+				int grow_x = max(tl->x - x, 0) + max(x + (int)pd.x - 1 - br->x, 0);
+				cost = cost * 4 + grow_z + grow_x;
+
+				if (cost < best_cost) {
+					best_cost = cost;
+					best = (struct coordinate){0, z, x};
+					best_turns = t;
+				}
+			}
+		}
+	}
+
+	// nothing fits inside the map; put the cell past the design's east side
+	if (best_cost == LONG_MAX) {
+		printf("[eco] no room for a %s among the kept cells\n", p->cell->name);
+		best = (struct coordinate){0, tl->z, br->x + m + 1};
+		best_turns = 0;
+	}
+
+	p->placement = best;
+	p->turns = best_turns;
+
+	struct dimensions pd = p->cell->dimensions[p->turns];
+	*tl = coordinate_piecewise_min(*tl, p->placement);
+	*br = coordinate_piecewise_max(*br, coordinate_add(p->placement, (struct coordinate){pd.y - 1, pd.z - 1, pd.x - 1}));
+}
+
+// every block (in x and z) of the previous route of net
+static void take_route(struct free_space *fs, struct serialized_net *sn, struct coordinate *tl, struct coordinate *br)
+{
+	for (int s = 0; s < sn->n_segments; s++) {
+		struct serialized_segment *ss = &sn->segments[s];
+		struct coordinate c = ss->end;
+		for (int k = 0; k <= ss->n_backtraces; k++) {
+			if (fs)
+				take_block(fs, c.z, c.x);
+			if (tl) {
+				*tl = coordinate_piecewise_min(*tl, c);
+				*br = coordinate_piecewise_max(*br, c);
+			}
+			if (k < ss->n_backtraces && ss->bt[k] != BT_START)
+				c = disp_backtrace(c, ss->bt[k]);
+		}
+	}
+}
+
+/* place cp, as initially placed, from the previous placements sp and
+   routings sr: cells that were there before are put back, and the rest
+   are placed around them. returns which nets (by net_t) keep their
+   previous routes, to be given to route, or NULL (leaving cp as it was)
+   if no cell could be kept */
+unsigned char *eco_place(struct cell_placements *cp, struct blif *blif, struct serialized_placements *sp, struct serialized_routings *sr)
+{
+	unsigned char *kept = keep_previous_cells(cp, blif, sp);
+
+	int n_kept = 0;
+	for (int i = 0; i < cp->n_placements; i++)
+		n_kept += kept[i];
+
+	if (!n_kept) {
+		printf("[eco] none of the previous cells are in this design\n");
+		free(kept);
+		return NULL;
+	}
+
+	struct name_index *ni = index_net_names(blif);
+	unsigned char *fixed = find_fixed_nets(cp, blif, ni, sp, sr, kept);
+
+	// the extent of everything kept, and the columns of kept pins
+	struct coordinate tl = {INT_MAX, INT_MAX, INT_MAX}, br = {INT_MIN, INT_MIN, INT_MIN};
+	struct eco_columns cols = {INT_MAX, INT_MIN, INT_MIN, 0, 0};
+	int area = 0, largest = 0, margin = 0;
+	for (int i = 0; i < cp->n_placements; i++) {
+		struct placement *p = &cp->placements[i];
+		struct dimensions pd = p->cell->dimensions[p->turns];
+		if (!kept[i]) {
+			area += (pd.z + 2 * p->margin) * (pd.x + 2 * p->margin);
+			largest = max(largest, max(pd.z, pd.x));
+			margin = max(margin, p->margin);
+			continue;
+		}
+
+		struct coordinate end = coordinate_add(p->placement, (struct coordinate){pd.y - 1, pd.z - 1, pd.x - 1});
+		tl = coordinate_piecewise_min(tl, p->placement);
+		br = coordinate_piecewise_max(br, end);
+
+		if (p->constraints & CONSTR_KEEP_LEFT) {
+			cols.have_left = 1;
+			cols.left = min(cols.left, p->placement.x);
+			cols.left_end = max(cols.left_end, end.x + 1);
+		} else if (p->constraints & CONSTR_KEEP_RIGHT) {
+			cols.have_right = 1;
+			cols.right = max(cols.right, p->placement.x);
+		}
+	}
+
+	for (int j = 0; j < sr->n_nets; j++)
+		if (fixed[find_net(ni, blif, sr->nets[j].name)])
+			take_route(NULL, &sr->nets[j], &tl, &br);
+
+	if (!cols.have_left)
+		cols.left = tl.x;
+	if (!cols.have_right)
+		cols.right = br.x + margin + 1;
+
+	// room around the kept design for every new cell
+	int pad = 2 * margin + largest + (int)ceil(sqrt(area));
+	struct free_space fs;
+	fs.origin = (struct coordinate){0, tl.z - pad, min(tl.x, cols.left) - pad};
+	fs.d_z = br.z - tl.z + 1 + 2 * pad;
+	fs.d_x = max(br.x, cols.right) - fs.origin.x + 1 + pad;
+	fs.taken = calloc(fs.d_z * fs.d_x, sizeof(unsigned char));
+	fs.sums = malloc((fs.d_z + 1) * (fs.d_x + 1) * sizeof(int));
+
+	struct net_centers nc = {calloc(blif->n_nets, sizeof(long)), calloc(blif->n_nets, sizeof(long)), calloc(blif->n_nets, sizeof(int))};
+	for (int i = 0; i < cp->n_placements; i++) {
+		if (kept[i]) {
+			take_cell(&fs, &cp->placements[i]);
+			add_to_centers(&nc, &cp->placements[i]);
+		}
+	}
+	for (int j = 0; j < sr->n_nets; j++)
+		if (fixed[find_net(ni, blif, sr->nets[j].name)])
+			take_route(&fs, &sr->nets[j], NULL, NULL);
+	sum_free_space(&fs);
+
+	int n_fixed = 0;
+	for (net_t i = 1; i < blif->n_nets; i++)
+		n_fixed += fixed[i];
+	printf("[eco] kept %d of %lu cells and the routes of %d of %u nets\n",
+	       n_kept, cp->n_placements, n_fixed, blif->n_nets - 1);
+
+	for (int i = 0; i < cp->n_placements; i++) {
+		struct placement *p = &cp->placements[i];
+		if (kept[i])
+			continue;
+
+		place_new_cell(p, &fs, &nc, &cols, &tl, &br);
+		printf("[eco] placed new %s at (%d, %d, %d), %lu turns\n",
+		       p->cell->name, p->placement.y, p->placement.z, p->placement.x, p->turns);
+
+		take_cell(&fs, p);
+		add_to_centers(&nc, p);
+		sum_free_space(&fs);
+	}
+
+	for (int i = 0; i < cp->n_placements; i++)
+		placement_moved(cp, i);
+
+	free(nc.z);
+	free(nc.x);
+	free(nc.n);
+	free(fs.taken);
+	free(fs.sums);
+	free(ni);
+	free(kept);
+
+	return fixed;
+}
+
+// join the segments of rn, loaded from a previous run, to each other and
+// to its pins, as the maze router would have: each segment hangs from one
+// that it touches, and each pin from a segment that reaches it
+static void join_loaded_segments(struct routed_net *rn)
+{
+	struct routed_segment_head *root = rn->routed_segments;
+	if (!root)
+		return;
+
+	int progress = 1;
+	while (progress) {
+		progress = 0;
+		for (struct routed_segment_head *rsh = root->next; rsh; rsh = rsh->next) {
+			struct routed_segment *rseg = &rsh->rseg;
+			if (rseg->up)
+				continue;
+
+			for (struct routed_segment_head *ph = root; ph; ph = ph->next) {
+				struct routed_segment *parent = &ph->rseg;
+				if (parent == rseg || (parent != &root->rseg && !parent->up))
+					continue;
+
+				struct coordinate at;
+				if (path_contains(parent, rseg->seg.start))
+					at = rseg->seg.start;
+				else if (path_contains(parent, rseg->seg.end))
+					at = rseg->seg.end;
+				else if (path_contains(rseg, parent->seg.start))
+					at = parent->seg.start;
+				else if (path_contains(rseg, parent->seg.end))
+					at = parent->seg.end;
+				else
+					continue;
+
+				add_adjacent_segment(rn, parent, rseg, at);
+				progress = 1;
+				break;
+			}
+		}
+	}
+
+	// a segment that touches nothing still belongs to the net
+	for (struct routed_segment_head *rsh = root->next; rsh; rsh = rsh->next)
+		if (!rsh->rseg.up)
+			add_adjacent_segment(rn, &root->rseg, &rsh->rseg, rsh->rseg.seg.start);
+
+	for (int i = 0; i < rn->n_pins; i++) {
+		struct coordinate c = extend_pin(&rn->pins[i]);
+		struct routed_segment *touching = &root->rseg;
+		for (struct routed_segment_head *rsh = root; rsh; rsh = rsh->next) {
+			if (path_contains(&rsh->rseg, c)) {
+				touching = &rsh->rseg;
+				break;
+			}
+		}
+		add_adjacent_pin(rn, touching, &rn->pins[i]);
+	}
+}
+
+/* put every cell of cp, as initially placed, where it is in the placements
+   sp (of this same design); returns 0, leaving cp partly placed, if a cell
+   of cp is not in sp or sp has cells cp does not */
+int eco_restore_placements(struct cell_placements *cp, struct blif *blif, struct serialized_placements *sp)
+{
+	for (int j = 0; j < sp->n_placements; j++) {
+		struct coordinate c = sp->placements[j].placement;
+		if (sp->placements[j].turns > 3 || c.y < 0 || c.y > ECO_MAX_SPAN ||
+		    c.z < -ECO_MAX_SPAN || c.z > ECO_MAX_SPAN || c.x < -ECO_MAX_SPAN || c.x > ECO_MAX_SPAN) {
+			printf("[eco] %s is placed out of bounds\n", sp->placements[j].cell);
+			return 0;
+		}
+	}
+
+	unsigned char *kept = keep_previous_cells(cp, blif, sp);
+
+	int n_kept = 0;
+	for (int i = 0; i < cp->n_placements; i++) {
+		n_kept += kept[i];
+		if (!kept[i])
+			printf("[eco] %s is not in the placements\n", cp->placements[i].cell->name);
+		placement_moved(cp, i);
+	}
+	free(kept);
+
+	return n_kept == cp->n_placements && n_kept == sp->n_placements;
+}
+
+/* give each net marked in fixed (see eco_place) its route from the previous
+   routings sr in place of the one it was first given, and keep it */
+void eco_restore_routings(struct routings *rt, struct blif *blif, struct serialized_routings *sr, unsigned char *fixed)
+{
+	struct name_index *ni = index_net_names(blif);
+
+	for (int j = 0; j < sr->n_nets; j++) {
+		struct serialized_net *sn = &sr->nets[j];
+		net_t net = find_net(ni, blif, sn->name);
+		if (!net || net > rt->n_routed_nets || !fixed[net])
+			continue;
+
+		struct routed_net *rn = &rt->routed_nets[net];
+		net_pool_release(&rn->pool);
+		rn->routed_segments = NULL;
+		rn->adjacencies = NULL;
+
+		// segments were written in list order; add them back in reverse,
+		// so the list comes out the same
+		for (int s = sn->n_segments - 1; s >= 0; s--) {
+			struct serialized_segment *ss = &sn->segments[s];
+			struct routed_segment_head *rsh = net_pool_alloc_rsh(&rn->pool);
+			rsh->next = NULL;
+			rsh->rseg = (struct routed_segment){{ss->start, ss->end}, 0, 0, NULL, {0, 0, 0}, {0, 0, 0}, 0, rn, 0, NULL, NULL};
+			for (int k = 0; k < ss->n_backtraces; k++)
+				if (ss->bt[k] != BT_START)
+					path_append(&rn->pool, &rsh->rseg, ss->bt[k], 1);
+			path_compute_bounds(&rsh->rseg);
+
+			routed_net_add_segment_node(rn, rsh);
+		}
+
+		join_loaded_segments(rn);
+		rn->fixed = 1;
+		routings_net_changed(rt, rn);
+	}
+
+	free(ni);
+}
@@ -0,0 +1,13 @@
+#ifndef __ECO_H__
+#define __ECO_H__
+
+#include "blif.h"
+#include "placer.h"
+#include "router.h"
+#include "serializer.h"
+
+unsigned char *eco_place(struct cell_placements *, struct blif *, struct serialized_placements *, struct serialized_routings *);
+int eco_restore_placements(struct cell_placements *, struct blif *, struct serialized_placements *);
+void eco_restore_routings(struct routings *, struct blif *, struct serialized_routings *, unsigned char *);
+
+#endif /* __ECO_H__ */
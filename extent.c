@@ -0,0 +1,182 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "extent.h"
+
+static inline int axis(struct coordinate c, int a)
+{
+	return a == 0 ? c.y : (a == 1 ? c.z : c.x);
+}
+
+static inline struct coordinate from_axes(int *v)
+{
+	return (struct coordinate){v[0], v[1], v[2]};
+}
+
+void extent_tracker_init(struct extent_tracker *t, int n)
+{
+	t->n = n;
+	t->tl = malloc(n * sizeof(struct coordinate));
+	t->br = malloc(n * sizeof(struct coordinate));
+	t->present = calloc(n, sizeof(unsigned char));
+	t->n_present = 0;
+	t->offset = (struct coordinate){0, 0, 0};
+	t->dirty = malloc(n * sizeof(int));
+	t->is_dirty = calloc(n, sizeof(unsigned char));
+	t->n_dirty = 0;
+}
+
+void extent_tracker_copy(struct extent_tracker *dst, struct extent_tracker *src)
+{
+	*dst = *src;
+	dst->tl = malloc(src->n * sizeof(struct coordinate));
+	dst->br = malloc(src->n * sizeof(struct coordinate));
+	dst->present = malloc(src->n * sizeof(unsigned char));
+	dst->dirty = malloc(src->n * sizeof(int));
+	dst->is_dirty = malloc(src->n * sizeof(unsigned char));
+	memcpy(dst->tl, src->tl, src->n * sizeof(struct coordinate));
+	memcpy(dst->br, src->br, src->n * sizeof(struct coordinate));
+	memcpy(dst->present, src->present, src->n * sizeof(unsigned char));
+	memcpy(dst->dirty, src->dirty, src->n_dirty * sizeof(int));
+	memcpy(dst->is_dirty, src->is_dirty, src->n * sizeof(unsigned char));
+}
+
+void extent_tracker_free(struct extent_tracker *t)
+{
+	free(t->tl);
+	free(t->br);
+	free(t->present);
+	free(t->dirty);
+	free(t->is_dirty);
+}
+
+void extent_clear(struct extent_tracker *t, int i)
+{
+	if (!t->present[i])
+		return;
+
+	for (int a = 0; a < 3; a++) {
+		if (axis(t->tl[i], a) == t->lo[a])
+			t->n_lo[a]--;
+		if (axis(t->br[i], a) == t->hi[a])
+			t->n_hi[a]--;
+	}
+
+	t->present[i] = 0;
+	t->n_present--;
+}
+
+// set the extent of object i to run from tl to br (inclusive)
+void extent_set(struct extent_tracker *t, int i, struct coordinate tl, struct coordinate br)
+{
+	tl = coordinate_sub(tl, t->offset);
+	br = coordinate_sub(br, t->offset);
+	if (t->present[i] && coordinate_equal(tl, t->tl[i]) && coordinate_equal(br, t->br[i]))
+		return;
+
+	extent_clear(t, i);
+	t->tl[i] = tl;
+	t->br[i] = br;
+
+	// while a side has no objects on it, the box still bounds the objects
+	// from outside, so an object on or beyond it is on the side again
+	for (int a = 0; a < 3; a++) {
+		int lo = axis(tl, a), hi = axis(br, a);
+		if (!t->n_present || lo < t->lo[a]) {
+			t->lo[a] = lo;
+			t->n_lo[a] = 1;
+		} else if (lo == t->lo[a]) {
+			t->n_lo[a]++;
+		}
+
+		if (!t->n_present || hi > t->hi[a]) {
+			t->hi[a] = hi;
+			t->n_hi[a] = 1;
+		} else if (hi == t->hi[a]) {
+			t->n_hi[a]++;
+		}
+	}
+
+	t->present[i] = 1;
+	t->n_present++;
+}
+
+// move every object by disp
+void extent_shift(struct extent_tracker *t, struct coordinate disp)
+{
+	t->offset = coordinate_add(t->offset, disp);
+}
+
+int extent_empty(struct extent_tracker *t)
+{
+	return !t->n_present;
+}
+
+// find the sides of the box along axis a that no object reaches any more
+static void rescan_axis(struct extent_tracker *t, int a)
+{
+	int started = 0;
+	for (int i = 0; i < t->n; i++) {
+		if (!t->present[i])
+			continue;
+
+		int lo = axis(t->tl[i], a), hi = axis(t->br[i], a);
+		if (!started || lo < t->lo[a]) {
+			t->lo[a] = lo;
+			t->n_lo[a] = 0;
+		}
+		if (!started || hi > t->hi[a]) {
+			t->hi[a] = hi;
+			t->n_hi[a] = 0;
+		}
+		started = 1;
+
+		t->n_lo[a] += lo == t->lo[a];
+		t->n_hi[a] += hi == t->hi[a];
+	}
+}
+
+static void refresh_box(struct extent_tracker *t)
+{
+	for (int a = 0; a < 3; a++)
+		if (!t->n_lo[a] || !t->n_hi[a])
+			rescan_axis(t, a);
+}
+
+// top-left (minimum) corner of the box around every present object
+struct coordinate extent_tl(struct extent_tracker *t)
+{
+	assert(t->n_present);
+	refresh_box(t);
+	return coordinate_add(from_axes(t->lo), t->offset);
+}
+
+// bottom-right (maximum) corner of the box around every present object
+struct coordinate extent_br(struct extent_tracker *t)
+{
+	assert(t->n_present);
+	refresh_box(t);
+	return coordinate_add(from_axes(t->hi), t->offset);
+}
+
+// note that the extent of object i has to be looked at again
+void extent_touch(struct extent_tracker *t, int i)
+{
+	if (t->is_dirty[i])
+		return;
+
+	t->is_dirty[i] = 1;
+	t->dirty[t->n_dirty++] = i;
+}
+
+// an object noted by extent_touch, or -1 if there are none left
+int extent_next_dirty(struct extent_tracker *t)
+{
+	if (!t->n_dirty)
+		return -1;
+
+	int i = t->dirty[--t->n_dirty];
+	t->is_dirty[i] = 0;
+	return i;
+}
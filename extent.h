@@ -0,0 +1,51 @@
+#ifndef __EXTENT_H__
+#define __EXTENT_H__
+
+#include "coord.h"
+
+// extent_tracker keeps the bounding box of a set of objects (cells, nets)
+// up to date as they move, without looking at every object each time it is
+// asked for. each object has its own extent, and for each side of the box
+// the tracker counts the objects that reach it: moving an object costs
+// O(1), and only when the last object on a side moves inward is that side
+// found again by looking at every object.
+struct extent_tracker {
+	int n;
+
+	// extent of each object, relative to offset; absent objects (those
+	// never set, or cleared) do not count toward the box
+	struct coordinate *tl, *br;
+	unsigned char *present;
+	int n_present;
+
+	// added to every extent, so the whole set moves at once
+	struct coordinate offset;
+
+	// the box, relative to offset, and on each of its sides how many
+	// present objects reach it; a side no object reaches any more is
+	// found again when next asked for. indexed by axis: y, z, x
+	int lo[3], hi[3];
+	int n_lo[3], n_hi[3];
+
+	// objects whose extents are out of date, for their owner to refresh
+	int *dirty;
+	unsigned char *is_dirty;
+	int n_dirty;
+};
+
+void extent_tracker_init(struct extent_tracker *, int);
+void extent_tracker_copy(struct extent_tracker *, struct extent_tracker *);
+void extent_tracker_free(struct extent_tracker *);
+
+void extent_set(struct extent_tracker *, int, struct coordinate, struct coordinate);
+void extent_clear(struct extent_tracker *, int);
+void extent_shift(struct extent_tracker *, struct coordinate);
+
+int extent_empty(struct extent_tracker *);
+struct coordinate extent_tl(struct extent_tracker *);
+struct coordinate extent_br(struct extent_tracker *);
+
+void extent_touch(struct extent_tracker *, int);
+int extent_next_dirty(struct extent_tracker *);
+
+#endif /* __EXTENT_H__ */
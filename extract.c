@@ -1,69 +1,56 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "extract.h"
 #include "placer.h"
 #include "router.h"
 #include "base_router.h"
+#include "util.h"
 
 // mass movement routines
 struct coordinate placements_top_left_most_point(struct cell_placements *cp)
 {
-	/* select the first placement for a baseline point */
-	int unfound = 1;
-	struct coordinate d;
-
-	for (int i = 0; i < cp->n_placements; i++) {
-		struct coordinate c = cp->placements[i].placement;
-		if (unfound) {
-			d = c;
-			unfound = 0;
-		} else {
-			d = coordinate_piecewise_min(c, d);
-		}
-		// printf("[ptlmp] c = (%d, %d, %d)\n", c.y, c.z, c.x);
-	}
-
-	return d;
+	return extent_tl(&cp->cells);
 }
 
 /* determine the top-left most point of routings */
 struct coordinate routings_top_left_most_point(struct routings *rt)
 {
-	int started = 0;
-	struct coordinate d;
-
-	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
-		for (struct routed_segment_head *rsh = rt->routed_nets[i].routed_segments; rsh; rsh = rsh->next) {
-			struct coordinate c = rsh->rseg.seg.end;
-			if (!started) {
-				started = 1;
-				d = c;
-			} else {
-				d = coordinate_piecewise_min(c, d);
-			}
+	return extent_tl(routings_extents(rt));
+}
 
-			for (int k = 0; k < rsh->rseg.n_backtraces; k++) {
-				c = disp_backtrace(c, rsh->rseg.bt[k]);
-				d = coordinate_piecewise_min(c, d);
-			}
+/* determine the top-left most point of the design, placements and (if
+   provided) routings */
+struct coordinate design_top_left_most_point(struct cell_placements *cp, struct routings *rt)
+{
+	struct coordinate d = placements_top_left_most_point(cp);
 
-			d = coordinate_piecewise_min(rsh->rseg.seg.start, d);
-		}
-	}
+	if (rt && !extent_empty(routings_extents(rt)))
+		d = coordinate_piecewise_min(extent_tl(&rt->extents), d);
 
 	return d;
 }
 
+/* determine the block just past the bottom-right most point of the design,
+   placements and (if provided) routings */
+struct coordinate design_end_point(struct cell_placements *cp, struct routings *rt)
+{
+	struct coordinate d = extent_br(&cp->cells);
+
+	if (rt && !extent_empty(routings_extents(rt)))
+		d = coordinate_piecewise_max(extent_br(&rt->extents), d);
+
+	return coordinate_add(d, (struct coordinate){1, 1, 1});
+}
+
 /* move the entire design so that all coordinates are non-negative:
  * if routings are provided, consider any possible out-of-bounds routing as well,
- * and recenter the routings as well. */
-void recenter(struct cell_placements *cp, struct routings *rt, int xz_margin)
+ * and recenter the routings as well. returns the displacement applied. */
+struct coordinate recenter(struct cell_placements *cp, struct routings *rt, int xz_margin)
 {
-	struct coordinate disp = placements_top_left_most_point(cp);
-	if (rt)
-		disp = coordinate_piecewise_min(disp, routings_top_left_most_point(rt));
+	struct coordinate disp = design_top_left_most_point(cp, rt);
 
 	struct coordinate xz_add = {0, -xz_margin, -xz_margin};
 	disp = coordinate_add(disp, xz_add);
@@ -72,6 +59,8 @@ void recenter(struct cell_placements *cp, struct routings *rt, int xz_margin)
 
 	if (rt)
 		routings_displace(rt, coordinate_neg(disp));
+
+	return coordinate_neg(disp);
 }
 
 // within connection distace
@@ -86,15 +75,11 @@ static int adjacent(struct coordinate c1, struct coordinate c2)
 }
 */
 
-// extend the extracted net to fit new_size elements
+// add a block to the extracted net, which is sized for every block it
+// can be given beforehand
 static void extracted_net_append(struct extracted_net *en, struct coordinate c, block_t b, data_t d)
 {
-	if (en->n >= en->sz) {
-		en->sz *= 2;
-		en->c = realloc(en->c, sizeof(struct coordinate) * en->sz);
-		en->b = realloc(en->b, sizeof(block_t) * en->sz);
-		en->d = realloc(en->d, sizeof(data_t) * en->sz);
-	}
+	assert(en->n < en->sz);
 
 	int i = en->n++;
 	en->c[i] = c;
@@ -234,99 +219,153 @@ static void add_repeaters(enum movement *m, int* strengths, int n)
 	}
 }
 
+/* the pins (at the block in front of them) and the blocks of the segments
+   of a net, by coordinate, so that what touches a block is found without
+   walking the whole net. it is an open-addressed hash table, built once per
+   net; the pins and segments at one block are chained in the order in
+   which they are found in the net */
 struct neighbor {
-	struct coordinate at;
 	enum rsa_type tn;
 	union {
 		struct routed_segment *rseg;
 		struct placed_pin *pin;
 	} n;
+	int next; // the next neighbor at the same block, or -1
 };
 
-struct neighbors {
+struct neighbor_slot {
+	struct coordinate at;
+	int first; // -1 if the slot is empty
+	int last;
+};
+
+struct neighbor_index {
+	int n_slots; // a power of two
+	struct neighbor_slot *slots;
+
 	int n_neighbors;
+	int sz_neighbors;
 	struct neighbor *neighbors;
 };
 
-static void add_neighbor_pin(struct neighbors *n, struct placed_pin *p, struct coordinate c)
+// what touches a pin or segment: everything in the index at its blocks,
+// other than itself
+struct neighbors {
+	struct neighbor_index *index;
+	void *self;
+};
+
+static void *neighbor_of(struct neighbor *n)
 {
-	n->neighbors = realloc(n->neighbors, sizeof(struct neighbor) * ++n->n_neighbors);
-	n->neighbors[n->n_neighbors-1].at = c;
-	n->neighbors[n->n_neighbors-1].tn = PIN;
-	n->neighbors[n->n_neighbors-1].n.pin = p;
+	return n->tn == PIN ? (void *)n->n.pin : (void *)n->n.rseg;
 }
 
-static void add_neighbor_segment(struct neighbors *n, struct routed_segment *rseg, struct coordinate c)
+static struct neighbor_slot *neighbor_slot(struct neighbor_index *ni, struct coordinate c)
 {
-	n->neighbors = realloc(n->neighbors, sizeof(struct neighbor) * ++n->n_neighbors);
-	n->neighbors[n->n_neighbors-1].at = c;
-	n->neighbors[n->n_neighbors-1].tn = SEGMENT;
-	n->neighbors[n->n_neighbors-1].n.rseg = rseg;
+	unsigned int h = (unsigned int)c.y * 73856093u ^ (unsigned int)c.z * 19349663u ^ (unsigned int)c.x * 83492791u;
+	int mask = ni->n_slots - 1;
+
+	for (int i = h & mask; ; i = (i + 1) & mask)
+		if (ni->slots[i].first < 0 || coordinate_equal(ni->slots[i].at, c))
+			return &ni->slots[i];
 }
 
-static void check_adjacent(struct routed_net *rn, struct neighbors *n, struct coordinate c, void *skip)
+// the first neighbor at c, or -1
+static int neighbor_first(struct neighbor_index *ni, struct coordinate c)
 {
-	for (int i = 0; i < rn->n_pins; i++) {
-		struct placed_pin *q = &rn->pins[i];
-		if ((void *)q == skip)
-			continue;
-
-		if (coordinate_equal(c, extend_pin(q)))
-			add_neighbor_pin(n, q, c);
-	}
+	return neighbor_slot(ni, c)->first;
+}
 
-	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next) {
-		struct routed_segment *rseg = &rsh->rseg;
-		if ((void *)rseg == skip)
-			continue;
+static void add_neighbor(struct neighbor_index *ni, struct coordinate c, enum rsa_type tn, void *p)
+{
+	struct neighbor_slot *slot = neighbor_slot(ni, c);
 
-		struct segment seg = rseg->seg;
+	// a path that passes over a block twice is only entered once
+	for (int i = slot->first; i >= 0; i = ni->neighbors[i].next)
+		if (neighbor_of(&ni->neighbors[i]) == p)
+			return;
 
-		struct coordinate cc = seg.end;
-		for (int i = 0; i < rseg->n_backtraces; i++) {
-			if (coordinate_equal(c, cc))
-				add_neighbor_segment(n, rseg, c);
+	if (ni->n_neighbors == ni->sz_neighbors) {
+		ni->sz_neighbors *= 2;
+		ni->neighbors = realloc(ni->neighbors, ni->sz_neighbors * sizeof(struct neighbor));
+	}
 
-			cc = disp_backtrace(cc, rseg->bt[i]);
-		}
+	int k = ni->n_neighbors++;
+	struct neighbor *n = &ni->neighbors[k];
+	n->tn = tn;
+	if (tn == PIN)
+		n->n.pin = p;
+	else
+		n->n.rseg = p;
+	n->next = -1;
 
-		assert(coordinate_equal(cc, seg.start));
-		if (coordinate_equal(c, cc))
-			add_neighbor_segment(n, rseg, c);
+	if (slot->first < 0) {
+		slot->at = c;
+		slot->first = k;
+	} else {
+		ni->neighbors[slot->last].next = k;
 	}
+	slot->last = k;
 }
 
-static struct neighbors find_neighbors(struct routed_net *rn, struct placed_pin *p, struct routed_segment *rseg)
+static void build_neighbor_index(struct neighbor_index *ni, struct routed_net *rn)
 {
-	assert(!!p ^ !!rseg);
-
-	struct neighbors n = {0, NULL};
+	int n_blocks = rn->n_pins;
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next) {
+		n_blocks++;
+		for (int r = 0; r < rsh->rseg.n_runs; r++)
+			n_blocks += rsh->rseg.runs[r].len;
+	}
 
-	if (p) {
-		struct coordinate c = extend_pin(p);
-		check_adjacent(rn, &n, c, (void *)p);
+	// keep the table at most half full
+	ni->n_slots = 16;
+	while (ni->n_slots < 2 * n_blocks)
+		ni->n_slots *= 2;
+	ni->slots = malloc(ni->n_slots * sizeof(struct neighbor_slot));
+	for (int i = 0; i < ni->n_slots; i++)
+		ni->slots[i].first = -1;
 
-	} else if (rseg) {
-		struct segment seg = rseg->seg;
+	ni->n_neighbors = 0;
+	ni->sz_neighbors = n_blocks + 1;
+	ni->neighbors = malloc(ni->sz_neighbors * sizeof(struct neighbor));
 
-		struct coordinate c = seg.end;
-		for (int i = 0; i <= rseg->n_backtraces; i++) {
-			check_adjacent(rn, &n, c, (void *)rseg);
+	// pins come before segments at a block, as they are tried in that order
+	for (int i = 0; i < rn->n_pins; i++)
+		add_neighbor(ni, extend_pin(&rn->pins[i]), PIN, &rn->pins[i]);
 
-			if (i < rseg->n_backtraces)
-				c = disp_backtrace(c, rseg->bt[i]);
-			else
-				assert(coordinate_equal(c, seg.start));
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next) {
+		struct routed_segment *rseg = &rsh->rseg;
+		struct coordinate c = rseg->seg.end;
+		add_neighbor(ni, c, SEGMENT, rseg);
+		for (int r = 0; r < rseg->n_runs; r++) {
+			struct coordinate step = backtrace_step(rseg->runs[r].bt);
+			for (int k = 0; k < rseg->runs[r].len; k++) {
+				c = coordinate_add(c, step);
+				add_neighbor(ni, c, SEGMENT, rseg);
+			}
 		}
 	}
+}
+
+static void free_neighbor_index(struct neighbor_index *ni)
+{
+	free(ni->slots);
+	free(ni->neighbors);
+}
+
+static struct neighbors find_neighbors(struct neighbor_index *ni, struct placed_pin *p, struct routed_segment *rseg)
+{
+	assert(!!p ^ !!rseg);
 
+	struct neighbors n = {ni, p ? (void *)p : (void *)rseg};
 	return n;
 }
 
 static int has_abutting_neighbor(struct neighbors neighbors, struct coordinate at)
 {
-	for (int i = 0; i < neighbors.n_neighbors; i++)
-		if (coordinate_equal(neighbors.neighbors[i].at, at))
+	struct neighbor_index *ni = neighbors.index;
+	for (int i = neighbor_first(ni, at); i >= 0; i = ni->neighbors[i].next)
+		if (neighbor_of(&ni->neighbors[i]) != neighbors.self)
 			return 1;
 
 	return 0;
@@ -435,31 +474,33 @@ static void print_extracted_net(struct routed_net *rn)
 */
 
 // forward declarations
-static void propagate_extraction(struct extracted_net *, struct routed_net *, struct neighbors, struct coordinate, int, struct coordinate);
-static void extract_segment(struct extracted_net *, struct routed_net *rn, struct routed_segment *, struct coordinate, int, struct coordinate);
+static void propagate_extraction(struct extracted_net *, struct neighbors, struct coordinate, int, struct coordinate);
+static void extract_segment(struct extracted_net *, struct neighbor_index *, struct routed_segment *, struct coordinate, int, struct coordinate);
 
-static void extract_pin(struct extracted_net *en, struct routed_net *rn, struct placed_pin *p, int strength, struct coordinate disp)
+static void extract_pin(struct extracted_net *en, struct neighbor_index *ni, struct placed_pin *p, int strength, struct coordinate disp)
 {
-	struct neighbors neighbors = find_neighbors(rn, p, NULL);
+	struct neighbors neighbors = find_neighbors(ni, p, NULL);
 
 	p->extracted = 1;
 
 	struct coordinate c = extend_pin(p);
 	place_movement(en, c, ordinal_to_movement(p->cell_pin->facing), disp);
 
-	propagate_extraction(en, rn, neighbors, c, strength, disp);
+	propagate_extraction(en, neighbors, c, strength, disp);
 }
 
-static void propagate_extraction(struct extracted_net *en, struct routed_net *rn, struct neighbors neighbors, struct coordinate c, int strength, struct coordinate disp)
+static void propagate_extraction(struct extracted_net *en, struct neighbors neighbors, struct coordinate c, int strength, struct coordinate disp)
 {
-	for (int k = 0; k < neighbors.n_neighbors; k++) {
-		struct neighbor n = neighbors.neighbors[k];
-		if (coordinate_equal(n.at, c)) {
-			if (n.tn == PIN && !n.n.pin->extracted)
-				extract_pin(en, rn, n.n.pin, strength, disp);
-			else if (n.tn == SEGMENT && !n.n.rseg->extracted)
-				extract_segment(en, rn, n.n.rseg, c, strength, disp);
-		}
+	struct neighbor_index *ni = neighbors.index;
+	for (int k = neighbor_first(ni, c); k >= 0; k = ni->neighbors[k].next) {
+		struct neighbor n = ni->neighbors[k];
+		if (neighbor_of(&n) == neighbors.self)
+			continue;
+
+		if (n.tn == PIN && !n.n.pin->extracted)
+			extract_pin(en, ni, n.n.pin, strength, disp);
+		else if (n.tn == SEGMENT && !n.n.rseg->extracted)
+			extract_segment(en, ni, n.n.rseg, c, strength, disp);
 	}
 }
 
@@ -477,12 +518,17 @@ static int weaken(int strength, enum movement m)
 }
 
 // extracts a segment `rseg`, outwards from coordinate `from`, displacing into the extraction with disp
-static void extract_segment(struct extracted_net *en, struct routed_net *rn, struct routed_segment *rseg, struct coordinate from, int initial_strength, struct coordinate disp)
+static void extract_segment(struct extracted_net *en, struct neighbor_index *ni, struct routed_segment *rseg, struct coordinate from, int initial_strength, struct coordinate disp)
 {
 	int n_bt = rseg->n_backtraces;
 	if (!n_bt)
 		return;
 
+	// extraction looks back and ahead along the path, so have it a step
+	// at a time
+	enum backtrace *bt = malloc(n_bt * sizeof(enum backtrace));
+	path_expand(rseg, bt);
+
 	// printf("i am segment (%d, %d, %d) -> (%d, %d, %d); from = (%d, %d, %d)\n", PRINT_COORD(rseg->seg.start), PRINT_COORD(rseg->seg.end), PRINT_COORD(from));
 
 	// find the position of `from` in this segment
@@ -496,31 +542,33 @@ static void extract_segment(struct extracted_net *en, struct routed_net *rn, str
 		}
 
 		if (i < n_bt)
-			c = disp_backtrace(c, rseg->bt[i]);
+			c = disp_backtrace(c, bt[i]);
 		else
 			assert(coordinate_equal(c, rseg->seg.start));
 	}
 
 	// if it's strictly greater than n_bt, it's not found, return
-	if (i > n_bt)
+	if (i > n_bt) {
+		free(bt);
 		return;
+	}
 
-	struct neighbors neighbors = find_neighbors(rn, NULL, rseg);
+	struct neighbors neighbors = find_neighbors(ni, NULL, rseg);
 	// printf("i am segment (%d, %d, %d) -> (%d, %d, %d) and i have %d neighbors\n", PRINT_COORD(rseg->seg.start), PRINT_COORD(rseg->seg.end), neighbors.n_neighbors);
 	rseg->extracted = 1;
 
 	// catch anything else that's here
-	propagate_extraction(en, rn, neighbors, from, initial_strength, disp);
+	propagate_extraction(en, neighbors, from, initial_strength, disp);
 
 	// do the extraction from `from` to rseg->seg.end
 	int back_count = i;
 	enum movement *back_movts = malloc(sizeof(enum movement) * back_count);
-	int *back_strengths = malloc(sizeof(int) * back_count);
+	int *back_strengths = malloc(sizeof(int) * (back_count + 1));
 	back_strengths[0] = initial_strength;
 
 	c = from;
 	for (int j = 0; j < i; j++) {
-		back_movts[j] = backtrace_to_movement(rseg->bt[i-j-1]);
+		back_movts[j] = backtrace_to_movement(bt[i-j-1]);
 		if (has_abutting_neighbor(neighbors, c))
 			back_movts[j] |= GO_FORBID_REPEAT;
 		c = disp_movement(c, back_movts[j]);
@@ -533,23 +581,24 @@ static void extract_segment(struct extracted_net *en, struct routed_net *rn, str
 		if (j == 0 || !movement_vertical(back_movts[j-1]))
 			place_movement(en, c, back_movts[j], disp);
 		c = disp_movement(c, back_movts[j]);
-		propagate_extraction(en, rn, neighbors, c, back_strengths[j], disp);
+		propagate_extraction(en, neighbors, c, back_strengths[j], disp);
 	}
 
 	assert(coordinate_equal(c, rseg->seg.end));
 	place_movement(en, c, GO_NONE, disp);
-	propagate_extraction(en, rn, neighbors, rseg->seg.end, back_strengths[i-1]-1, disp);
+	// (if `from` is the end, whatever is there has been caught already)
+	propagate_extraction(en, neighbors, rseg->seg.end, back_count ? back_strengths[back_count-1]-1 : initial_strength, disp);
 
 	// do the extraction from `from` to rseg->seg.start
 	int fwd_count = n_bt - i;
 	enum movement *fwd_movts = malloc(sizeof(enum movement) * fwd_count);
-	int *fwd_strengths = malloc(sizeof(int) * fwd_count);
+	int *fwd_strengths = malloc(sizeof(int) * (fwd_count + 1));
 	int is_end = coordinate_equal(from, rseg->seg.end);
-	fwd_strengths[0] = is_end ? initial_strength : weaken(initial_strength, backtrace_to_movement(rseg->bt[i]));
+	fwd_strengths[0] = is_end || !fwd_count ? initial_strength : weaken(initial_strength, backtrace_to_movement(bt[i]));
 
 	c = from;
 	for (int j = 0; j < fwd_count; j++) {
-		fwd_movts[j] = backtrace_IS_movement(rseg->bt[j+i]);
+		fwd_movts[j] = backtrace_IS_movement(bt[j+i]);
 		if (has_abutting_neighbor(neighbors, c))
 			fwd_movts[j] |= GO_FORBID_REPEAT;
 		c = disp_movement(c, fwd_movts[j]);
@@ -562,23 +611,39 @@ static void extract_segment(struct extracted_net *en, struct routed_net *rn, str
 		if (j != 0 && !movement_vertical(fwd_movts[j-1])) // don't place `from` again
 			place_movement(en, c, fwd_movts[j], disp);
 		c = disp_movement(c, fwd_movts[j]);
-		propagate_extraction(en, rn, neighbors, c, fwd_strengths[j], disp);
+		propagate_extraction(en, neighbors, c, fwd_strengths[j], disp);
 	}
 
 	assert(coordinate_equal(c, rseg->seg.start));
 	place_movement(en, rseg->seg.start, GO_NONE, disp);
-	propagate_extraction(en, rn, neighbors, rseg->seg.start, fwd_strengths[n_bt-1]-1, disp);
+	propagate_extraction(en, neighbors, rseg->seg.start, fwd_count ? fwd_strengths[fwd_count-1]-1 : initial_strength, disp);
+
+	free(back_movts);
+	free(back_strengths);
+	free(fwd_movts);
+	free(fwd_strengths);
+	free(bt);
 }
 
-struct extracted_net *extract_net(struct routed_net *rn, struct coordinate disp)
+// a movement places at most this many blocks
+#define MAX_MOVEMENT_BLOCKS 5
+
+/* the most blocks extracting rn can give: a movement is placed at most once
+   for each pin, and for each block of each segment and both its ends */
+static int extracted_net_bound(struct routed_net *rn)
+{
+	int n = rn->n_pins;
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next)
+		n += rsh->rseg.n_backtraces + 2;
+
+	return n * MAX_MOVEMENT_BLOCKS;
+}
+
+// extract rn into en, which has room for extracted_net_bound(rn) blocks
+static void extract_net_into(struct extracted_net *en, struct routed_net *rn, struct coordinate disp)
 {
-	struct extracted_net *en = malloc(sizeof(struct extracted_net));
 	en->net = rn->net;
 	en->n = 0;
-	en->sz = 4;
-	en->c = malloc(sizeof(struct coordinate) * en->sz);
-	en->b = malloc(sizeof(block_t) * en->sz);
-	en->d = malloc(sizeof(data_t) * en->sz);
 
 	// find the driving pin
 	struct routed_segment *ds = NULL;
@@ -598,7 +663,10 @@ struct extracted_net *extract_net(struct routed_net *rn, struct coordinate disp)
 		for (int i = 0; i < rn->n_pins; i++)
 			rn->pins[i].extracted = 0;
 
-		extract_pin(en, rn, dp, dp->cell_pin->level - 1, disp);
+		struct neighbor_index ni;
+		build_neighbor_index(&ni, rn);
+		extract_pin(en, &ni, dp, dp->cell_pin->level - 1, disp);
+		free_neighbor_index(&ni);
 
 		// ensure all segments extracted
 		int extracted = 0, total = 0;
@@ -615,35 +683,369 @@ struct extracted_net *extract_net(struct routed_net *rn, struct coordinate disp)
 		for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next) {
 			struct routed_segment *rseg = &rsh->rseg;
 			struct coordinate c = rseg->seg.end;
-			for (int i = 0; i < rseg->n_backtraces; i++) {
-				place_movement(en, c, backtrace_to_movement(rseg->bt[i]), disp);
-				c = disp_backtrace(c, rseg->bt[i]);
+			for (int r = 0; r < rseg->n_runs; r++) {
+				enum movement mv = backtrace_to_movement(rseg->runs[r].bt);
+				struct coordinate step = backtrace_step(rseg->runs[r].bt);
+				for (int k = 0; k < rseg->runs[r].len; k++) {
+					place_movement(en, c, mv, disp);
+					c = coordinate_add(c, step);
+				}
 			}
 		}
 	}
+}
+
+struct extracted_net *extract_net(struct routed_net *rn, struct coordinate disp)
+{
+	struct extracted_net *en = malloc(sizeof(struct extracted_net));
+	en->sz = extracted_net_bound(rn);
+	en->c = malloc(sizeof(struct coordinate) * en->sz);
+	en->b = malloc(sizeof(block_t) * en->sz);
+	en->d = malloc(sizeof(data_t) * en->sz);
+
+	extract_net_into(en, rn, disp);
 
 	return en;
 }
 
-// block placement routines
-void place_block(struct extraction *e, struct coordinate c, block_t b, data_t da)
+void free_extracted_net(struct extracted_net *en)
+{
+	free(en->c);
+	free(en->b);
+	free(en->d);
+	free(en);
+}
+
+/* SPARSE EXTRACTIONS */
+
+struct extraction *new_extraction(struct dimensions d)
+{
+	struct extraction *e = malloc(sizeof(struct extraction));
+	e->dimensions = d;
+
+	int n = EXTRACTION_SECTION_SIZE - 1;
+	e->n_sections = (struct dimensions){(d.y + n) >> EXTRACTION_SECTION_BITS,
+		(d.z + n) >> EXTRACTION_SECTION_BITS, (d.x + n) >> EXTRACTION_SECTION_BITS};
+	e->sections = calloc(e->n_sections.y * e->n_sections.z * e->n_sections.x + 1, sizeof(struct extraction_section *));
+	e->n_blocks = 0;
+
+	e->n_nets = 0;
+	e->nets = NULL;
+	e->n_buffers = 0;
+	e->buffers = NULL;
+
+	return e;
+}
+
+static int in_extraction(struct extraction *e, struct coordinate c)
 {
 	struct dimensions d = e->dimensions;
+	return c.y >= 0 && c.z >= 0 && c.x >= 0 && c.y < (int)d.y && c.z < (int)d.z && c.x < (int)d.x;
+}
+
+// the offset of the section holding c, and of c within it
+static int section_of(struct extraction *e, struct coordinate c, int *i)
+{
+	int m = EXTRACTION_SECTION_SIZE - 1;
+	*i = (((c.y & m) << EXTRACTION_SECTION_BITS | (c.z & m)) << EXTRACTION_SECTION_BITS) | (c.x & m);
+
+	struct dimensions ns = e->n_sections;
+	return ((c.y >> EXTRACTION_SECTION_BITS) * ns.z + (c.z >> EXTRACTION_SECTION_BITS)) * ns.x + (c.x >> EXTRACTION_SECTION_BITS);
+}
+
+static struct extraction_section *new_section(struct extraction *e, int s)
+{
+	struct dimensions ns = e->n_sections;
+	struct extraction_section *sec = malloc(sizeof(struct extraction_section));
+
+	int sx = s % ns.x, sz = s / ns.x % ns.z, sy = s / ns.x / ns.z;
+	sec->origin = (struct coordinate){sy * EXTRACTION_SECTION_SIZE, sz * EXTRACTION_SECTION_SIZE, sx * EXTRACTION_SECTION_SIZE};
+	sec->n_blocks = 0;
+
+	sec->n_palette = 1;
+	sec->sz_palette = 4;
+	sec->palette = malloc(sec->sz_palette * sizeof(struct extraction_block));
+	sec->palette[0] = (struct extraction_block){0, 0};
+
+	sec->index = calloc(EXTRACTION_SECTION_VOLUME, sizeof(unsigned char));
+	sec->wide_index = NULL;
+
+	return sec;
+}
+
+static void free_section(struct extraction_section *sec)
+{
+	free(sec->palette);
+	free(sec->index);
+	free(sec->wide_index);
+	free(sec);
+}
+
+static int section_entry(struct extraction_section *sec, int i)
+{
+	return sec->wide_index ? sec->wide_index[i] : sec->index[i];
+}
+
+// the palette entry for (b, da), added if it is not there yet
+static int palette_lookup(struct extraction_section *sec, block_t b, data_t da)
+{
+	for (int p = 0; p < sec->n_palette; p++)
+		if (sec->palette[p].b == b && sec->palette[p].d == da)
+			return p;
+
+	if (sec->n_palette == sec->sz_palette) {
+		sec->sz_palette *= 2;
+		sec->palette = realloc(sec->palette, sec->sz_palette * sizeof(struct extraction_block));
+	}
+
+	// widen the index once a byte cannot tell the entries apart
+	if (sec->n_palette == 256) {
+		sec->wide_index = malloc(EXTRACTION_SECTION_VOLUME * sizeof(uint16_t));
+		for (int i = 0; i < EXTRACTION_SECTION_VOLUME; i++)
+			sec->wide_index[i] = sec->index[i];
+		free(sec->index);
+		sec->index = NULL;
+	}
 
-	if (c.x > d.x || c.y > d.y || c.z > d.z || c.x < 0 || c.y < 0 || c.z < 0)
+	sec->palette[sec->n_palette] = (struct extraction_block){b, da};
+	return sec->n_palette++;
+}
+
+// set block i of section s, returning the change in the number of blocks
+// other than air; only section s is touched
+static int set_block(struct extraction *e, int s, int i, block_t b, data_t da)
+{
+	struct extraction_section *sec = e->sections[s];
+	if (!sec) {
+		if (b == 0 && da == 0)
+			return 0;
+		sec = e->sections[s] = new_section(e, s);
+	}
+
+	int was_air = section_entry(sec, i) == 0;
+	int p = b == 0 && da == 0 ? 0 : palette_lookup(sec, b, da);
+	if (sec->wide_index)
+		sec->wide_index[i] = p;
+	else
+		sec->index[i] = p;
+
+	int change = was_air - (p == 0);
+	sec->n_blocks += change;
+
+	if (sec->n_blocks == 0) {
+		free_section(sec);
+		e->sections[s] = NULL;
+	}
+
+	return change;
+}
+
+// place a block in e; those outside it are dropped
+void extraction_set(struct extraction *e, struct coordinate c, block_t b, data_t da)
+{
+	if (!in_extraction(e, c))
 		return;
 
-	int offset = c.y * d.z * d.x + c.z * d.x + c.x;
+	int i;
+	int s = section_of(e, c, &i);
+	e->n_blocks += set_block(e, s, i, b, da);
+}
+
+// the block at c (air, outside e), and its data in *da
+block_t extraction_get(struct extraction *e, struct coordinate c, data_t *da)
+{
+	*da = 0;
+	if (!in_extraction(e, c))
+		return 0;
+
+	int i;
+	struct extraction_section *sec = e->sections[section_of(e, c, &i)];
+	if (!sec)
+		return 0;
 
-	e->blocks[offset] = b;
-	e->data[offset] = da;
+	struct extraction_block eb = sec->palette[section_entry(sec, i)];
+	*da = eb.d;
+	return eb.b;
 }
 
-struct extraction *extract(struct cell_placements *cp, struct routings *rt)
+void extraction_iterator_init(struct extraction_iterator *it)
 {
-	struct coordinate disp = placements_top_left_most_point(cp);
-	if (rt)
-		disp = coordinate_piecewise_min(disp, routings_top_left_most_point(rt));
+	it->section = 0;
+	it->i = 0;
+}
+
+/* find the next block of e other than air, sections in (y, z, x) order and
+   blocks in (y, z, x) order within each; returns 0 once there are none left */
+int extraction_next(struct extraction *e, struct extraction_iterator *it, struct coordinate *c, block_t *b, data_t *da)
+{
+	struct dimensions ns = e->n_sections;
+	int n_sections = ns.y * ns.z * ns.x;
+
+	for (; it->section < n_sections; it->section++, it->i = 0) {
+		struct extraction_section *sec = e->sections[it->section];
+		if (!sec)
+			continue;
+
+		for (; it->i < EXTRACTION_SECTION_VOLUME; it->i++) {
+			int p = section_entry(sec, it->i);
+			if (p == 0)
+				continue;
+
+			int m = EXTRACTION_SECTION_SIZE - 1;
+			c->y = sec->origin.y + (it->i >> (2 * EXTRACTION_SECTION_BITS));
+			c->z = sec->origin.z + ((it->i >> EXTRACTION_SECTION_BITS) & m);
+			c->x = sec->origin.x + (it->i & m);
+			*b = sec->palette[p].b;
+			*da = sec->palette[p].d;
+
+			it->i++;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* PARALLEL EXTRACTION
+
+   nets are extracted independently of one another. each thread takes a run
+   of consecutive nets, and extracts them into a buffer of its own that is
+   sized for them from their paths. the blocks are then scattered into the
+   extraction, each thread setting only those that fall in its share of the
+   sections; as every thread goes through the nets in order, a block set by
+   two nets is left as the later one set it */
+
+struct extraction_work {
+	struct extraction *e;
+	struct routings *rt;
+	int thread;
+	int n_threads;
+
+	// nets first..last-1 (into e->nets), and the blocks they can give
+	int first;
+	int last;
+	int *bound;
+
+	// for scattering, where the nets are moved to, and the change in the
+	// number of blocks other than air in the thread's sections
+	struct coordinate disp;
+	int n_blocks;
+};
+
+static void *extract_worker(void *arg)
+{
+	struct extraction_work *w = arg;
+	struct extraction *e = w->e;
+
+	int size = 0;
+	for (int i = w->first; i < w->last; i++)
+		size += w->bound[i];
+
+	char *buffer = malloc(size * (sizeof(struct coordinate) + sizeof(block_t) + sizeof(data_t)) + 1);
+	e->buffers[w->thread] = buffer;
+
+	struct coordinate *c = (struct coordinate *)buffer;
+	block_t *b = (block_t *)(c + size);
+	data_t *d = (data_t *)(b + size);
+
+	struct coordinate none = {0, 0, 0};
+	for (int i = w->first; i < w->last; i++) {
+		struct extracted_net *en = &e->nets[i];
+		en->sz = w->bound[i];
+		en->c = c;
+		en->b = b;
+		en->d = d;
+		c += en->sz;
+		b += en->sz;
+		d += en->sz;
+
+		extract_net_into(en, &w->rt->routed_nets[i + 1], none);
+	}
+
+	return NULL;
+}
+
+static void *scatter_worker(void *arg)
+{
+	struct extraction_work *w = arg;
+	struct extraction *e = w->e;
+
+	for (int i = 0; i < e->n_nets; i++) {
+		struct extracted_net *en = &e->nets[i];
+		for (int j = 0; j < en->n; j++) {
+			struct coordinate c = coordinate_add(en->c[j], w->disp);
+			if (!in_extraction(e, c))
+				continue;
+
+			int k;
+			int s = section_of(e, c, &k);
+			if (s % w->n_threads == w->thread)
+				w->n_blocks += set_block(e, s, k, en->b[j], en->d[j]);
+		}
+	}
+
+	return NULL;
+}
+
+static void run_workers(void *(*worker)(void *), struct extraction_work *w, int n_workers)
+{
+	pthread_t *workers = calloc(n_workers, sizeof(pthread_t));
+
+	// this thread is the last worker
+	for (int i = 0; i < n_workers - 1; i++)
+		pthread_create(&workers[i], NULL, worker, &w[i]);
+	worker(&w[n_workers - 1]);
+	for (int i = 0; i < n_workers - 1; i++)
+		pthread_join(workers[i], NULL);
+
+	free(workers);
+}
+
+// extract every routed net of rt into e->nets, and place them in e, moved
+// by disp, using up to `threads` threads
+static void extract_routings(struct extraction *e, struct routings *rt, struct coordinate disp, int threads)
+{
+	int n_nets = rt->n_routed_nets;
+	int *bound = malloc((n_nets + 1) * sizeof(int));
+	int total = 0;
+	for (int i = 0; i < n_nets; i++) {
+		bound[i] = extracted_net_bound(&rt->routed_nets[i + 1]);
+		total += bound[i];
+	}
+
+	int n_workers = max(min(threads, n_nets), 1);
+	e->n_nets = n_nets;
+	e->nets = calloc(n_nets + 1, sizeof(struct extracted_net));
+	e->n_buffers = n_workers;
+	e->buffers = calloc(n_workers, sizeof(void *));
+
+	// give each thread a run of nets with about as many blocks
+	struct extraction_work *w = calloc(n_workers, sizeof(struct extraction_work));
+	int next = 0, given = 0;
+	for (int t = 0; t < n_workers; t++) {
+		w[t] = (struct extraction_work){e, rt, t, n_workers, next, next, bound, disp, 0};
+
+		long share = (long)total * (t + 1) / n_workers;
+		while (next < n_nets && (t == n_workers - 1 || given < share))
+			given += bound[next++];
+		w[t].last = next;
+	}
+
+	run_workers(extract_worker, w, n_workers);
+	run_workers(scatter_worker, w, n_workers);
+
+	for (int t = 0; t < n_workers; t++)
+		e->n_blocks += w[t].n_blocks;
+
+	free(w);
+	free(bound);
+}
+
+/* extract the placed cells of cp and, if given, the routed nets of rt,
+   extracting up to `threads` nets at once */
+struct extraction *extract(struct cell_placements *cp, struct routings *rt, int threads)
+{
+	struct coordinate disp = design_top_left_most_point(cp, rt);
 
 	struct dimensions cpd = compute_placement_dimensions(cp);
 	struct dimensions rtd = {0, 0, 0};
@@ -658,12 +1060,7 @@ struct extraction *extract(struct cell_placements *cp, struct routings *rt)
 	d.x = d.x - disp.x + 2 * margin;
 	printf("[extract] extraction dimensions: h=%d w=%d l=%d\n", d.y, d.z, d.x);
 
-	struct extraction *e = malloc(sizeof(struct extraction));
-	e->dimensions = d;
-
-	int size = d.x * d.y * d.z;
-	e->blocks = calloc(size, sizeof(block_t));
-	e->data = calloc(size, sizeof(data_t));
+	struct extraction *e = new_extraction(d);
 
 	/* place blocks resulting from placement in image */
 	for (int i = 0; i < cp->n_placements; i++) {
@@ -676,13 +1073,12 @@ struct extraction *extract(struct cell_placements *cp, struct routings *rt)
 		for (int y = 0; y < lcd.y; y++) {
 			for (int z = 0; z < lcd.z; z++) {
 				for (int x = 0; x < lcd.x; x++) {
-					// index into extraction matrix
-					int fd_off = (c.y - disp.y + y) * d.z * d.x + (c.z - disp.z + margin + z) * d.x + (c.x - disp.x + margin + x);
+					// position in the extraction
+					struct coordinate fd = {c.y - disp.y + y, c.z - disp.z + margin + z, c.x - disp.x + margin + x};
 					int b_off = y * lcd.z * lcd.x + z * lcd.x + x; // block offset into logic cell
 
-					assert(fd_off >= 0 && fd_off <= size);
-					e->blocks[fd_off] = lc->blocks[p.turns][b_off];
-					e->data[fd_off] = lc->data[p.turns][b_off];
+					assert(in_extraction(e, fd));
+					extraction_set(e, fd, lc->blocks[p.turns][b_off], lc->data[p.turns][b_off]);
 				}
 			}
 		}
@@ -693,21 +1089,24 @@ struct extraction *extract(struct cell_placements *cp, struct routings *rt)
 		return e;
 
 	struct coordinate rt_disp = {-disp.y, -disp.z + margin, -disp.x + margin};
-	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
-		struct extracted_net *en = extract_net(&rt->routed_nets[i], rt_disp);
-		// print_rsa(&rt->routed_nets[i]);
-		// print_extracted_net(&rt->routed_nets[i]);
-		// putchar('\n');
-		for (int i = 0; i < en->n; i++)
-			place_block(e, en->c[i], en->b[i], en->d[i]);
-	}
+	extract_routings(e, rt, rt_disp, threads);
 
 	return e;
 }
 
 void free_extraction(struct extraction *e)
 {
-	free(e->blocks);
-	free(e->data);
+	struct dimensions ns = e->n_sections;
+	for (int i = 0; i < ns.y * ns.z * ns.x; i++)
+		if (e->sections[i])
+			free_section(e->sections[i]);
+
+	free(e->sections);
+
+	for (int i = 0; i < e->n_buffers; i++)
+		free(e->buffers[i]);
+	free(e->buffers);
+	free(e->nets);
+
 	free(e);
 }
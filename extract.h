@@ -1,15 +1,60 @@
 #ifndef __EXTRACT_H__
 #define __EXTRACT_H__
 
+#include <stdint.h>
+
 #include "coord.h"
 #include "cell.h"
 #include "base_router.h"
 #include "placer.h"
 
+/* an extraction is kept in 16x16x16 sections, aligned to its origin (and so
+   to chunks, when it is inserted at a multiple of 16). only sections with
+   something other than air in them are allocated */
+#define EXTRACTION_SECTION_BITS 4
+#define EXTRACTION_SECTION_SIZE (1 << EXTRACTION_SECTION_BITS)
+#define EXTRACTION_SECTION_VOLUME (EXTRACTION_SECTION_SIZE * EXTRACTION_SECTION_SIZE * EXTRACTION_SECTION_SIZE)
+
+struct extraction_block {
+	block_t b;
+	data_t d;
+};
+
+struct extraction_section {
+	struct coordinate origin; // within the extraction
+	int n_blocks; // other than air
+
+	// the blocks that occur in the section; entry 0 is air
+	int n_palette;
+	int sz_palette;
+	struct extraction_block *palette;
+
+	// the palette entry of every block, in (y, z, x) order: a byte each
+	// until the palette outgrows that
+	unsigned char *index;
+	uint16_t *wide_index;
+};
+
 struct extraction {
 	struct dimensions dimensions;
-	block_t *blocks;
-	data_t *data;
+
+	// sections, in (y, z, x) order; NULL where there is only air
+	struct dimensions n_sections;
+	struct extraction_section **sections;
+	int n_blocks;
+
+	// the blocks each routed net gave (net i in nets[i-1]), where the
+	// router put them rather than moved into the extraction
+	int n_nets;
+	struct extracted_net *nets;
+	int n_buffers;
+	void **buffers;
+};
+
+// walks the blocks of an extraction other than air, a section at a time
+struct extraction_iterator {
+	int section;
+	int i;
 };
 
 struct extracted_net {
@@ -24,12 +69,21 @@ struct extracted_net {
 
 struct coordinate placements_top_left_most_point(struct cell_placements *);
 struct coordinate routings_top_left_most_point(struct routings *);
+struct coordinate design_top_left_most_point(struct cell_placements *, struct routings *);
+struct coordinate design_end_point(struct cell_placements *, struct routings *);
+
+struct coordinate recenter(struct cell_placements *, struct routings *, int);
 
-void recenter(struct cell_placements *, struct routings *, int);
+struct extraction *new_extraction(struct dimensions);
+void extraction_set(struct extraction *, struct coordinate, block_t, data_t);
+block_t extraction_get(struct extraction *, struct coordinate, data_t *);
+void extraction_iterator_init(struct extraction_iterator *);
+int extraction_next(struct extraction *, struct extraction_iterator *, struct coordinate *, block_t *, data_t *);
 
 struct extraction *extract_placements(struct cell_placements *);
-struct extraction *extract(struct cell_placements *, struct routings *);
+struct extraction *extract(struct cell_placements *, struct routings *, int);
 struct extracted_net *extract_net(struct routed_net *, struct coordinate);
+void free_extracted_net(struct extracted_net *);
 void free_extraction(struct extraction *);
 
 #endif /* __EXTRACT_H__ */
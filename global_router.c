@@ -0,0 +1,368 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global_router.h"
+#include "heap.h"
+#include "router.h"
+#include "usage_matrix.h"
+#include "util.h"
+
+/* GLOBAL ROUTING
+
+   the design is divided into tiles of TILE_SIZE by TILE_SIZE blocks. the
+   capacity of the boundary between two neighboring tiles is the number of
+   wires that can cross it on the routing layers (y = 0, 3 and 6), given
+   the cells in the way and that wires must be WIRE_PITCH blocks apart.
+   every net is routed over the tiles at a cost that rises as boundaries
+   fill up; nets crossing overfull boundaries are then rerouted with the
+   history of that overflow added to the cost, a few times over. the
+   detailed router is afterwards confined to the tiles each net was given,
+   plus a ring of tiles around them. */
+
+#define GLOBAL_ITERATIONS 4
+#define WIRE_PITCH 2
+#define OVERFLOW_COST 8
+#define HISTORY_COST 2
+#define CORRIDOR_DILATION 1
+
+static const int routing_layers[] = {0, 3, 6};
+
+struct tile_grid {
+	// the first block of the first tile (that of the usage matrix)
+	struct coordinate origin;
+	int tiles_z;
+	int tiles_x;
+	int n_tiles;
+
+	// the boundary of tile t with the tile east of it (x+1) is edge t,
+	// and with the tile south of it (z+1) is edge n_tiles + t
+	int *capacity;
+	int *demand;
+	int *history;
+};
+
+// the tiles and boundaries a net's global route uses
+struct tile_route {
+	int n_edges;
+	int size;
+	int *edges;
+
+	unsigned char *tiles;
+};
+
+int corridor_contains(struct corridor *cor, struct coordinate c)
+{
+	int dz = c.z - cor->origin.z, dx = c.x - cor->origin.x;
+	if (dz < 0 || dx < 0)
+		return 0;
+
+	int tz = dz / TILE_SIZE, tx = dx / TILE_SIZE;
+	if (tz >= cor->tiles_z || tx >= cor->tiles_x)
+		return 0;
+
+	return cor->tiles[tz * cor->tiles_x + tx];
+}
+
+// the top-left and bottom-right blocks (in x and z) of the corridor's tiles
+void corridor_extent(struct corridor *cor, struct coordinate *tl, struct coordinate *br)
+{
+	*tl = (struct coordinate){0, cor->origin.z, cor->origin.x};
+	*br = (struct coordinate){0, cor->origin.z + cor->tiles_z * TILE_SIZE - 1, cor->origin.x + cor->tiles_x * TILE_SIZE - 1};
+}
+
+void free_corridor(struct corridor *cor)
+{
+	if (!cor)
+		return;
+
+	free(cor->tiles);
+	free(cor);
+}
+
+static int track_free(struct usage_matrix *m, struct coordinate c)
+{
+	return in_usage_bounds(m, c) && !usage_matrix_violated(m, c);
+}
+
+static struct tile_grid *create_tile_grid(struct usage_matrix *m)
+{
+	struct tile_grid *g = malloc(sizeof(struct tile_grid));
+	g->origin = m->origin;
+	g->tiles_z = (m->d.z + TILE_SIZE - 1) / TILE_SIZE;
+	g->tiles_x = (m->d.x + TILE_SIZE - 1) / TILE_SIZE;
+	g->n_tiles = g->tiles_z * g->tiles_x;
+	g->capacity = calloc(2 * g->n_tiles, sizeof(int));
+	g->demand = calloc(2 * g->n_tiles, sizeof(int));
+	g->history = calloc(2 * g->n_tiles, sizeof(int));
+
+	for (int tz = 0; tz < g->tiles_z; tz++) {
+		for (int tx = 0; tx < g->tiles_x; tx++) {
+			int t = tz * g->tiles_x + tx;
+			int east = 0, south = 0;
+
+			for (int l = 0; l < sizeof(routing_layers) / sizeof(int); l++) {
+				int y = routing_layers[l];
+
+				// wires crossing into the tile to the east
+				int x = g->origin.x + (tx + 1) * TILE_SIZE - 1;
+				for (int z = g->origin.z + tz * TILE_SIZE; tx + 1 < g->tiles_x && z < g->origin.z + (tz + 1) * TILE_SIZE; z++)
+					if (track_free(m, (struct coordinate){y, z, x}) && track_free(m, (struct coordinate){y, z, x + 1}))
+						east++;
+
+				// wires crossing into the tile to the south
+				int z = g->origin.z + (tz + 1) * TILE_SIZE - 1;
+				for (int x = g->origin.x + tx * TILE_SIZE; tz + 1 < g->tiles_z && x < g->origin.x + (tx + 1) * TILE_SIZE; x++)
+					if (track_free(m, (struct coordinate){y, z, x}) && track_free(m, (struct coordinate){y, z + 1, x}))
+						south++;
+			}
+
+			g->capacity[t] = east / WIRE_PITCH;
+			g->capacity[g->n_tiles + t] = south / WIRE_PITCH;
+		}
+	}
+
+	return g;
+}
+
+static void free_tile_grid(struct tile_grid *g)
+{
+	free(g->capacity);
+	free(g->demand);
+	free(g->history);
+	free(g);
+}
+
+// the edge between neighboring tiles a and b
+static int tile_edge(struct tile_grid *g, int a, int b)
+{
+	if (b == a + 1)
+		return a;
+	if (a == b + 1)
+		return b;
+	if (b == a + g->tiles_x)
+		return g->n_tiles + a;
+
+	assert(a == b + g->tiles_x);
+	return g->n_tiles + b;
+}
+
+static unsigned int edge_cost(struct tile_grid *g, int e)
+{
+	int cost = 1 + g->history[e];
+	int over = g->demand[e] + 1 - g->capacity[e];
+	if (over > 0)
+		cost += OVERFLOW_COST * over;
+
+	return cost;
+}
+
+static int pin_tile(struct tile_grid *g, struct placed_pin *p)
+{
+	struct coordinate c = coordinate_sub(extend_pin(p), g->origin);
+	int tz = min(max(c.z / TILE_SIZE, 0), g->tiles_z - 1);
+	int tx = min(max(c.x / TILE_SIZE, 0), g->tiles_x - 1);
+
+	return tz * g->tiles_x + tx;
+}
+
+static void tile_route_add_edge(struct tile_route *tr, int e)
+{
+	if (tr->n_edges >= tr->size) {
+		tr->size = tr->size ? tr->size * 2 : 8;
+		tr->edges = realloc(tr->edges, tr->size * sizeof(int));
+	}
+
+	tr->edges[tr->n_edges++] = e;
+}
+
+static void rip_up_tile_route(struct tile_grid *g, struct tile_route *tr)
+{
+	for (int i = 0; i < tr->n_edges; i++)
+		g->demand[tr->edges[i]]--;
+
+	tr->n_edges = 0;
+	memset(tr->tiles, 0, g->n_tiles);
+}
+
+// route a net over the tiles as a tree, joining the nearest unconnected pin
+// to the tree one at a time (scratch arrays are sized to the grid)
+static void route_net_tiles(struct tile_grid *g, struct tile_route *tr, struct routed_net *rn,
+		struct cost_coord_heap *heap, unsigned int *cost, int *prev, unsigned char *is_pin)
+{
+	memset(is_pin, 0, g->n_tiles);
+	for (int i = 0; i < rn->n_pins; i++)
+		is_pin[pin_tile(g, &rn->pins[i])] = 1;
+
+	tr->tiles[pin_tile(g, &rn->pins[0])] = 1;
+
+	for (;;) {
+		clear_cost_coord_heap(heap);
+		for (int t = 0; t < g->n_tiles; t++) {
+			cost[t] = UINT_MAX;
+			prev[t] = -1;
+			if (tr->tiles[t]) {
+				cost[t] = 0;
+				cost_coord_heap_update(heap, (struct cost_coord){0, {0, t / g->tiles_x, t % g->tiles_x}, NULL, t});
+			}
+		}
+
+		// find the cheapest way from the tree to a pin not yet on it
+		int found = -1;
+		while (heap->n_elts > 0) {
+			struct cost_coord cc = cost_coord_heap_delete_min(heap);
+			int t = cc.key;
+			if (is_pin[t] && !tr->tiles[t]) {
+				found = t;
+				break;
+			}
+
+			int tz = t / g->tiles_x, tx = t % g->tiles_x;
+			int neighbors[4] = {
+				tx > 0 ? t - 1 : -1,
+				tx + 1 < g->tiles_x ? t + 1 : -1,
+				tz > 0 ? t - g->tiles_x : -1,
+				tz + 1 < g->tiles_z ? t + g->tiles_x : -1
+			};
+
+			for (int i = 0; i < 4; i++) {
+				int u = neighbors[i];
+				if (u < 0)
+					continue;
+
+				unsigned int c = cost[t] + edge_cost(g, tile_edge(g, t, u));
+				if (c < cost[u]) {
+					cost[u] = c;
+					prev[u] = t;
+					cost_coord_heap_update(heap, (struct cost_coord){c, {0, u / g->tiles_x, u % g->tiles_x}, NULL, u});
+				}
+			}
+		}
+
+		if (found < 0)
+			break;
+
+		for (int t = found; !tr->tiles[t]; t = prev[t]) {
+			int e = tile_edge(g, t, prev[t]);
+			tr->tiles[t] = 1;
+			tile_route_add_edge(tr, e);
+			g->demand[e]++;
+		}
+	}
+}
+
+static int count_overflow(struct tile_grid *g)
+{
+	int overflow = 0;
+	for (int e = 0; e < 2 * g->n_tiles; e++)
+		if (g->demand[e] > g->capacity[e])
+			overflow++;
+
+	return overflow;
+}
+
+// the tiles of a net's global route, and those within CORRIDOR_DILATION
+// tiles of them, cropped to their bounding box
+static struct corridor *make_corridor(struct tile_grid *g, struct tile_route *tr, struct usage_matrix *m)
+{
+	int z1 = g->tiles_z, z2 = -1, x1 = g->tiles_x, x2 = -1;
+	for (int t = 0; t < g->n_tiles; t++) {
+		if (!tr->tiles[t])
+			continue;
+
+		int tz = t / g->tiles_x, tx = t % g->tiles_x;
+		z1 = min(z1, max(tz - CORRIDOR_DILATION, 0));
+		z2 = max(z2, min(tz + CORRIDOR_DILATION, g->tiles_z - 1));
+		x1 = min(x1, max(tx - CORRIDOR_DILATION, 0));
+		x2 = max(x2, min(tx + CORRIDOR_DILATION, g->tiles_x - 1));
+	}
+
+	assert(z2 >= z1 && x2 >= x1);
+
+	struct corridor *cor = malloc(sizeof(struct corridor));
+	cor->origin = coordinate_add(m->origin, (struct coordinate){0, z1 * TILE_SIZE, x1 * TILE_SIZE});
+	cor->tiles_z = z2 - z1 + 1;
+	cor->tiles_x = x2 - x1 + 1;
+	cor->tiles = calloc(cor->tiles_z * cor->tiles_x, sizeof(unsigned char));
+
+	for (int t = 0; t < g->n_tiles; t++) {
+		if (!tr->tiles[t])
+			continue;
+
+		int tz = t / g->tiles_x, tx = t % g->tiles_x;
+		for (int z = max(tz - CORRIDOR_DILATION, z1); z <= min(tz + CORRIDOR_DILATION, z2); z++)
+			for (int x = max(tx - CORRIDOR_DILATION, x1); x <= min(tx + CORRIDOR_DILATION, x2); x++)
+				cor->tiles[(z - z1) * cor->tiles_x + (x - x1)] = 1;
+	}
+
+	return cor;
+}
+
+/* assign every net with more than one pin a corridor of tiles to be routed
+   in, replacing any it had */
+void global_route(struct cell_placements *cp, struct routings *rt, int xz_margin)
+{
+	struct usage_matrix *m = create_placement_usage_matrix(cp, rt, xz_margin);
+	struct tile_grid *g = create_tile_grid(m);
+
+	struct tile_route *routes = calloc(rt->n_routed_nets + 1, sizeof(struct tile_route));
+	struct cost_coord_heap *heap = create_indexed_cost_coord_heap(g->n_tiles);
+	unsigned int *cost = malloc(g->n_tiles * sizeof(unsigned int));
+	int *prev = malloc(g->n_tiles * sizeof(int));
+	unsigned char *is_pin = malloc(g->n_tiles * sizeof(unsigned char));
+	unsigned char *overfull = malloc(2 * g->n_tiles * sizeof(unsigned char));
+
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
+		routes[i].tiles = calloc(g->n_tiles, sizeof(unsigned char));
+		if (rt->routed_nets[i].n_pins > 1)
+			route_net_tiles(g, &routes[i], &rt->routed_nets[i], heap, cost, prev, is_pin);
+	}
+
+	// reroute nets that cross overfull boundaries, which grow costlier
+	int iterations = 1;
+	int overflow = count_overflow(g);
+	for (; overflow > 0 && iterations < GLOBAL_ITERATIONS; iterations++) {
+		for (int e = 0; e < 2 * g->n_tiles; e++) {
+			overfull[e] = g->demand[e] > g->capacity[e];
+			if (overfull[e])
+				g->history[e] += HISTORY_COST;
+		}
+
+		for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
+			int crosses = 0;
+			for (int j = 0; j < routes[i].n_edges && !crosses; j++)
+				crosses = overfull[routes[i].edges[j]];
+
+			if (!crosses)
+				continue;
+
+			rip_up_tile_route(g, &routes[i]);
+			route_net_tiles(g, &routes[i], &rt->routed_nets[i], heap, cost, prev, is_pin);
+		}
+
+		overflow = count_overflow(g);
+	}
+
+	printf("[global] Routed nets over %dx%d tiles of %d blocks in %d iterations, overfull boundaries: %d\n",
+	       g->tiles_z, g->tiles_x, TILE_SIZE, iterations, overflow);
+
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
+		struct routed_net *rn = &rt->routed_nets[i];
+		free_corridor(rn->corridor);
+		rn->corridor = rn->n_pins > 1 ? make_corridor(g, &routes[i], m) : NULL;
+
+		free(routes[i].edges);
+		free(routes[i].tiles);
+	}
+
+	free(overfull);
+	free(is_pin);
+	free(prev);
+	free(cost);
+	free_cost_coord_heap(heap);
+	free(routes);
+	free_tile_grid(g);
+	free_usage_matrix(m);
+}
@@ -0,0 +1,28 @@
+#ifndef __GLOBAL_ROUTER_H__
+#define __GLOBAL_ROUTER_H__
+
+#include "coord.h"
+#include "placer.h"
+#include "base_router.h"
+
+// blocks per side of a global routing tile
+#define TILE_SIZE 8
+
+// the tiles (TILE_SIZE by TILE_SIZE blocks, through every layer) a net's
+// detailed routing is confined to
+struct corridor {
+	// block coordinate of the top-left of the first tile; y is unused
+	struct coordinate origin;
+
+	int tiles_z;
+	int tiles_x;
+	unsigned char *tiles;
+};
+
+int corridor_contains(struct corridor *, struct coordinate);
+void corridor_extent(struct corridor *, struct coordinate *, struct coordinate *);
+void free_corridor(struct corridor *);
+
+void global_route(struct cell_placements *, struct routings *, int);
+
+#endif /* __GLOBAL_ROUTER_H__ */
@@ -16,11 +16,46 @@ struct cost_coord_heap *create_cost_coord_heap()
 	h->elts = malloc(h->size * sizeof(struct cost_coord));
 	assert(h->elts);
 
+	h->n_keys = 0;
+	h->pos = NULL;
+	h->shared_pos = 0;
+
+	return h;
+}
+
+/* an indexed heap holds each key (cost_coord.key < n_keys) at most once,
+   which lets cost_coord_heap_update() lower the cost of an entry in place
+   instead of inserting a duplicate */
+struct cost_coord_heap *create_indexed_cost_coord_heap(unsigned int n_keys)
+{
+	struct cost_coord_heap *h = create_cost_coord_heap();
+
+	h->n_keys = n_keys;
+	h->pos = calloc(n_keys, sizeof(unsigned int));
+	assert(h->pos);
+
+	return h;
+}
+
+/* like an indexed heap, but positions are kept in pos (n_keys long and
+   zeroed), which the caller owns. several heaps may share one pos as long
+   as no key is in more than one of them at a time; a heap should be
+   cleared before it is freed, so that its keys are left out of pos */
+struct cost_coord_heap *create_shared_index_cost_coord_heap(unsigned int n_keys, unsigned int *pos)
+{
+	struct cost_coord_heap *h = create_cost_coord_heap();
+
+	h->n_keys = n_keys;
+	h->pos = pos;
+	h->shared_pos = 1;
+
 	return h;
 }
 
 void free_cost_coord_heap(struct cost_coord_heap *h)
 {
+	if (!h->shared_pos)
+		free(h->pos);
 	free(h->elts);
 	free(h);
 }
@@ -30,6 +65,21 @@ static void swap(struct cost_coord_heap *h, unsigned int i, unsigned int j)
 	struct cost_coord tmp = h->elts[i];
 	h->elts[i] = h->elts[j];
 	h->elts[j] = tmp;
+
+	if (h->pos) {
+		h->pos[h->elts[i].key] = i;
+		h->pos[h->elts[j].key] = j;
+	}
+}
+
+static void sift_up(struct cost_coord_heap *h, unsigned int i)
+{
+	unsigned int p = i / 2;
+	while (p != 0 && h->elts[i].cost < h->elts[p].cost) {
+		swap(h, i, p);
+		i = p;
+		p = i / 2;
+	}
 }
 
 static void min_heapify(struct cost_coord_heap *h, unsigned int i)
@@ -67,12 +117,51 @@ void cost_coord_heap_insert(struct cost_coord_heap *h, struct cost_coord c)
 	h->elts[i] = c;
 	h->n_elts++;
 
-	int p = i / 2;
-	while (h->elts[i].cost < h->elts[p].cost && p != 0) {
-		swap(h, i, p);
-		i = p;
-		p = i / 2;
+	if (h->pos) {
+		assert(c.key < h->n_keys && !h->pos[c.key]);
+		h->pos[c.key] = i;
 	}
+
+	sift_up(h, i);
+}
+
+/* for indexed heaps: insert c, or if its key is already present, lower
+   that entry's cost to c.cost; returns 1 if c was newly inserted */
+int cost_coord_heap_update(struct cost_coord_heap *h, struct cost_coord c)
+{
+	assert(h->pos && c.key < h->n_keys);
+
+	unsigned int i = h->pos[c.key];
+	if (!i) {
+		cost_coord_heap_insert(h, c);
+		return 1;
+	}
+
+	assert(c.cost <= h->elts[i].cost);
+	h->elts[i] = c;
+	sift_up(h, i);
+
+	return 0;
+}
+
+/* for indexed heaps: take the entry with the given key out of the heap */
+void cost_coord_heap_remove(struct cost_coord_heap *h, unsigned int key)
+{
+	assert(h->pos && key < h->n_keys && h->pos[key]);
+
+	unsigned int i = h->pos[key];
+	h->pos[key] = 0;
+
+	struct cost_coord last = h->elts[h->n_elts--];
+	if (i > h->n_elts)
+		return;
+
+	/* put the last entry where the removed one was, then restore the
+	   heap in whichever direction it is out of order */
+	h->elts[i] = last;
+	h->pos[last.key] = i;
+	sift_up(h, i);
+	min_heapify(h, h->pos[last.key]);
 }
 
 struct cost_coord cost_coord_heap_delete_min(struct cost_coord_heap *h)
@@ -82,6 +171,11 @@ struct cost_coord cost_coord_heap_delete_min(struct cost_coord_heap *h)
 
 	/* replace the first entry with the last entry */
 	h->elts[1] = h->elts[h->n_elts--];
+	if (h->pos) {
+		h->pos[elt.key] = 0;
+		if (h->n_elts)
+			h->pos[h->elts[1].key] = 1;
+	}
 
 	/* re-run min-heap on the remaining */
 	min_heapify(h, 1);
@@ -115,5 +209,9 @@ int cost_coord_heap_contains_coordinate(struct cost_coord_heap *h, struct coordi
 
 void clear_cost_coord_heap(struct cost_coord_heap *h)
 {
+	if (h->pos)
+		for (unsigned int i = 1; i < h->n_elts + 1; i++)
+			h->pos[h->elts[i].key] = 0;
+
 	h->n_elts = 0;
 }
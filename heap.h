@@ -7,13 +7,25 @@ struct cost_coord_heap {
 	unsigned int size;
 	unsigned int n_elts;
 	struct cost_coord *elts;
+
+	/* for indexed heaps, the position in elts of each key (0 if the key
+	   is not in the heap); NULL otherwise */
+	unsigned int n_keys;
+	unsigned int *pos;
+
+	// set if pos belongs to the caller (see create_shared_index_cost_coord_heap)
+	int shared_pos;
 };
 
 struct cost_coord_heap *create_cost_coord_heap();
+struct cost_coord_heap *create_indexed_cost_coord_heap(unsigned int);
+struct cost_coord_heap *create_shared_index_cost_coord_heap(unsigned int, unsigned int *);
 void free_cost_coord_heap(struct cost_coord_heap *);
 void clear_cost_coord_heap(struct cost_coord_heap *);
 
 void cost_coord_heap_insert(struct cost_coord_heap *, struct cost_coord);
+int cost_coord_heap_update(struct cost_coord_heap *, struct cost_coord);
+void cost_coord_heap_remove(struct cost_coord_heap *, unsigned int);
 struct cost_coord cost_coord_heap_delete_min(struct cost_coord_heap *);
 struct cost_coord cost_coord_heap_peek(struct cost_coord_heap *);
 
@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global_router.h"
+#include "line_router.h"
+#include "maze_router.h"
+#include "router.h"
+#include "usage_matrix.h"
+
+/* LINE PROBE ROUTER
+
+   Mikami and Tabuchi's line-search algorithm. from every block where a
+   routing group starts, probes go out in each cardinal direction as
+   straight lines until they are blocked. every block passed by a level-n
+   line is a base point for level-(n+1) lines perpendicular to it, or for a
+   via that carries the line on in the same direction on another layer.
+   the first line to reach another group is traced back into a segment,
+   just as when two maze wavefronts meet.
+
+   lines never take a step that mri_visit would count as a violation, so
+   the search either finds a clean path or gives up and leaves the net to
+   the maze router. the net's own segments are taken out of the usage matrix
+   first, as they are not obstacles to it (though their vias still are);
+   when routing with negotiated congestion, lines also keep out of blocks
+   with any history of congestion, leaving contested areas to the maze. */
+
+// lines leaving the starting blocks are level 0; a path turns (or takes a
+// via) at most LINE_MAX_LEVEL times
+#define LINE_MAX_LEVEL 6
+
+struct line_probe {
+	struct coordinate at;
+	enum movement mv;
+};
+
+struct probe_list {
+	int n_probes;
+	int size;
+	struct line_probe *probes;
+};
+
+struct line_search {
+	struct maze_route_instance *mri;
+	struct routing_group *rg;
+
+	// backtraces of blocks reached by lines, as in a routing group
+	unsigned char *bt;
+
+	// base points of the next level's lines
+	struct probe_list next;
+
+	unsigned long labelled;
+};
+
+static void probe_list_add(struct probe_list *pl, struct coordinate at, enum movement mv)
+{
+	if (pl->n_probes >= pl->size) {
+		pl->size = pl->size ? pl->size * 2 : 64;
+		pl->probes = realloc(pl->probes, pl->size * sizeof(struct line_probe));
+	}
+
+	pl->probes[pl->n_probes++] = (struct line_probe){at, mv};
+}
+
+// whether the step from c to cc (by mv) is free of the via violations
+// counted in mri_visit; congestion is checked separately
+static int line_step_allowed(struct line_search *ls, struct coordinate c, struct coordinate cc, enum movement mv)
+{
+	struct maze_route_instance *mri = ls->mri;
+	struct usage_matrix *m = mri->m;
+
+	if (!in_usage_bounds(m, cc))
+		return 0;
+
+	if (mri->corridor && !corridor_contains(mri->corridor, cc))
+		return 0;
+
+	// lines stop at blocks already reached by another line
+	if (ls->bt[usage_idx(m, cc)] != BT_NONE)
+		return 0;
+
+	return !mri_via_violated(mri, NULL, ls->bt, c, mv);
+}
+
+// whether cc is too close to other nets or cells, or has been contested
+static int line_congested(struct line_search *ls, struct coordinate cc)
+{
+	struct maze_route_instance *mri = ls->mri;
+
+	if (usage_matrix_violated(mri->m, cc))
+		return 1;
+
+	return mri->cm && congestion_history(mri->cm, cc) > 0;
+}
+
+// extend a line from c by mv until it is blocked or meets another group;
+// returns 1 if the groups were joined
+static int extend_line(struct line_search *ls, struct coordinate c, enum movement mv)
+{
+	struct maze_route_instance *mri = ls->mri;
+	struct usage_matrix *m = mri->m;
+
+	for (;;) {
+		struct coordinate cc = disp_movement(c, mv);
+		if (!line_step_allowed(ls, c, cc, mv))
+			return 0;
+
+		// the maze keeps a join onto such a block only if nothing better
+		// turns up, so it is left to the maze
+		if (line_congested(ls, cc))
+			return 0;
+
+		struct routing_group *visited_rg = mri_group_at(mri, usage_idx(m, cc));
+		if (visited_rg) {
+			if (visited_rg->parent == visited_rg && routing_group_find(visited_rg) != ls->rg) {
+				mri_merge(mri, ls->rg, ls->bt, c, visited_rg, cc);
+				return 1;
+			}
+
+			// a block of a group already joined to this one
+			return 0;
+		}
+
+		ls->bt[usage_idx(m, cc)] = movement_to_backtrace(mv);
+		ls->labelled++;
+
+		if (movement_vertical(mv)) {
+			// after a via, carry on in the direction taken before it
+			mv = backtrace_to_movement(ls->bt[usage_idx(m, c)]);
+		} else {
+			enum movement turns[2];
+			if (mv == GO_EAST || mv == GO_WEST) {
+				turns[0] = GO_NORTH;
+				turns[1] = GO_SOUTH;
+			} else {
+				turns[0] = GO_EAST;
+				turns[1] = GO_WEST;
+			}
+
+			probe_list_add(&ls->next, cc, turns[0]);
+			probe_list_add(&ls->next, cc, turns[1]);
+			probe_list_add(&ls->next, cc, GO_UP);
+			probe_list_add(&ls->next, cc, GO_DOWN);
+		}
+
+		c = cc;
+	}
+}
+
+// join the routing group rg to another group by line search; returns 0 if
+// no path was found within LINE_MAX_LEVEL levels
+static int line_search_from(struct maze_route_instance *mri, struct routing_group *rg, unsigned long *labelled)
+{
+	struct usage_matrix *m = mri->m;
+	struct line_search ls = {mri, rg, calloc(USAGE_SIZE(m), sizeof(unsigned char)), {0, 0, NULL}, 0};
+	struct probe_list level = {0, 0, NULL};
+
+	enum movement cardinals[] = {GO_WEST, GO_NORTH, GO_EAST, GO_SOUTH};
+	for (int y = 0; y < m->d.y; y++) {
+		for (int z = 0; z < m->d.z; z++) {
+			for (int x = 0; x < m->d.x; x++) {
+				struct coordinate c = coordinate_add(m->origin, (struct coordinate){y, z, x});
+				int i = usage_idx(m, c);
+				if (mri->group[i] != rg->id || mri->bt[i] != BT_START)
+					continue;
+
+				ls.bt[i] = BT_START;
+				for (int j = 0; j < 4; j++)
+					probe_list_add(&level, c, cardinals[j]);
+			}
+		}
+	}
+
+	int joined = 0;
+	for (int n = 0; n <= LINE_MAX_LEVEL && !joined && level.n_probes > 0; n++) {
+		for (int i = 0; i < level.n_probes && !joined; i++)
+			joined = extend_line(&ls, level.probes[i].at, level.probes[i].mv);
+
+		struct probe_list t = level;
+		level = ls.next;
+		ls.next = t;
+		ls.next.n_probes = 0;
+	}
+
+	*labelled += ls.labelled;
+
+	free(level.probes);
+	free(ls.next.probes);
+	free(ls.bt);
+
+	return joined;
+}
+
+// connect every group of rn within window w (which is modified) using line
+// probes alone; returns 0, leaving rn as it was, if some group could not be
+// reached
+int line_route_window(struct usage_matrix *w, struct routed_net *rn, struct congestion_map *cm, struct corridor *corridor, struct maze_route_stats *stats)
+{
+	struct routed_segment_head *old_rsh = rn->routed_segments;
+
+	usage_unmark_net(w, rn);
+	struct maze_route_instance mri = create_maze_route_instance(w, rn, cm);
+	mri.corridor = corridor;
+
+	int routed = 1;
+	while (routed && mri.remaining_groups > 1) {
+		struct routing_group *rg = NULL;
+		for (int i = 0; i < mri.n_groups && !rg; i++)
+			if (mri.rgs[i]->parent == mri.rgs[i])
+				rg = mri.rgs[i];
+
+		assert(rg);
+		routed = line_search_from(&mri, rg, &stats->line_cells);
+	}
+
+	stats->merges += mri.stats.merges;
+	free_mri(mri);
+
+	if (!routed)
+		rip_up_new_segments(rn, old_rsh);
+
+	return routed;
+}
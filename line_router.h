@@ -0,0 +1,10 @@
+#ifndef __LINE_ROUTER_H__
+#define __LINE_ROUTER_H__
+
+#include "base_router.h"
+#include "maze_router.h"
+#include "usage_matrix.h"
+
+int line_route_window(struct usage_matrix *, struct routed_net *, struct congestion_map *, struct corridor *, struct maze_route_stats *);
+
+#endif /* __LINE_ROUTER_H__ */
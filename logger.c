@@ -0,0 +1,269 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+
+static const char *module_names[N_LOG_MODULES] = {
+	"router",
+	"negotiate",
+	"optimize",
+	"natural_selection",
+	"crv",
+	"violation"
+};
+
+static const char *level_names[] = {"off", "info", "debug", "trace"};
+
+// the module, level and printf-style format of each event, in the order of
+// enum log_event. formats may take %d, %u, %lu, %p, %f and %s
+static struct {
+	enum log_module module;
+	enum log_level level;
+	const char *format;
+} events[N_LOG_EVENTS] = {
+	{LOG_ROUTER, LOG_INFO, "[router] Iterations: %4d, Score: %d, Violations: %d, Segments to re-route: %d"},
+	{LOG_ROUTER, LOG_INFO, "[router] Iterations: %4d, Score: %d, Violations: %d"},
+	{LOG_ROUTER, LOG_DEBUG, "[router] Ripping up net %d, segment %p (score %d)"},
+	{LOG_ROUTER, LOG_DEBUG, "[router] Rerouting net %d"},
+	{LOG_ROUTER, LOG_INFO, "[router] Stopped at the %s limit with %d violations left, keeping the best routings found"},
+	{LOG_ROUTER, LOG_INFO, "[router] Solution found! Optimizing..."},
+	{LOG_ROUTER, LOG_INFO, "[router] Stopped optimizing at the %s limit"},
+	{LOG_NEGOTIATE, LOG_INFO, "[negotiate] Iterations: %4d, Score: %d, Violations: %d, Present factor: %.2f"},
+	{LOG_OPTIMIZE, LOG_INFO, "[optimize] Iterations: %4d, Score: %d, Changed nets: %d, Violations: %d"},
+	{LOG_NATURAL_SELECTION, LOG_DEBUG, "[natural_selection] adjusted_score = score - %d (min net score) + %d (bias)\n"
+	                                   "[natural_selection] net   seg                rip   rand(%5d)   adj. score\n"
+	                                   "[natural_selection] ---   ----------------   ---   -----------   ----------"},
+	{LOG_NATURAL_SELECTION, LOG_TRACE, "[natural_selection] %3d   %p    X         %5d   %5d"},
+	{LOG_NATURAL_SELECTION, LOG_TRACE, "[natural_selection] %3d   %p               %5d   %5d"},
+	{LOG_CRV, LOG_TRACE, "[crv] net %d seg %p score = %d"},
+	{LOG_VIOLATION, LOG_TRACE, "[violation] by net %d, seg %p at (%d, %d, %d) with (%d, %d, %d)"}
+};
+
+// every module logs its iterations unless told otherwise
+static enum log_level module_levels[N_LOG_MODULES] = {LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO};
+
+unsigned char log_event_enabled[N_LOG_EVENTS];
+
+// records are packed here and written out when it fills
+#define LOG_BUFFER_SIZE (1 << 16)
+
+static FILE *log_file;
+static unsigned char log_buffer[LOG_BUFFER_SIZE];
+static size_t log_used;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static enum log_level parse_level(const char *s, size_t len)
+{
+	for (int i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++)
+		if (strlen(level_names[i]) == len && strncmp(s, level_names[i], len) == 0)
+			return i;
+
+	return -1;
+}
+
+// set the level of modules from a comma-separated list of module[:level],
+// where module may be "all", and a module named alone logs everything;
+// "none" turns every module off. returns 0 if the list cannot be parsed
+int log_set_levels(const char *spec)
+{
+	if (strcmp(spec, "none") == 0) {
+		for (int m = 0; m < N_LOG_MODULES; m++)
+			module_levels[m] = LOG_OFF;
+		return 1;
+	}
+
+	while (*spec) {
+		size_t len = strcspn(spec, ",");
+		size_t name_len = strcspn(spec, ":,");
+
+		enum log_level level = LOG_TRACE;
+		if (name_len < len) {
+			level = parse_level(spec + name_len + 1, len - name_len - 1);
+			if ((int)level < 0) {
+				printf("[logger] unknown level in %.*s\n", (int)len, spec);
+				return 0;
+			}
+		}
+
+		int found = 0;
+		for (int m = 0; m < N_LOG_MODULES; m++) {
+			if ((name_len == 3 && strncmp(spec, "all", 3) == 0) ||
+			    (strlen(module_names[m]) == name_len && strncmp(spec, module_names[m], name_len) == 0)) {
+				module_levels[m] = level;
+				found++;
+			}
+		}
+
+		if (!found) {
+			printf("[logger] unknown module in %.*s\n", (int)len, spec);
+			return 0;
+		}
+
+		spec += len;
+		if (*spec == ',')
+			spec++;
+	}
+
+	return 1;
+}
+
+static void put(const void *p, size_t n)
+{
+	if (log_used + n > LOG_BUFFER_SIZE) {
+		fwrite(log_buffer, 1, log_used, log_file);
+		log_used = 0;
+	}
+
+	assert(n <= LOG_BUFFER_SIZE);
+	memcpy(log_buffer + log_used, p, n);
+	log_used += n;
+}
+
+static void put_u16(uint16_t v)
+{
+	put(&v, sizeof(v));
+}
+
+static void put_string(const char *s)
+{
+	size_t len = strlen(s);
+	put_u16(len);
+	put(s, len);
+}
+
+/* the log starts with a header from which it can be read back:
+     "DEWEYLOG", a uint32 0x01020304 (for the byte order of what follows),
+     the number of modules, and each module's name;
+     the number of events, and each event's module, level and format.
+   strings are a uint16 length and their bytes. each record is then the
+   uint16 id of its event, followed by its arguments: int32 for %d and %u,
+   uint64 for %lu and %p, a double for %f, and a string for %s. */
+static void put_header(void)
+{
+	uint32_t order = 0x01020304;
+	put("DEWEYLOG", 8);
+	put(&order, sizeof(order));
+
+	put_u16(N_LOG_MODULES);
+	for (int m = 0; m < N_LOG_MODULES; m++)
+		put_string(module_names[m]);
+
+	put_u16(N_LOG_EVENTS);
+	for (int e = 0; e < N_LOG_EVENTS; e++) {
+		put_u16(events[e].module);
+		put_u16(events[e].level);
+		put_string(events[e].format);
+	}
+}
+
+// start logging to the file at path, if any event is to be logged; returns
+// 0 if the file cannot be opened
+int log_open(const char *path)
+{
+	int any = 0;
+	for (int e = 0; e < N_LOG_EVENTS; e++) {
+		log_event_enabled[e] = events[e].level <= module_levels[events[e].module];
+		any |= log_event_enabled[e];
+	}
+
+	if (!any)
+		return 1;
+
+	log_file = fopen(path, "wb");
+	if (!log_file) {
+		memset(log_event_enabled, 0, sizeof(log_event_enabled));
+		return 0;
+	}
+
+	log_used = 0;
+	put_header();
+
+	return 1;
+}
+
+void log_event(enum log_event ev, ...)
+{
+	if (!log_file)
+		return;
+
+	va_list ap;
+	va_start(ap, ev);
+	pthread_mutex_lock(&log_lock);
+
+	put_u16(ev);
+	for (const char *f = events[ev].format; *f; f++) {
+		if (*f != '%')
+			continue;
+
+		// skip the flags, width and precision
+		f++;
+		while (*f && strchr("-+ #0123456789.", *f))
+			f++;
+
+		int is_long = *f == 'l';
+		if (is_long)
+			f++;
+
+		switch (*f) {
+		case 'd':
+		case 'u':
+			if (is_long) {
+				uint64_t v = va_arg(ap, unsigned long);
+				put(&v, sizeof(v));
+			} else {
+				int32_t v = va_arg(ap, int);
+				put(&v, sizeof(v));
+			}
+			break;
+		case 'p': {
+			uint64_t v = (uintptr_t)va_arg(ap, void *);
+			put(&v, sizeof(v));
+			break;
+		}
+		case 'f': {
+			double v = va_arg(ap, double);
+			put(&v, sizeof(v));
+			break;
+		}
+		case 's':
+			put_string(va_arg(ap, const char *));
+			break;
+		case '%':
+			break;
+		default:
+			assert(!"unsupported log format");
+		}
+	}
+
+	pthread_mutex_unlock(&log_lock);
+	va_end(ap);
+}
+
+// write out the records logged so far
+void log_flush(void)
+{
+	if (!log_file)
+		return;
+
+	pthread_mutex_lock(&log_lock);
+	fwrite(log_buffer, 1, log_used, log_file);
+	log_used = 0;
+	fflush(log_file);
+	pthread_mutex_unlock(&log_lock);
+}
+
+void log_close(void)
+{
+	memset(log_event_enabled, 0, sizeof(log_event_enabled));
+	if (!log_file)
+		return;
+
+	log_flush();
+	fclose(log_file);
+	log_file = NULL;
+}
@@ -0,0 +1,69 @@
+#ifndef __LOGGER_H__
+#define __LOGGER_H__
+
+/* LOGGING
+
+   events are logged by module, each at a level of detail; a module logs
+   only the events at or below the level it is set to. an event is written
+   as a binary record (its id and its arguments, packed) into a buffer that
+   is written out when full, and the log starts with the module names and
+   the format of every event, so that scripts/decode_log.py can turn it into
+   text without knowing anything about dewey.
+
+   LOG() costs a single load and branch for an event that is not logged, and
+   does not evaluate its arguments. */
+
+enum log_level {
+	LOG_OFF,
+	LOG_INFO,  // once per iteration or stage
+	LOG_DEBUG, // once per net or segment changed
+	LOG_TRACE  // once per segment or block examined
+};
+
+enum log_module {
+	LOG_ROUTER,
+	LOG_NEGOTIATE,
+	LOG_OPTIMIZE,
+	LOG_NATURAL_SELECTION,
+	LOG_CRV, // count_routings_violations
+	LOG_VIOLATION,
+	N_LOG_MODULES
+};
+
+// every event and its arguments, as given by its format in logger.c
+enum log_event {
+	LOG_ROUTER_ITERATION,     // iteration, score, violations, segments to reroute
+	LOG_ROUTER_FINAL,         // iterations, score, violations
+	LOG_ROUTER_RIP_UP,        // net, segment, score
+	LOG_ROUTER_REROUTE,       // net
+	LOG_ROUTER_LIMIT,         // limit, violations
+	LOG_ROUTER_SOLVED,
+	LOG_ROUTER_OPTIMIZE_LIMIT, // limit
+	LOG_NEGOTIATE_ITERATION,  // iteration, score, violations, present factor
+	LOG_OPTIMIZE_ITERATION,   // iteration, score, changed nets, violations
+	LOG_NATURAL_SELECTION_HEADER, // min net score, bias, score range
+	LOG_NATURAL_SELECTION_RIP,    // net, segment, roll, adjusted score
+	LOG_NATURAL_SELECTION_KEEP,   // net, segment, roll, adjusted score
+	LOG_CRV_SEGMENT,          // net, segment, score
+	LOG_VIOLATION_BLOCK,      // net, segment, block, block it collides with
+	N_LOG_EVENTS
+};
+
+// whether each event is logged; set by log_open
+extern unsigned char log_event_enabled[N_LOG_EVENTS];
+
+#define LOG_EVENT_OF(...) LOG_EVENT_OF_(__VA_ARGS__, 0)
+#define LOG_EVENT_OF_(ev, ...) ev
+
+#define LOG(...) do { \
+		if (log_event_enabled[LOG_EVENT_OF(__VA_ARGS__)]) \
+			log_event(__VA_ARGS__); \
+	} while (0)
+
+int log_set_levels(const char *);
+int log_open(const char *);
+void log_event(enum log_event, ...);
+void log_flush(void);
+void log_close(void);
+
+#endif /* __LOGGER_H__ */
@@ -1,92 +1,200 @@
 #include <assert.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "base_router.h"
+#include "congestion.h"
 #include "maze_router.h"
+#include "global_router.h"
 #include "heap.h"
+#include "line_router.h"
+#include "pattern_router.h"
 #include "usage_matrix.h"
 #include "util.h"
 
 /* MAZE REROUTE */
 
-/* a single routing group may consist of any number of pins or
-   already-existing segments, and tracks the state of the
-   wavefront in maze_reroute. extant pins/wires are marked
-   BT_START in the backtrace structure, and cost 0 in the heap. */
-struct routing_group {
-	/* if parent points to this group, it's an independent routing group.
-           when non-NULL, another routing group has subsumed this one. */
-	struct routing_group *parent;
+// search effort accumulated over all calls to maze_reroute, in total and
+// for each net (indexed by net, grown as nets are seen); nets may be routed
+// concurrently, so updates are serialized
+static struct maze_route_stats maze_stats;
+static struct maze_route_stats *maze_net_stats;
+static int n_maze_net_stats;
+static pthread_mutex_t maze_stats_lock = PTHREAD_MUTEX_INITIALIZER;
 
-	/* backtrace for this routing instance */
-	enum backtrace *bt;
+struct maze_route_stats maze_router_stats(void)
+{
+	return maze_stats;
+}
 
-	/* cost matrix for this routing instance */
-	unsigned int *cost;
+// the search effort spent on net
+struct maze_route_stats maze_router_net_stats(net_t net)
+{
+	if ((int)net >= n_maze_net_stats)
+		return (struct maze_route_stats){0};
 
-	// the (parentless) pin or segment that forms
-	// the start from which a Lee's algo wavefront
-	// begins
-	enum rsa_type origin_type;
-	union {
-		void *p;
-		struct routed_segment *rseg;
-		struct placed_pin *pin;
-	} origin;
-};
+	return maze_net_stats[net];
+}
 
-// also confusingly abbreviated MRI
-struct maze_route_instance {
-	struct routed_net *rn;
+void maze_router_reset_stats(void)
+{
+	memset(&maze_stats, 0, sizeof(struct maze_route_stats));
+	free(maze_net_stats);
+	maze_net_stats = NULL;
+	n_maze_net_stats = 0;
+}
 
-	/* heap of cost/coordinate pairs to visit */
-	struct cost_coord_heap *heap;
+// a field of struct maze_route_stats left out of MAZE_ROUTE_STATS_FIELDS
+// makes this array's size negative
+#define COUNT_FIELD(f) + 1
+typedef char maze_route_stats_fields_listed[
+	sizeof(struct maze_route_stats) == (0 MAZE_ROUTE_STATS_FIELDS(COUNT_FIELD)) * sizeof(unsigned long) ? 1 : -1];
+#undef COUNT_FIELD
 
-	struct usage_matrix *m;
-	struct routing_group **visited;
+static void add_maze_route_stats(struct maze_route_stats *a, struct maze_route_stats *b)
+{
+#define ADD_FIELD(f) a->f += b->f;
+	MAZE_ROUTE_STATS_FIELDS(ADD_FIELD)
+#undef ADD_FIELD
+}
 
-	struct routing_group **rgs;
+// the search effort spent since the totals were those in before
+struct maze_route_stats maze_router_stats_since(struct maze_route_stats *before)
+{
+	struct maze_route_stats s = maze_stats;
+#define SUB_FIELD(f) s.f -= before->f;
+	MAZE_ROUTE_STATS_FIELDS(SUB_FIELD)
+#undef SUB_FIELD
 
-	int n_groups;         // groups we currently have
-	int remaining_groups; // groups remaining to combine
-};
+	return s;
+}
 
-static struct routing_group *alloc_routing_group(struct maze_route_instance *mri)
+static void record_maze_route_stats(net_t net, struct maze_route_stats *s)
 {
-	unsigned int usage_size = USAGE_SIZE(mri->m);
+	pthread_mutex_lock(&maze_stats_lock);
+	add_maze_route_stats(&maze_stats, s);
+
+	if ((int)net >= n_maze_net_stats) {
+		int n = max(net + 1, n_maze_net_stats * 2);
+		maze_net_stats = realloc(maze_net_stats, n * sizeof(struct maze_route_stats));
+		memset(maze_net_stats + n_maze_net_stats, 0, (n - n_maze_net_stats) * sizeof(struct maze_route_stats));
+		n_maze_net_stats = n;
+	}
+	add_maze_route_stats(&maze_net_stats[net], s);
 
+	pthread_mutex_unlock(&maze_stats_lock);
+}
+
+static struct routing_group *alloc_routing_group(struct maze_route_instance *mri)
+{
 	struct routing_group *rg = malloc(sizeof(struct routing_group));
 	rg->parent = rg;
-	rg->bt = NULL;
-	rg->cost = NULL;
 
-
-	rg->bt = calloc(usage_size, sizeof(enum backtrace));
-	for (int i = 0; i < usage_size; i++)
-		rg->bt[i] = BT_NONE;
-
-	rg->cost = malloc(usage_size * sizeof(unsigned int));
-	memset(rg->cost, 0xff, usage_size * sizeof(unsigned int));
+	rg->heap = create_shared_index_cost_coord_heap(USAGE_SIZE(mri->m), mri->heap_pos);
+	rg->pending.cost = UINT_MAX;
 
 	rg->origin_type = NONE;
 	rg->origin.p = NULL;
 
+	assert(mri->n_groups < USHRT_MAX);
 	mri->rgs = realloc(mri->rgs, sizeof(struct routing_group *) * ++mri->n_groups);
 	mri->rgs[mri->n_groups-1] = rg;
+	rg->id = mri->n_groups;
 
 	return rg;
 }
 
+// drop whatever is left of a subsumed group's wavefront all at once, so
+// none of it has to be popped and skipped later
+static void discard_routing_group_heap(struct maze_route_instance *mri, struct routing_group *rg)
+{
+	if (!rg->heap)
+		return;
+
+	mri->stats.discarded += rg->heap->n_elts;
+	clear_cost_coord_heap(rg->heap);
+	free_cost_coord_heap(rg->heap);
+	rg->heap = NULL;
+}
+
 void free_routing_group(struct routing_group *rg)
 {
-	free(rg->bt);
-	free(rg->cost);
+	if (rg->heap)
+		free_cost_coord_heap(rg->heap);
+	free(rg);
+}
+
+// the group that owns block i, or NULL if no group has labelled it
+struct routing_group *mri_group_at(struct maze_route_instance *mri, int i)
+{
+	return mri->group[i] ? mri->rgs[mri->group[i] - 1] : NULL;
+}
+
+// rg's backtrace and cost at block i, if rg owns it
+static inline enum backtrace group_bt(struct maze_route_instance *mri, struct routing_group *rg, int i)
+{
+	return mri->group[i] == rg->id ? mri->bt[i] : BT_NONE;
+}
+
+static inline unsigned int group_cost(struct maze_route_instance *mri, struct routing_group *rg, int i)
+{
+	return mri->group[i] == rg->id ? mri->cost[i] : UINT_MAX;
+}
+
+// queue coordinate c for expansion by rg at cost, or lower its queued cost
+static void routing_group_push(struct maze_route_instance *mri, struct routing_group *rg, struct coordinate c, unsigned int cost)
+{
+	struct cost_coord cc = {cost, c, rg, usage_idx(mri->m, c)};
+	if (cost_coord_heap_update(rg->heap, cc))
+		mri->stats.pushes++;
+	else
+		mri->stats.decrease_keys++;
+}
+
+// the cost of what rg would do next, expanding its cheapest heap entry or
+// taking its pending merge; UINT_MAX if it has been subsumed or has run out
+static unsigned int routing_group_next_cost(struct routing_group *rg)
+{
+	if (!rg->heap)
+		return UINT_MAX;
+
+	unsigned int cost = rg->pending.cost;
+	if (rg->heap->n_elts > 0 && cost_coord_heap_peek(rg->heap).cost < cost)
+		cost = cost_coord_heap_peek(rg->heap).cost;
+
+	return cost;
+}
+
+// label block c as reached by rg at cost by way of bt, taking it from
+// whichever group owned it before, and queue it for expansion by rg
+static void label_block(struct maze_route_instance *mri, struct routing_group *rg, struct coordinate c, unsigned int cost, enum backtrace bt)
+{
+	int i = usage_idx(mri->m, c);
+
+	// a block that another group starts from stays that group's; as the
+	// two already touch there, rg is set to join it before anything else
+	struct routing_group *owner = mri_group_at(mri, i);
+	if (owner && owner != rg && owner->parent == owner && mri->bt[i] == BT_START) {
+		rg->pending.cost = 0;
+		rg->pending.c = rg->pending.cc = c;
+		return;
+	}
+
+	// only the owner of a block may have it queued
+	if (owner && owner != rg && mri->heap_pos[i])
+		cost_coord_heap_remove(owner->heap, i);
+
+	mri->group[i] = rg->id;
+	mri->cost[i] = cost;
+	mri->bt[i] = bt;
+	routing_group_push(mri, rg, c, cost);
 }
 
 // union-by-rank's find() method adapted to routing groups
-static struct routing_group *routing_group_find(struct routing_group *rg)
+struct routing_group *routing_group_find(struct routing_group *rg)
 {
 	if (rg->parent != rg)
 		rg->parent = routing_group_find(rg->parent);
@@ -94,45 +202,26 @@ static struct routing_group *routing_group_find(struct routing_group *rg)
 	return rg->parent;
 }
 
-// routines to initialize a routing group based on a pin or a segment
+// routines to initialize a routing group based on a pin or a segment; when
+// a net is repaired, only the blocks inside the window are labelled
 static void init_routing_group_with_pin(struct maze_route_instance *mri, struct routing_group *rg, struct placed_pin *p)
 {
-	struct coordinate start = extend_pin(p);
-	rg->bt[usage_idx(mri->m, start)] = BT_START;
-	rg->cost[usage_idx(mri->m, start)] = 0;
-	struct cost_coord start_cc = {0, start, rg};
-	cost_coord_heap_insert(mri->heap, start_cc);
-	int i = usage_idx(mri->m, extend_pin(p));
-	// assert(!mri->visited[i] || routing_group_find(mri->visited[i]) == routing_group_find(rg));
-	mri->visited[i] = rg;
+	if (in_usage_bounds(mri->m, extend_pin(p)))
+		label_block(mri, rg, extend_pin(p), 0, BT_START);
 
 	rg->origin_type = PIN;
 	rg->origin.pin = p;
 }
 
-static int within_a_vertical(enum backtrace *bt, int i, int n)
-{
-	for (int j = max(i - 1, 0); j < min(i+2, n); j++)
-		if (is_vertical(bt[j]))
-			return 1;
-
-	return 0;
-}
-
 // mark the usage matrix in a 3x3 zone centered on c to prevent subsequent routings
 static void mark_via_violation_zone(struct usage_matrix *m, struct coordinate c)
 {
-	int y1 = max(c.y, 0), y2 = min(c.y, m->d.y - 1);
-	int z1 = max(c.z - 1, 0), z2 = min(c.z + 1, m->d.z - 1);
-	int x1 = max(c.x - 1, 0), x2 = min(c.x + 1, m->d.x - 1);
-
-	for (int y = y1; y <= y2; y++) {
-		for (int z = z1; z <= z2; z++) {
-			for (int x = x1; x <= x2; x++) {
-				struct coordinate cc = {y, z, x};
+	for (int z = c.z - 1; z <= c.z + 1; z++) {
+		for (int x = c.x - 1; x <= c.x + 1; x++) {
+			struct coordinate cc = {c.y, z, x};
 
+			if (in_usage_bounds(m, cc))
 				usage_mark(m, cc);
-			}
 		}
 	}
 }
@@ -141,23 +230,28 @@ static void mark_via_violation_zone(struct usage_matrix *m, struct coordinate c)
 static void init_routing_group_with_segment(struct maze_route_instance *mri, struct routing_group *rg, struct routed_segment *rseg)
 {
 	struct coordinate c = rseg->seg.end;
-	for (int i = 0; i < rseg->n_backtraces; i++) {
-		c = disp_backtrace(c, rseg->bt[i]);
-		assert(in_usage_bounds(mri->m, c));
-
-		if (!within_a_vertical(rseg->bt, i, rseg->n_backtraces)) {
-			struct cost_coord next = {0, c, rg};
-			cost_coord_heap_insert(mri->heap, next);
-			rg->cost[usage_idx(mri->m, c)] = 0;
-			rg->bt[usage_idx(mri->m, c)] = BT_START;
-			mri->visited[usage_idx(mri->m, c)] = rg;
-		} else if (is_vertical(rseg->bt[i]) || (i > 0 && (is_vertical(rseg->bt[i-1])))) {
-			mark_via_violation_zone(mri->m, c);
-		} else {
-			usage_mark(mri->m, c);
-		}
+	for (int r = 0; r < rseg->n_runs; r++) {
+		struct path_run run = rseg->runs[r];
+		struct coordinate step = backtrace_step(run.bt);
+		int prev_vertical = r > 0 && is_vertical(rseg->runs[r-1].bt);
+		int next_vertical = r + 1 < rseg->n_runs && is_vertical(rseg->runs[r+1].bt);
+
+		for (int k = 0; k < run.len; k++) {
+			c = coordinate_add(c, step);
+			if (!in_usage_bounds(mri->m, c))
+				continue;
 
-		// assert(!mri->visited[i] || routing_group_find(mri->visited[i]) == routing_group_find(rg));
+			// blocks of a via, and those on either side of one, may not
+			// be grown from
+			int after_via = is_vertical(run.bt) || (k == 0 && prev_vertical);
+			int before_via = k == run.len - 1 && next_vertical;
+			if (!after_via && !before_via)
+				label_block(mri, rg, c, 0, BT_START);
+			else if (after_via)
+				mark_via_violation_zone(mri->m, c);
+			else
+				usage_mark(mri->m, c);
+		}
 	}
 
 	rg->origin_type = SEGMENT;
@@ -173,34 +267,24 @@ static void routed_segment_add_child(struct routed_net *rn, struct routed_segmen
 		add_adjacent_segment(rn, rseg, child->origin.rseg, at);
 }
 
+// nets are first searched for within their bounding box grown by this much
+// in x and z; the slack doubles each time the net does not fit
+#define WINDOW_SLACK 8
+
 // TODO: implement this again
 #define ROUTER_PREFER_CONTINUE_IN_DIRECTION 0
 
-#define INITIAL_BT_SIZE 4
-
-static int append_backtrace(enum backtrace ent, struct routed_segment *rseg, int bt_size)
-{
-	assert(rseg->n_backtraces < bt_size);
-	rseg->bt[rseg->n_backtraces++] = ent;
-	if (rseg->n_backtraces >= bt_size) {
-		bt_size *= 2;
-		rseg->bt = realloc(rseg->bt, bt_size * sizeof(enum backtrace));
-	}
-	return bt_size;
-}
-
 // starting from a coordinate, build a backtrace array tracing from `c` to the
 // first instance of BT_START. the array is necessarily backwards
 // create a routed_segment based on two backtraces:
 // from a, to a BT_START in a_bt, and from b, to a BT_START in b_bt.
 // a and b should be adjacent.
-static struct routed_segment make_segment_from_backtrace(struct usage_matrix *m,
+// the backtraces are allocated from pool
+static struct routed_segment make_segment_from_backtrace(struct usage_matrix *m, struct net_pool *pool,
 		struct coordinate a, struct coordinate b,
-		enum backtrace *a_bt, enum backtrace *b_bt)
+		unsigned char *a_bt, unsigned char *b_bt)
 {
-	int bt_size = INITIAL_BT_SIZE;
-	struct routed_segment rseg = {{{0, 0, 0}, {0, 0, 0}}, 0, NULL, 0, NULL, 0};
-	rseg.bt = calloc(bt_size, sizeof(enum backtrace));
+	struct routed_segment rseg = {{{0, 0, 0}, {0, 0, 0}}, 0, 0, NULL, {0, 0, 0}, {0, 0, 0}, 0, NULL, 0, NULL, NULL};
 
 	enum backtrace b_to_a = compute_backtrace(b, a);
 
@@ -221,17 +305,17 @@ static struct routed_segment make_segment_from_backtrace(struct usage_matrix *m,
 		if (is_vertical(ent))
 			mark_via_violation_zone(m, b);
 
-		bt_size = append_backtrace(ent, &rseg, bt_size);
+		path_append(pool, &rseg, ent, 1);
 	}
 
 	// now, at BT_START, we are at the end of the B side
 	rseg.seg.end = b;
 
 	// invert the B backtrace
-	invert_backtrace_sequence(rseg.bt, rseg.n_backtraces);
+	path_invert(&rseg);
 
 	// add backtrace bridging (original) B and A
-	bt_size = append_backtrace(b_to_a, &rseg, bt_size);
+	path_append(pool, &rseg, b_to_a, 1);
 
 	// create backtrace to the A side (the start)
 	while (a_bt[usage_idx(m, a)] != BT_START) {
@@ -248,24 +332,19 @@ static struct routed_segment make_segment_from_backtrace(struct usage_matrix *m,
 		if (is_vertical(ent))
 			mark_via_violation_zone(m, a);
 
-		bt_size = append_backtrace(ent, &rseg, bt_size);
+		path_append(pool, &rseg, ent, 1);
 	}
 
 	// now, at BT_START again, we are at the start of the A side
 	rseg.seg.start = a;
+	path_compute_bounds(&rseg);
 
-	// todo: realloc() to resize rseg->bt to size
 	return rseg;
 }
 
 int segment_in_bounds(struct usage_matrix *m, struct routed_segment *rseg)
 {
-	struct coordinate c = rseg->seg.end;
-	for (int i = 0; i < rseg->n_backtraces; i++)
-		if (!in_usage_bounds(m, (c = disp_backtrace(c, rseg->bt[i]))))
-			return 0;
-
-	return 1;
+	return in_usage_bounds(m, rseg->tl) && in_usage_bounds(m, rseg->br);
 }
 
 // if the parent group is not represented by an origin, then
@@ -310,47 +389,50 @@ void find_or_make_routing_group(struct maze_route_instance *mri, struct placed_p
 	}
 }
 
+// add the origin pin or segment of group org into rg
+static void init_routing_group_with_origin(struct maze_route_instance *mri, struct routing_group *rg, struct routing_group *org)
+{
+	if (org->origin_type == PIN)
+		init_routing_group_with_pin(mri, rg, org->origin.pin);
+	else if (org->origin_type == SEGMENT)
+		init_routing_group_with_segment(mri, rg, org->origin.rseg);
+	else
+		printf("[populate_routing_group] wat\n");
+}
+
 // for all of the routing groups other than the one specified,
 // find all children routing_groups and add their origin pins or
 // segments into this one; behavior for setting origin is undefined
 void populate_routing_group(struct maze_route_instance *mri, struct routing_group *rg)
 {
 	for (int i = 0; i < mri->n_groups; i++) {
-		struct routing_group *org = mri->rgs[i], *porg;
-		if (org == rg)
-			continue;
-
-		porg = routing_group_find(org);
-
-		if (porg == rg) {
-			if (org->origin_type == PIN)
-				init_routing_group_with_pin(mri, rg, org->origin.pin);
-			else if (org->origin_type == SEGMENT)
-				init_routing_group_with_segment(mri, rg, org->origin.rseg);
-			else
-				printf("[populate_routing_group] wat\n");
-		}
+		struct routing_group *org = mri->rgs[i];
+		if (org != rg && routing_group_find(org) == rg)
+			init_routing_group_with_origin(mri, rg, org);
 	}
 }
 
-struct maze_route_instance create_maze_route_instance(struct cell_placements *cp, struct routings *rt, struct routed_net *rn, int xz_margin)
+struct maze_route_instance create_maze_route_instance(struct usage_matrix *m, struct routed_net *rn, struct congestion_map *cm)
 {
-	struct maze_route_instance mri = {NULL, NULL, NULL, NULL, NULL, 0, 0};
+	struct maze_route_instance mri = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0, 0, NULL, {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}, NULL, NULL};
 
 	mri.rn = rn;
+	mri.cm = cm;
+	mri.m = m;
 
-	// create usage matrix
-	mri.m = create_usage_matrix(cp, rt, xz_margin);
-	for (int i = 0; i < rn->n_pins; i++)
+	// a net being repaired may reach beyond the window
+	for (int i = 0; i < rn->n_pins && !rn->repair; i++)
 		assert(in_usage_bounds(mri.m, rn->pins[i].coordinate));
-	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next)
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh && !rn->repair; rsh = rsh->next)
 		assert(segment_in_bounds(mri.m, &rsh->rseg));
 
 	unsigned int usage_size = USAGE_SIZE(mri.m);
 
-	// track visiting routing_groups; NULL if not-yet visited
-	mri.visited = calloc(usage_size, sizeof(struct routing_group *));
-	mri.heap = create_cost_coord_heap();
+	// one set of labels for all groups, however many pins the net has
+	mri.group = calloc(usage_size, sizeof(unsigned short));
+	mri.cost = malloc(usage_size * sizeof(unsigned int));
+	mri.bt = calloc(usage_size, sizeof(unsigned char));
+	mri.heap_pos = calloc(usage_size, sizeof(unsigned int));
 
 	// at fewest we can have just one remaining group
 	mri.n_groups = 0;
@@ -375,22 +457,50 @@ void free_mri(struct maze_route_instance mri)
 	for (int i = 0; i < mri.n_groups; i++)
 		free_routing_group(mri.rgs[i]);
 	free(mri.rgs);
-	free_cost_coord_heap(mri.heap);
-	free(mri.visited);
+	free(mri.group);
+	free(mri.cost);
+	free(mri.bt);
+	free(mri.heap_pos);
+	free(mri.guide);
+}
+
+// the cost of a step off the net's Steiner tree
+#define STEINER_GUIDE_COST 1
+
+// mark the bounding box of every edge of the net's Steiner tree, clipped
+// to the window; any shortest path along an edge stays inside its box
+static unsigned char *make_steiner_guide(struct usage_matrix *m, struct routed_net *rn)
+{
+	struct steiner_tree *st = rn->steiner;
+	if (!st)
+		return NULL;
+
+	unsigned char *guide = calloc(m->d.z * m->d.x, sizeof(unsigned char));
+	for (int e = 0; e < st->n_points - 1; e++) {
+		struct coordinate a = st->points[st->edges[e].a], b = st->points[st->edges[e].b];
+		int z1 = max(min(a.z, b.z), m->origin.z), z2 = min(max(a.z, b.z), m->origin.z + (int)m->d.z - 1);
+		int x1 = max(min(a.x, b.x), m->origin.x), x2 = min(max(a.x, b.x), m->origin.x + (int)m->d.x - 1);
+		for (int z = z1; z <= z2; z++)
+			memset(&guide[(z - m->origin.z) * m->d.x + (x1 - m->origin.x)], 1, max(x2 - x1 + 1, 0));
+	}
+
+	return guide;
 }
 
-static int movement_cost(struct maze_route_instance *mri, struct routing_group *rg, struct coordinate c, enum movement mv)
+// the cost of moving from c by mv, having reached c by way of my_bt
+int mri_movement_cost(struct maze_route_instance *mri, enum backtrace my_bt, struct coordinate c, enum movement mv)
 {
-	enum movement prev_mv = backtrace_to_movement(rg->bt[usage_idx(mri->m, c)]);
+	enum movement prev_mv = backtrace_to_movement(my_bt);
 
 	// dissuade turns
 	int turn_cost = (movement_cardinal(mv) && is_cardinal(prev_mv) && prev_mv != mv) ? 5 : 0;
 	int via_cost = movement_vertical(mv) ? 20 : 0;
 	int y_cost = c.y / 2;
 
-	// dissuade going too close to bounds
+	// dissuade going too close to bounds (of the design, not of the window)
 	int edge_margin = 2;
-	int edge_cost = (c.x < edge_margin || c.x > mri->m->d.x - edge_margin || c.z < edge_margin || c.z > mri->m->d.z - edge_margin) ? 4 : 0;
+	struct coordinate e = coordinate_sub(c, mri->m->base);
+	int edge_cost = (e.x < edge_margin || e.x > (int)mri->m->bounds.x - edge_margin || e.z < edge_margin || e.z > (int)mri->m->bounds.z - edge_margin) ? 4 : 0;
 
 	int preferred_direction_cost = 0;
 	if ((c.y == 0 || c.y == 6) && (mv & (GO_NORTH | GO_SOUTH)))
@@ -398,7 +508,14 @@ static int movement_cost(struct maze_route_instance *mri, struct routing_group *
 	else if (c.y == 3 && (mv & (GO_EAST | GO_WEST)))
 		preferred_direction_cost = 10;
 
-	int movement_cost = 1 + turn_cost + via_cost + y_cost + edge_cost + preferred_direction_cost;
+	int steiner_cost = 0;
+	if (mri->guide) {
+		struct coordinate cc = disp_movement(c, mv);
+		if (!mri->guide[(cc.z - mri->m->origin.z) * mri->m->d.x + (cc.x - mri->m->origin.x)])
+			steiner_cost = STEINER_GUIDE_COST;
+	}
+
+	int movement_cost = 1 + turn_cost + via_cost + y_cost + edge_cost + preferred_direction_cost + steiner_cost;
 
 	return movement_cost;
 }
@@ -477,6 +594,114 @@ static int violates_merge_isolation(struct maze_route_instance *mri, struct rout
 }
 */
 
+// join group rg, having reached c by backtrace bt, with visited_rg at the
+// adjacent coordinate cc, adding a segment for the path between them unless
+// c and cc are both where the groups started
+void mri_merge(struct maze_route_instance *mri, struct routing_group *rg, unsigned char *bt,
+		struct coordinate c, struct routing_group *visited_rg, struct coordinate cc)
+{
+	struct usage_matrix *m = mri->m;
+
+	mri->stats.merges++;
+
+	if (bt[usage_idx(m, c)] == BT_START && mri->bt[usage_idx(m, cc)] == BT_START) {
+		// the groups already touch; rg takes over the blocks that
+		// visited_rg (and the groups it subsumed) started from
+		unsigned char *adopt = calloc(mri->n_groups, sizeof(unsigned char));
+		for (int i = 0; i < mri->n_groups; i++)
+			adopt[i] = routing_group_find(mri->rgs[i]) == visited_rg;
+
+		visited_rg->parent = rg->parent;
+		discard_routing_group_heap(mri, visited_rg);
+
+		for (int i = 0; i < mri->n_groups; i++)
+			if (adopt[i])
+				init_routing_group_with_origin(mri, rg, mri->rgs[i]);
+		free(adopt);
+
+		mri->remaining_groups--;
+		return;
+	}
+
+	// create a new segment arising from the merging of these two routing groups
+	struct routed_segment_head *rsh = net_pool_alloc_rsh(&mri->rn->pool);
+	rsh->rseg = make_segment_from_backtrace(m, &mri->rn->pool, c, cc, bt, mri->bt);
+	rsh->rseg.net = mri->rn;
+	routed_net_add_segment_node(mri->rn, rsh);
+
+	// add, as children, the two groups formed by this segment
+	struct routed_segment *rseg = &rsh->rseg;
+	assert(rseg);
+	routed_segment_add_child(mri->rn, rseg, rg, rseg->seg.start);
+	routed_segment_add_child(mri->rn, rseg, visited_rg, rseg->seg.end);
+
+	// create a new routing group based on this segment
+	struct routing_group *new_rg = alloc_routing_group(mri);
+	rg->parent = visited_rg->parent = new_rg;
+	discard_routing_group_heap(mri, rg);
+	discard_routing_group_heap(mri, visited_rg);
+
+	init_routing_group_with_segment(mri, new_rg, rseg);
+	populate_routing_group(mri, new_rg);
+	new_rg->origin_type = SEGMENT;
+	new_rg->origin.rseg = rseg;
+
+	// add the group to the list
+	mri->remaining_groups--;
+}
+
+// the backtrace bt holds for block i, if rg (when given) owns it
+static inline enum backtrace search_bt(struct maze_route_instance *mri, struct routing_group *rg, unsigned char *bt, int i)
+{
+	return !rg || mri->group[i] == rg->id ? bt[i] : BT_NONE;
+}
+
+// whether the step from c by mv breaks the rules for vias, given the
+// backtraces bt of the search so far (only those of blocks rg owns, if rg
+// is given); shared by the maze, line and pattern routers
+int mri_via_violated(struct maze_route_instance *mri, struct routing_group *rg, unsigned char *bt, struct coordinate c, enum movement mv)
+{
+	struct usage_matrix *m = mri->m;
+	struct coordinate cc = disp_movement(c, mv);
+	enum backtrace step = movement_to_backtrace(mv);
+
+	enum backtrace my_bt = search_bt(mri, rg, bt, usage_idx(m, c));
+	enum backtrace b4_bt = search_bt(mri, rg, bt, usage_idx(m, disp_backtrace(c, my_bt))); // ha ha, "before"
+
+	// vias only after two steps in the same cardinal direction (for proper
+	// signal pointing)
+	if (is_vertical(step) && (!is_cardinal(my_bt) || my_bt != b4_bt))
+		return 1;
+
+	// and the step after the block a via lands on goes on the same way
+	if (is_vertical(b4_bt) && is_cardinal(my_bt) && step != my_bt)
+		return 1;
+
+	struct coordinate via_checks[4] = {{0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
+	for (int j = 0; j < 4; j++) {
+		struct coordinate ccc = coordinate_add(cc, via_checks[j]);
+		if (!in_usage_bounds(m, ccc))
+			continue;
+
+		// not beside a via we did not just come from
+		if (movement_cardinal(mv) && is_vertical(search_bt(mri, rg, bt, usage_idx(m, ccc))) && !coordinate_equal(ccc, c))
+			return 1;
+
+		// no via beside a block the net starts from; every such block is
+		// owned by a group that has not been subsumed
+		if (movement_vertical(mv) && mri->group[usage_idx(m, ccc)] && mri->bt[usage_idx(m, ccc)] == BT_START)
+			return 1;
+	}
+
+	// prohibit vias on odd x, z
+/*
+	if (is_vertical(step) && (c.x & 1 || c.z & 1))
+		return 1;
+*/
+
+	return 0;
+}
+
 // visit coordinate cc from coordinate c (of routing group rg), by using
 // backtrace bt, merging groups as needed; if it merged, return 1, otherwise
 // return 0
@@ -490,121 +715,76 @@ static int mri_visit(struct maze_route_instance *mri, struct routing_group *rg,
 	if (!in_usage_bounds(m, cc))
 		return 0;
 
-	// skip this if it's been marked BT_START
-	if (rg->bt[usage_idx(m, cc)] == BT_START)
+	// keep to the net's corridor, if it has one
+	if (mri->corridor && !corridor_contains(mri->corridor, cc))
 		return 0;
 
-	// do not allow up/down movements from a BT_START
-	if (rg->bt[usage_idx(m, c)] == BT_START && is_vertical(bt))
+	int i = usage_idx(m, c), ii = usage_idx(m, cc);
+
+	// skip this if it's been marked BT_START
+	if (group_bt(mri, rg, ii) == BT_START)
 		return 0;
 
-	int violation = 0;
-	// if this is a vertical movement, make sure its origin and the
-	// origin's backtrace are the same (for proper signal pointing)
-	enum backtrace my_bt = rg->bt[usage_idx(m, c)];
-	enum backtrace b4_bt = rg->bt[usage_idx(m, disp_backtrace(c, my_bt))]; // ha ha, "before"
-	if (is_vertical(bt) && is_cardinal(my_bt) && my_bt != b4_bt)
-		violation++;
-
-	// if the coordinate (c) that led to the exploration of this coordinate
-	// (cc) was itself explored by a vertical movement, make sure that this
-	// movement (for c->cc) is the same as the one for the vertical
-	// movement to this one
-	if (is_vertical(b4_bt) && is_cardinal(my_bt) && bt != my_bt)
-		violation++;
-
-	// if we are adjacent to a via we did not just come from, it is a violation
-	struct coordinate via_checks[4] = {{0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
-	if (movement_cardinal(mv)) {
-		for (int i = 0; i < 4; i++) {
-			struct coordinate ccc = coordinate_add(cc, via_checks[i]);
-			if (in_usage_bounds(m, ccc) && is_vertical(rg->bt[usage_idx(m, ccc)]) && !coordinate_equal(ccc, c))
-				violation++;
-		}
-	}
+	// do not allow up/down movements from a BT_START; c is rg's own, as
+	// it came out of rg's heap
+	enum backtrace my_bt = mri->bt[i];
+	if (my_bt == BT_START && is_vertical(bt))
+		return 0;
 
-	// disallow vertical movements adjacent to other nets
-	if (movement_vertical(mv)) {
-		for (int i = 0; i < 4; i++) {
-			struct coordinate ccc = coordinate_add(cc, via_checks[i]);
-			if (in_usage_bounds(m, ccc))
-				for (int j = 0; j < mri->n_groups; j++)
-					if (mri->rgs[j]->bt[usage_idx(m, ccc)] == BT_START)
-						violation++;
-		}
-	}
+	int violation = mri_via_violated(mri, rg, mri->bt, c, mv);
 
-	// prohibit vias on odd x, z
-/*
-	if (is_vertical(bt) && (c.x & 1 || c.z & 1))
-		violation++;
-*/
+	// blocks too close to other nets or cells
+	int congested = usage_matrix_violated(m, cc);
+	violation += congested;
 
-	if (usage_matrix_violated(m, cc))
-		violation++;
+	mri->stats.visits++;
+	mri->stats.violations += violation > 0;
 
 	int violation_cost = 1000;
 
-	int mv_cost = movement_cost(mri, rg, c, mv);
-
-	unsigned int cost_delta = mv_cost + (violation ? violation_cost : 0);
-	unsigned int new_cost = rg->cost[usage_idx(m, c)] + cost_delta;
-
-	// if this location has a lower score, update the cost and backtrace
-	int update_cost = new_cost < rg->cost[usage_idx(m, cc)];
-	if (update_cost) {
-		rg->cost[usage_idx(m, cc)] = new_cost;
-		rg->bt[usage_idx(m, cc)] = bt;
+	int mv_cost = mri_movement_cost(mri, my_bt, c, mv);
+
+	unsigned int cost_delta;
+	if (mri->cm) {
+		// negotiated congestion: sharing a block with another net costs
+		// (base + history) * present congestion; breaking the via rules
+		// of this net is still expensive outright
+		unsigned int h = congestion_history(mri->cm, cc);
+		cost_delta = (unsigned int)((mv_cost + h) * (1.0 + mri->cm->present_factor * congested) + 0.5);
+		if (violation > congested)
+			cost_delta += violation_cost;
+	} else {
+		cost_delta = mv_cost + (violation ? violation_cost : 0);
 	}
-
-	// if the lowest min-heap element expands into another group that is
-	// "independent" (i.e., it is its own parent)
-	struct routing_group *visited_rg = mri->visited[usage_idx(m, cc)];
-	if (!violation && visited_rg && visited_rg->parent == visited_rg && routing_group_find(visited_rg) != rg) {
-		// int merge_violation = violates_merge_isolation(mri, rg, visited_rg, cc) || violates_mutual(mri, rg, visited_rg, cc, mv);
-
-		if (rg->bt[usage_idx(m, c)] == BT_START && visited_rg->bt[usage_idx(m, cc)] == BT_START) {
-			visited_rg->parent = rg->parent;
-			mri->remaining_groups--;
+	unsigned int new_cost = mri->cost[i] + cost_delta;
+
+	// if this expands into another group that is "independent" (i.e., it
+	// is its own parent), the two merge. otherwise the block is that
+	// group's, and its labels may still lie on the way back to where the
+	// group started, so it is not taken; a merge onto it that is only
+	// too close to other nets is kept in case nothing better turns up
+	struct routing_group *visited_rg = mri_group_at(mri, ii);
+	if (visited_rg && visited_rg->parent == visited_rg && visited_rg != rg) {
+		if (!violation) {
+			// int merge_violation = violates_merge_isolation(mri, rg, visited_rg, cc) || violates_mutual(mri, rg, visited_rg, cc, mv);
+			mri_merge(mri, rg, mri->bt, c, visited_rg, cc);
 			return 1;
+		}
 
-		} else {
-			// create a new segment arising from the merging of these two routing groups
-			struct routed_segment_head *rsh = malloc(sizeof(struct routed_segment_head));
-			rsh->next = NULL;
-			rsh->rseg = make_segment_from_backtrace(m, c, cc, rg->bt, visited_rg->bt);
-			rsh->rseg.net = mri->rn;
-			routed_net_add_segment_node(mri->rn, rsh);
-
-			// add, as children, the two groups formed by this segment
-			struct routed_segment *rseg = &rsh->rseg;
-			assert(rseg);
-			routed_segment_add_child(mri->rn, rseg, rg, rseg->seg.start);
-			routed_segment_add_child(mri->rn, rseg, visited_rg, rseg->seg.end);
-
-			// create a new routing group based on this segment
-			struct routing_group *new_rg = alloc_routing_group(mri);
-			rg->parent = visited_rg->parent = new_rg;
-
-			init_routing_group_with_segment(mri, new_rg, rseg);
-			populate_routing_group(mri, new_rg);
-			new_rg->origin_type = SEGMENT;
-			new_rg->origin.rseg = rseg;
-
-			// add the group to the list
-			mri->remaining_groups--;
-			return 1;
+		if (violation == congested && new_cost < rg->pending.cost) {
+			rg->pending.cost = new_cost;
+			rg->pending.c = c;
+			rg->pending.cc = cc;
 		}
-	}
 
-	// if we haven't already visited this one, add it to the heap
-	// (and by "we" i mean this exact routing group, not its children)
-	if (visited_rg != rg) {
-		struct cost_coord next = {new_cost, cc, rg};
-		cost_coord_heap_insert(mri->heap, next);
+		return 0;
 	}
 
-	mri->visited[usage_idx(m, cc)] = rg;
+	// if this location has a lower score, update the cost and backtrace
+	// and (re)queue it; an entry already in the heap has its cost lowered
+	// in place
+	if (new_cost < group_cost(mri, rg, ii))
+		label_block(mri, rg, cc, new_cost, bt);
 
 	return 0;
 }
@@ -613,25 +793,71 @@ static int mri_visit(struct maze_route_instance *mri, struct routing_group *rg,
 // accepts a routed_net object, with any combination of previously-routed
 // segments and unrouted pins and uses Lee's algorithm to connect them
 // assumes that all routed_segments are contiguously placed
-void maze_reroute(struct cell_placements *cp, struct routings *rt, struct routed_net *rn, int xz_margin)
+// if cm is given, costs are those of negotiated-congestion routing
+// the usage matrix is the one kept in rt, brought up to date with the
+// nets changed since the last reroute (see routings_usage)
+void maze_reroute(struct cell_placements *cp, struct routings *rt, struct routed_net *rn, int xz_margin, struct congestion_map *cm)
 {
 	if (rn->n_pins <= 1)
 		return;
 
-	struct maze_route_instance mri = create_maze_route_instance(cp, rt, rn, xz_margin);
+	maze_reroute_in(routings_usage(cp, rt, xz_margin), rn, cm);
+
+	routings_net_changed(rt, rn);
+}
+
+// route rn within window w (and corridor, if given), which is marked (around
+// new vias) as the net is routed; returns 0, leaving rn as it was, if its groups cannot all be
+// connected inside the window
+static int maze_route_window(struct usage_matrix *w, struct routed_net *rn, struct congestion_map *cm, struct corridor *corridor)
+{
+	struct routed_segment_head *old_rsh = rn->routed_segments;
+	struct maze_route_instance mri = create_maze_route_instance(w, rn, cm);
+	mri.corridor = corridor;
+	mri.guide = make_steiner_guide(w, rn);
+	mri.stats.windows++;
+	mri.stats.window_cells += USAGE_SIZE(w);
+	int routed = 1;
 	// printf("[maze_reroute] rerouting net %d\n", rn->net);
 
 	// THERE CAN ONLY BE ONE-- i mean,
 	// repeat until one group remains
 	while (mri.remaining_groups > 1) {
-		// select the smallest non-empty heap that is also its own parent (rg->parent = rg)
+		// select the group with the cheapest heap entry or pending merge
+		// that is also its own parent (rg->parent = rg); subsumed groups
+		// have already had their heaps discarded
+		struct routing_group *next_rg = NULL;
+		unsigned int next_cost = UINT_MAX;
+		for (int i = 0; i < mri.n_groups; i++) {
+			unsigned int cost = routing_group_next_cost(mri.rgs[i]);
+			if (cost < next_cost) {
+				next_rg = mri.rgs[i];
+				next_cost = cost;
+			}
+		}
+
+		// every wavefront has run into the edge of the window
+		if (!next_rg) {
+			routed = 0;
+			break;
+		}
+
+		assert(next_rg == routing_group_find(next_rg));
+
+		// nothing cheaper is left than the pending merge, so take it if
+		// the group it meets has not been subsumed in the meantime
+		if (next_rg->pending.cost == next_cost) {
+			struct coordinate pc = next_rg->pending.c, pcc = next_rg->pending.cc;
+			struct routing_group *visited_rg = mri_group_at(&mri, usage_idx(mri.m, pcc));
+			next_rg->pending.cost = UINT_MAX;
+			if (visited_rg && visited_rg->parent == visited_rg && visited_rg != next_rg)
+				mri_merge(&mri, next_rg, mri.bt, pc, visited_rg, pcc);
+			continue;
+		}
+
 		// expand this smallest heap
-		assert(mri.heap->n_elts > 0);
-		struct cost_coord cc;
-		do {
-			assert(mri.heap->n_elts > 0);
-			cc = cost_coord_heap_delete_min(mri.heap);
-		} while (cc.rg != routing_group_find(cc.rg));
+		struct cost_coord cc = cost_coord_heap_delete_min(next_rg->heap);
+		mri.stats.pops++;
 
 		struct coordinate c = cc.coord;
 		assert(in_usage_bounds(mri.m, c));
@@ -641,8 +867,8 @@ void maze_reroute(struct cell_placements *cp, struct routings *rt, struct routed
 
 		if (!merge_occurred) {
 			// suggest vertical movements only if mine and previous backtraces were cardinal and same
-			enum backtrace my_bt = cc.rg->bt[usage_idx(mri.m, c)];
-			enum backtrace b4_bt = cc.rg->bt[usage_idx(mri.m, disp_backtrace(c, my_bt))];
+			enum backtrace my_bt = mri.bt[usage_idx(mri.m, c)];
+			enum backtrace b4_bt = mri.bt[usage_idx(mri.m, disp_backtrace(c, my_bt))];
 			if (is_cardinal(my_bt) && b4_bt == my_bt) {
 				merge_occurred = mri_visit(&mri, cc.rg, c, GO_UP);
 				if (!merge_occurred)
@@ -651,8 +877,155 @@ void maze_reroute(struct cell_placements *cp, struct routings *rt, struct routed
 		}
 	}
 
+	record_maze_route_stats(rn->net, &mri.stats);
+
 	free_mri(mri);
 	// printf("[maze_reroute] n_routed_segments=%d, n_pins=%d\n", rn->n_routed_segments, rn->n_pins);
 	// assert(rn->n_routed_segments >= rn->n_pins - 1);
 	// printf("[maze_route] done\n");
+
+	if (!routed)
+		rip_up_new_segments(rn, old_rsh);
+
+	return routed;
+}
+
+// nets being repaired are first reconnected within the extent of the
+// segments ripped out of them, grown by this much in x and z
+#define REPAIR_MARGIN 4
+
+// reconnect rn, which is being repaired, within a window around where its
+// segments were ripped up, by patterns and then the maze; the rest of its
+// tree is left alone, even where it reaches beyond the window. returns 0,
+// keeping only the segments made by patterns, if it cannot be done there
+static int maze_repair_window(struct usage_matrix *m, struct routed_net *rn, struct congestion_map *cm)
+{
+	struct coordinate s = {0, REPAIR_MARGIN, REPAIR_MARGIN};
+	struct coordinate tl = coordinate_sub(rn->repair_tl, s), br = coordinate_add(rn->repair_br, s);
+	struct maze_route_stats rs = {0};
+
+	struct usage_matrix *w = usage_matrix_window(m, tl, br);
+	int routed = pattern_route_window(w, rn, cm, NULL, &rs);
+	free_usage_matrix(w);
+
+	if (!routed) {
+		w = usage_matrix_window(m, tl, br);
+		routed = maze_route_window(w, rn, cm, NULL);
+		free_usage_matrix(w);
+	}
+
+	rs.repairs += routed;
+	rs.repair_fallbacks += !routed;
+	record_maze_route_stats(rn->net, &rs);
+
+	return routed;
+}
+
+// the search done by maze_reroute_in, described there
+static void maze_reroute_net(struct usage_matrix *m, struct routed_net *rn, struct congestion_map *cm)
+{
+	if (rn->repair && maze_repair_window(m, rn, cm))
+		return;
+
+	struct coordinate tl, br;
+	compute_net_extent(rn, &tl, &br);
+
+	struct corridor *corridor = rn->corridor;
+	if (corridor) {
+		struct coordinate ctl, cbr;
+		corridor_extent(corridor, &ctl, &cbr);
+		tl = coordinate_piecewise_min(tl, ctl);
+		br = coordinate_piecewise_max(br, cbr);
+	}
+
+	int routed = 0;
+	int tried_patterns = 0;
+	int tried_lines = rn->router != NET_ROUTER_LINE;
+	// the corridor already bounds the search
+	int slack = corridor ? 0 : WINDOW_SLACK;
+	while (!routed) {
+		struct coordinate s = {0, slack, slack};
+		struct coordinate wtl = coordinate_sub(tl, s), wbr = coordinate_add(br, s);
+		struct usage_matrix *w = usage_matrix_window(m, wtl, wbr);
+
+		if (!tried_patterns) {
+			struct maze_route_stats ps = {0};
+			routed = pattern_route_window(w, rn, cm, corridor, &ps);
+			record_maze_route_stats(rn->net, &ps);
+			tried_patterns = 1;
+
+			free_usage_matrix(w);
+			if (routed)
+				break;
+
+			// what is left starts over on an unmarked window
+			w = usage_matrix_window(m, wtl, wbr);
+		}
+
+		if (!tried_lines) {
+			struct maze_route_stats ls = {0};
+			routed = line_route_window(w, rn, cm, corridor, &ls);
+			ls.line_routed += routed;
+			ls.line_failed += !routed;
+			record_maze_route_stats(rn->net, &ls);
+			tried_lines = 1;
+
+			if (routed) {
+				free_usage_matrix(w);
+				break;
+			}
+
+			// start the maze over on an unmarked window
+			free_usage_matrix(w);
+			w = usage_matrix_window(m, wtl, wbr);
+		}
+
+		int full = usage_matrix_is_full(w);
+		routed = maze_route_window(w, rn, cm, corridor);
+		free_usage_matrix(w);
+
+		if (routed)
+			break;
+
+		// leave the corridor before growing the window
+		if (corridor) {
+			struct maze_route_stats cs = {0};
+			cs.corridor_escapes++;
+			record_maze_route_stats(rn->net, &cs);
+			corridor = NULL;
+			slack = WINDOW_SLACK;
+			continue;
+		}
+
+		if (full) {
+			printf("[maze_reroute] could not route net %d\n", rn->net);
+			assert(routed);
+		}
+
+		slack *= 2;
+	}
+}
+
+// like maze_reroute, but searches against a usage matrix built by the
+// caller, which is only read, so it may be shared by nets routed at the
+// same time; the search is confined to a window around the net's pins and
+// segments, which grows only if the net cannot be routed inside it. in the
+// smallest window, groups are first joined by simple shapes where they
+// can be, and nets set to use the line router are then tried with line
+// probes. a net with a corridor from global routing is kept to it until it
+// turns out not to fit. a net being repaired is first reconnected around
+// where it was ripped up. the time it takes is recorded with the net's
+// search effort
+void maze_reroute_in(struct usage_matrix *m, struct routed_net *rn, struct congestion_map *cm)
+{
+	if (rn->n_pins <= 1)
+		return;
+
+	unsigned long start = wall_usec();
+	maze_reroute_net(m, rn, cm);
+
+	struct maze_route_stats ts = {0};
+	ts.reroutes++;
+	ts.usec = wall_usec() - start;
+	record_maze_route_stats(rn->net, &ts);
 }
@@ -3,7 +3,128 @@
 
 #include "placer.h"
 #include "base_router.h"
+#include "congestion.h"
+#include "usage_matrix.h"
 
-void maze_reroute(struct cell_placements *, struct routings *, struct routed_net *, int);
+// counts of the search effort spent by maze_reroute
+struct maze_route_stats {
+	unsigned long reroutes;      // times a net was routed
+	unsigned long usec;          // wall time spent routing nets, in microseconds
+	unsigned long pops;          // heap entries expanded
+	unsigned long visits;        // moves out of expanded blocks that were costed
+	unsigned long violations;    // of those, moves that broke the via or spacing rules
+	unsigned long pushes;        // heap entries inserted
+	unsigned long decrease_keys; // queued entries whose cost was lowered in place
+	unsigned long merges;        // routing groups joined
+	unsigned long discarded;     // queued entries dropped when their group merged
+	unsigned long windows;       // search windows tried
+	unsigned long window_cells;  // total size of the search windows tried
+	unsigned long line_routed;   // nets connected entirely by line probes
+	unsigned long line_failed;   // nets handed to the maze after line probing failed
+	unsigned long line_cells;    // blocks labelled by line probes
+	unsigned long corridor_escapes; // nets that did not fit in their global routing corridor
+	unsigned long pattern_joins; // groups joined by an L or Z shape
+	unsigned long pattern_left;  // groups left to the line probes or the maze after shapes were tried
+	unsigned long repairs;          // nets reconnected around the segments ripped out of them
+	unsigned long repair_fallbacks; // nets that could not be, and were routed in a window around the whole net
+};
+
+// every field of struct maze_route_stats, to be kept in step with it; what
+// is done to each field (such as adding or subtracting it) is F
+#define MAZE_ROUTE_STATS_FIELDS(F) \
+	F(reroutes) F(usec) F(pops) F(visits) F(violations) F(pushes) \
+	F(decrease_keys) F(merges) F(discarded) F(windows) F(window_cells) \
+	F(line_routed) F(line_failed) F(line_cells) F(corridor_escapes) \
+	F(pattern_joins) F(pattern_left) F(repairs) F(repair_fallbacks)
+
+/* a single routing group may consist of any number of pins or
+   already-existing segments, and tracks the state of the
+   wavefront in maze_reroute. extant pins/wires are marked
+   BT_START in the backtrace structure, and cost 0 in the heap. */
+struct routing_group {
+	/* if parent points to this group, it's an independent routing group.
+           when non-NULL, another routing group has subsumed this one. */
+	struct routing_group *parent;
+
+	/* this group's entry in the instance's group array (its index in
+	   rgs, plus one) */
+	unsigned short id;
+
+	/* heap of cost/coordinate pairs this group has yet to expand,
+	   indexed through the instance's heap_pos; NULL once the group has
+	   been subsumed by another */
+	struct cost_coord_heap *heap;
+
+	/* the cheapest step from a block of this group (c) into a block of
+	   another (cc) that was too close to other nets to merge on at once;
+	   it is taken if the group finds nothing cheaper. cost is UINT_MAX
+	   if there is none */
+	struct {
+		unsigned int cost;
+		struct coordinate c, cc;
+	} pending;
+
+	// the (parentless) pin or segment that forms
+	// the start from which a Lee's algo wavefront
+	// begins
+	enum rsa_type origin_type;
+	union {
+		void *p;
+		struct routed_segment *rseg;
+		struct placed_pin *pin;
+	} origin;
+};
+
+// also confusingly abbreviated MRI
+struct maze_route_instance {
+	struct routed_net *rn;
+
+	struct usage_matrix *m;
+
+	/* labels shared by all groups: the group (by id, 0 for none) that
+	   last labelled each block, and that group's cost and backtrace there.
+	   a group's labels are those of the blocks it owns; blocks owned by
+	   subsumed groups are free to be labelled again */
+	unsigned short *group;
+	unsigned int *cost;
+	unsigned char *bt;
+
+	// position of each block in the heap of the group that queued it
+	unsigned int *heap_pos;
+
+	struct routing_group **rgs;
+
+	int n_groups;         // groups we currently have
+	int remaining_groups; // groups remaining to combine
+
+	// negotiated-congestion costs, or NULL to use a fixed violation cost
+	struct congestion_map *cm;
+
+	struct maze_route_stats stats;
+
+	// tiles the search is confined to, or NULL
+	struct corridor *corridor;
+
+	// blocks (in x and z, over the window) within the bounding box of an
+	// edge of the net's Steiner tree, or NULL; leaving them costs a little
+	// more, so groups neighboring in the tree tend to meet first
+	unsigned char *guide;
+};
+
+struct maze_route_stats maze_router_stats(void);
+struct maze_route_stats maze_router_net_stats(net_t);
+struct maze_route_stats maze_router_stats_since(struct maze_route_stats *);
+void maze_router_reset_stats(void);
+
+struct maze_route_instance create_maze_route_instance(struct usage_matrix *, struct routed_net *, struct congestion_map *);
+void free_mri(struct maze_route_instance);
+struct routing_group *routing_group_find(struct routing_group *);
+struct routing_group *mri_group_at(struct maze_route_instance *, int);
+void mri_merge(struct maze_route_instance *, struct routing_group *, unsigned char *, struct coordinate, struct routing_group *, struct coordinate);
+int mri_movement_cost(struct maze_route_instance *, enum backtrace, struct coordinate, enum movement);
+int mri_via_violated(struct maze_route_instance *, struct routing_group *, unsigned char *, struct coordinate, enum movement);
+
+void maze_reroute(struct cell_placements *, struct routings *, struct routed_net *, int, struct congestion_map *);
+void maze_reroute_in(struct usage_matrix *, struct routed_net *, struct congestion_map *);
 
 #endif /* __MAZE_ROUTER_H__ */
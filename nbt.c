@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nbt.h"
+
+/* writing */
+
+void nbt_buffer_init(struct nbt_buffer *nb, size_t sz)
+{
+	nb->sz = sz ? sz : 64;
+	nb->b = malloc(nb->sz);
+	nb->n = 0;
+}
+
+void nbt_put(struct nbt_buffer *nb, const void *p, size_t n)
+{
+	if (nb->n + n > nb->sz) {
+		while (nb->n + n > nb->sz)
+			nb->sz *= 2;
+		nb->b = realloc(nb->b, nb->sz);
+	}
+
+	memcpy(nb->b + nb->n, p, n);
+	nb->n += n;
+}
+
+void nbt_byte(struct nbt_buffer *nb, unsigned char v)
+{
+	nbt_put(nb, &v, 1);
+}
+
+// NBT is big-endian
+void nbt_short(struct nbt_buffer *nb, uint16_t v)
+{
+	unsigned char b[2] = {v >> 8, v & 0xff};
+	nbt_put(nb, b, 2);
+}
+
+void nbt_int(struct nbt_buffer *nb, int32_t v)
+{
+	uint32_t u = v;
+	unsigned char b[4] = {u >> 24, (u >> 16) & 0xff, (u >> 8) & 0xff, u & 0xff};
+	nbt_put(nb, b, 4);
+}
+
+void nbt_long(struct nbt_buffer *nb, int64_t v)
+{
+	uint64_t u = v;
+	nbt_int(nb, u >> 32);
+	nbt_int(nb, u & 0xffffffff);
+}
+
+void nbt_string(struct nbt_buffer *nb, const char *s)
+{
+	size_t len = strlen(s);
+	nbt_short(nb, len);
+	nbt_put(nb, s, len);
+}
+
+// the type and name of a named tag, whose payload follows
+void nbt_tag(struct nbt_buffer *nb, enum nbt_tag type, const char *name)
+{
+	nbt_byte(nb, type);
+	nbt_string(nb, name);
+}
+
+static void write_payload(struct nbt_buffer *nb, struct nbt_node *n)
+{
+	switch (n->type) {
+	case TAG_BYTE:
+		nbt_byte(nb, n->i);
+		break;
+	case TAG_SHORT:
+		nbt_short(nb, n->i);
+		break;
+	case TAG_INT:
+		nbt_int(nb, n->i);
+		break;
+	case TAG_LONG:
+		nbt_long(nb, n->i);
+		break;
+	case TAG_FLOAT: {
+		float f = n->f;
+		uint32_t u;
+		memcpy(&u, &f, sizeof(u));
+		nbt_int(nb, u);
+		break;
+	}
+	case TAG_DOUBLE: {
+		uint64_t u;
+		memcpy(&u, &n->f, sizeof(u));
+		nbt_long(nb, u);
+		break;
+	}
+	case TAG_STRING:
+		nbt_short(nb, n->len);
+		nbt_put(nb, n->bytes, n->len);
+		break;
+	case TAG_BYTE_ARRAY:
+	case TAG_INT_ARRAY:
+	case TAG_LONG_ARRAY:
+		nbt_int(nb, n->len);
+		nbt_put(nb, n->bytes, n->len * (n->type == TAG_BYTE_ARRAY ? 1 : n->type == TAG_INT_ARRAY ? 4 : 8));
+		break;
+	case TAG_LIST:
+		nbt_byte(nb, n->n_children ? n->list_type : TAG_END);
+		nbt_int(nb, n->n_children);
+		for (int i = 0; i < n->n_children; i++)
+			write_payload(nb, n->children[i]);
+		break;
+	case TAG_COMPOUND:
+		for (int i = 0; i < n->n_children; i++)
+			nbt_write(nb, n->children[i]);
+		nbt_byte(nb, TAG_END);
+		break;
+	default:
+		break;
+	}
+}
+
+// write n as a named tag
+void nbt_write(struct nbt_buffer *nb, struct nbt_node *n)
+{
+	nbt_tag(nb, n->type, n->name ? n->name : "");
+	write_payload(nb, n);
+}
+
+/* reading */
+
+// compounds and lists may nest no deeper than this
+#define NBT_MAX_DEPTH 512
+
+struct nbt_reader {
+	const unsigned char *b;
+	size_t n, pos;
+	int failed;
+};
+
+static const unsigned char *take(struct nbt_reader *r, size_t n)
+{
+	if (r->failed || n > r->n - r->pos) {
+		r->failed = 1;
+		return NULL;
+	}
+
+	const unsigned char *p = r->b + r->pos;
+	r->pos += n;
+	return p;
+}
+
+static uint64_t take_be(struct nbt_reader *r, int n)
+{
+	const unsigned char *p = take(r, n);
+	uint64_t v = 0;
+	for (int i = 0; p && i < n; i++)
+		v = v << 8 | p[i];
+	return v;
+}
+
+static char *take_string(struct nbt_reader *r)
+{
+	size_t len = take_be(r, 2);
+	const unsigned char *p = take(r, len);
+	if (!p)
+		return NULL;
+
+	char *s = malloc(len + 1);
+	memcpy(s, p, len);
+	s[len] = '\0';
+	return s;
+}
+
+static struct nbt_node *new_node(enum nbt_tag type, char *name)
+{
+	struct nbt_node *n = calloc(1, sizeof(struct nbt_node));
+	n->type = type;
+	n->name = name;
+	return n;
+}
+
+static void add_child(struct nbt_node *parent, struct nbt_node *child)
+{
+	if (parent->n_children == parent->sz_children) {
+		parent->sz_children = parent->sz_children ? parent->sz_children * 2 : 4;
+		parent->children = realloc(parent->children, parent->sz_children * sizeof(struct nbt_node *));
+	}
+
+	parent->children[parent->n_children++] = child;
+}
+
+static int read_payload(struct nbt_reader *r, struct nbt_node *n, int depth)
+{
+	switch (n->type) {
+	case TAG_BYTE:
+		n->i = (int8_t)take_be(r, 1);
+		break;
+	case TAG_SHORT:
+		n->i = (int16_t)take_be(r, 2);
+		break;
+	case TAG_INT:
+		n->i = (int32_t)take_be(r, 4);
+		break;
+	case TAG_LONG:
+		n->i = (int64_t)take_be(r, 8);
+		break;
+	case TAG_FLOAT: {
+		uint32_t u = take_be(r, 4);
+		float f;
+		memcpy(&f, &u, sizeof(f));
+		n->f = f;
+		break;
+	}
+	case TAG_DOUBLE: {
+		uint64_t u = take_be(r, 8);
+		memcpy(&n->f, &u, sizeof(n->f));
+		break;
+	}
+	case TAG_STRING:
+	case TAG_BYTE_ARRAY:
+	case TAG_INT_ARRAY:
+	case TAG_LONG_ARRAY: {
+		int size = n->type == TAG_INT_ARRAY ? 4 : n->type == TAG_LONG_ARRAY ? 8 : 1;
+		n->len = n->type == TAG_STRING ? (int32_t)take_be(r, 2) : (int32_t)take_be(r, 4);
+		if (n->len < 0 || (size_t)n->len > (r->n - r->pos) / size)
+			return 0;
+
+		const unsigned char *p = take(r, n->len * size);
+		n->bytes = malloc(n->len * size + 1);
+		if (p)
+			memcpy(n->bytes, p, n->len * size);
+		break;
+	}
+	case TAG_LIST: {
+		if (depth >= NBT_MAX_DEPTH)
+			return 0;
+
+		n->list_type = take_be(r, 1);
+		int32_t count = take_be(r, 4);
+		if (count < 0 || (count > 0 && (n->list_type == TAG_END || n->list_type > TAG_LONG_ARRAY)))
+			return 0;
+
+		for (int32_t i = 0; i < count && !r->failed; i++) {
+			struct nbt_node *child = new_node(n->list_type, NULL);
+			add_child(n, child);
+			if (!read_payload(r, child, depth + 1))
+				return 0;
+		}
+		break;
+	}
+	case TAG_COMPOUND:
+		if (depth >= NBT_MAX_DEPTH)
+			return 0;
+
+		for (;;) {
+			enum nbt_tag type = take_be(r, 1);
+			if (r->failed || type == TAG_END)
+				break;
+			if (type > TAG_LONG_ARRAY)
+				return 0;
+
+			struct nbt_node *child = new_node(type, take_string(r));
+			add_child(n, child);
+			if (!read_payload(r, child, depth + 1))
+				return 0;
+		}
+		break;
+	default:
+		return 0;
+	}
+
+	return !r->failed;
+}
+
+// read the named tag at the start of b (of n bytes); NULL if it is not
+// well-formed
+struct nbt_node *nbt_read(const unsigned char *b, size_t n)
+{
+	struct nbt_reader r = {b, n, 0, 0};
+
+	enum nbt_tag type = take_be(&r, 1);
+	if (r.failed || type == TAG_END || type > TAG_LONG_ARRAY)
+		return NULL;
+
+	struct nbt_node *root = new_node(type, take_string(&r));
+	if (!read_payload(&r, root, 0)) {
+		nbt_free(root);
+		return NULL;
+	}
+
+	return root;
+}
+
+/* editing */
+
+// the child of compound n named name, or NULL
+struct nbt_node *nbt_find(struct nbt_node *n, const char *name)
+{
+	if (!n || n->type != TAG_COMPOUND)
+		return NULL;
+
+	for (int i = 0; i < n->n_children; i++)
+		if (n->children[i]->name && strcmp(n->children[i]->name, name) == 0)
+			return n->children[i];
+
+	return NULL;
+}
+
+// add a tag of the given type to compound (or list) n; it starts out zero
+// or empty
+struct nbt_node *nbt_add(struct nbt_node *n, enum nbt_tag type, const char *name)
+{
+	char *copy = NULL;
+	if (n->type == TAG_COMPOUND) {
+		copy = malloc(strlen(name) + 1);
+		strcpy(copy, name);
+	} else {
+		n->list_type = type;
+	}
+
+	struct nbt_node *child = new_node(type, copy);
+	add_child(n, child);
+	return child;
+}
+
+// add an array of len elements, all zero, to compound n
+struct nbt_node *nbt_add_array(struct nbt_node *n, enum nbt_tag type, const char *name, int32_t len)
+{
+	int size = type == TAG_INT_ARRAY ? 4 : type == TAG_LONG_ARRAY ? 8 : 1;
+
+	struct nbt_node *child = nbt_add(n, type, name);
+	child->len = len;
+	child->bytes = calloc(len * size + 1, 1);
+	return child;
+}
+
+// remove, and free, child from n
+void nbt_remove(struct nbt_node *n, struct nbt_node *child)
+{
+	for (int i = 0; i < n->n_children; i++) {
+		if (n->children[i] == child) {
+			memmove(&n->children[i], &n->children[i + 1], (n->n_children - i - 1) * sizeof(struct nbt_node *));
+			n->n_children--;
+			nbt_free(child);
+			return;
+		}
+	}
+}
+
+void nbt_free(struct nbt_node *n)
+{
+	if (!n)
+		return;
+
+	for (int i = 0; i < n->n_children; i++)
+		nbt_free(n->children[i]);
+	free(n->children);
+	free(n->bytes);
+	free(n->name);
+	free(n);
+}
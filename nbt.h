@@ -0,0 +1,69 @@
+#ifndef __NBT_H__
+#define __NBT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* NBT, the format Minecraft keeps worlds and schematics in: named, typed
+   tags, big-endian, nested in lists and compounds */
+
+enum nbt_tag {
+	TAG_END = 0,
+	TAG_BYTE = 1,
+	TAG_SHORT = 2,
+	TAG_INT = 3,
+	TAG_LONG = 4,
+	TAG_FLOAT = 5,
+	TAG_DOUBLE = 6,
+	TAG_BYTE_ARRAY = 7,
+	TAG_STRING = 8,
+	TAG_LIST = 9,
+	TAG_COMPOUND = 10,
+	TAG_INT_ARRAY = 11,
+	TAG_LONG_ARRAY = 12
+};
+
+// NBT is written into memory, to be compressed in one go
+struct nbt_buffer {
+	unsigned char *b;
+	size_t n, sz;
+};
+
+void nbt_buffer_init(struct nbt_buffer *, size_t);
+void nbt_put(struct nbt_buffer *, const void *, size_t);
+void nbt_byte(struct nbt_buffer *, unsigned char);
+void nbt_short(struct nbt_buffer *, uint16_t);
+void nbt_int(struct nbt_buffer *, int32_t);
+void nbt_long(struct nbt_buffer *, int64_t);
+void nbt_string(struct nbt_buffer *, const char *);
+void nbt_tag(struct nbt_buffer *, enum nbt_tag, const char *);
+
+// a tag read back, to be changed and written out again
+struct nbt_node {
+	enum nbt_tag type;
+	char *name; // NULL for the elements of a list
+
+	// bytes, shorts, ints and longs; floats and doubles
+	int64_t i;
+	double f;
+
+	// byte arrays and strings hold their bytes, and int and long arrays
+	// their elements as they are stored (big-endian); len counts elements
+	int32_t len;
+	unsigned char *bytes;
+
+	// lists and compounds
+	enum nbt_tag list_type;
+	int n_children, sz_children;
+	struct nbt_node **children;
+};
+
+struct nbt_node *nbt_read(const unsigned char *, size_t);
+void nbt_write(struct nbt_buffer *, struct nbt_node *);
+struct nbt_node *nbt_find(struct nbt_node *, const char *);
+struct nbt_node *nbt_add(struct nbt_node *, enum nbt_tag, const char *);
+struct nbt_node *nbt_add_array(struct nbt_node *, enum nbt_tag, const char *, int32_t);
+void nbt_remove(struct nbt_node *, struct nbt_node *);
+void nbt_free(struct nbt_node *);
+
+#endif /* __NBT_H__ */
@@ -0,0 +1,201 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel_router.h"
+#include "maze_router.h"
+#include "router.h"
+#include "util.h"
+
+/* PARALLEL NET ROUTING
+
+   nets whose bounding boxes (grown by BATCH_MARGIN) do not intersect are
+   unlikely to interact, so they are collected into a batch and routed at
+   the same time against a usage matrix built once for the batch. results
+   are committed in order; a net whose new segments come too close to
+   those of a net committed before it in the same batch is ripped up again
+   and routed in a later batch. */
+
+#define BATCH_MARGIN 4
+
+struct net_extent {
+	struct coordinate tl; // top-left (minimum) corner
+	struct coordinate br; // bottom-right (maximum) corner
+};
+
+// whether two extents, each grown by BATCH_MARGIN in x and z, intersect
+static int extents_overlap(struct net_extent a, struct net_extent b)
+{
+	return a.tl.x - BATCH_MARGIN <= b.br.x + BATCH_MARGIN && b.tl.x - BATCH_MARGIN <= a.br.x + BATCH_MARGIN &&
+	       a.tl.z - BATCH_MARGIN <= b.br.z + BATCH_MARGIN && b.tl.z - BATCH_MARGIN <= a.br.z + BATCH_MARGIN;
+}
+
+// move the nets in pending that do not overlap each other (taken greedily
+// in order) into batch, which must have room for all of pending; returns
+// the number of nets in the batch, and keeps the rest of pending in order
+int select_net_batch(struct routed_net **pending, int *n_pending, struct routed_net **batch)
+{
+	struct net_extent *extents = malloc(*n_pending * sizeof(struct net_extent));
+	int n_batch = 0, n_left = 0;
+
+	for (int i = 0; i < *n_pending; i++) {
+		struct net_extent e;
+		compute_net_extent(pending[i], &e.tl, &e.br);
+
+		int fits = 1;
+		for (int j = 0; j < n_batch && fits; j++)
+			if (extents_overlap(e, extents[j]))
+				fits = 0;
+
+		if (fits) {
+			extents[n_batch] = e;
+			batch[n_batch++] = pending[i];
+		} else {
+			pending[n_left++] = pending[i];
+		}
+	}
+
+	*n_pending = n_left;
+	free(extents);
+
+	return n_batch;
+}
+
+struct batch_work {
+	struct usage_matrix *m;
+	struct congestion_map *cm;
+
+	struct routed_net **nets;
+	int n_nets;
+
+	// index of the next net to be routed
+	int next;
+	pthread_mutex_t lock;
+};
+
+static void *batch_worker(void *arg)
+{
+	struct batch_work *w = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&w->lock);
+		int i = w->next++;
+		pthread_mutex_unlock(&w->lock);
+
+		if (i >= w->n_nets)
+			break;
+
+		maze_reroute_in(w->m, w->nets[i], w->cm);
+	}
+
+	return NULL;
+}
+
+// maze route every net in the batch against usage matrix m, which is only
+// read, using up to `threads` threads
+void route_net_batch(struct usage_matrix *m, struct routed_net **batch, int n_batch, struct congestion_map *cm, int threads)
+{
+	struct batch_work w = {m, cm, batch, n_batch, 0, PTHREAD_MUTEX_INITIALIZER};
+
+	int n_workers = max(min(threads, n_batch), 1);
+	pthread_t *workers = calloc(n_workers, sizeof(pthread_t));
+
+	// this thread is the last worker
+	for (int i = 0; i < n_workers - 1; i++)
+		pthread_create(&workers[i], NULL, batch_worker, &w);
+	batch_worker(&w);
+	for (int i = 0; i < n_workers - 1; i++)
+		pthread_join(workers[i], NULL);
+
+	free(workers);
+	pthread_mutex_destroy(&w.lock);
+}
+
+// whether the segments of rn added since `old` come too close to anything in m
+static int new_segments_conflict(struct usage_matrix *m, struct routed_net *rn, struct routed_segment_head *old)
+{
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh != old; rsh = rsh->next) {
+		struct coordinate c = rsh->rseg.seg.end;
+		for (int r = 0; r < rsh->rseg.n_runs; r++) {
+			struct coordinate step = backtrace_step(rsh->rseg.runs[r].bt);
+			for (int k = 0; k < rsh->rseg.runs[r].len; k++) {
+				c = coordinate_add(c, step);
+				if (in_usage_bounds(m, c) && usage_matrix_violated(m, c))
+					return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void mark_new_segments(struct usage_matrix *m, struct routed_net *rn, struct routed_segment_head *old)
+{
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh != old; rsh = rsh->next) {
+		struct coordinate c = rsh->rseg.seg.end;
+		for (int r = 0; r < rsh->rseg.n_runs; r++) {
+			struct coordinate step = backtrace_step(rsh->rseg.runs[r].bt);
+			for (int k = 0; k < rsh->rseg.runs[r].len; k++) {
+				c = coordinate_add(c, step);
+				if (!in_usage_bounds(m, c))
+					continue;
+
+				usage_mark(m, c);
+				c.y--;
+				if (in_usage_bounds(m, c))
+					usage_mark(m, c);
+				c.y++;
+			}
+		}
+	}
+}
+
+// reroute each of the nets (whose unwanted segments have already been ripped
+// up), using up to `threads` threads; with a single thread, nets are simply
+// rerouted one after another
+void reroute_nets(struct cell_placements *cp, struct routings *rt, struct routed_net **nets, int n_nets, int xz_margin, struct congestion_map *cm, int threads)
+{
+	if (threads <= 1) {
+		for (int i = 0; i < n_nets; i++)
+			maze_reroute(cp, rt, nets[i], xz_margin, cm);
+		return;
+	}
+
+	struct routed_net **pending = malloc(n_nets * sizeof(struct routed_net *));
+	struct routed_net **batch = malloc(n_nets * sizeof(struct routed_net *));
+	struct routed_segment_head **old = malloc(n_nets * sizeof(struct routed_segment_head *));
+	memcpy(pending, nets, n_nets * sizeof(struct routed_net *));
+	int n_pending = n_nets;
+
+	while (n_pending > 0) {
+		int n_batch = select_net_batch(pending, &n_pending, batch);
+		for (int i = 0; i < n_batch; i++)
+			old[i] = batch[i]->routed_segments;
+
+		struct usage_matrix *m = create_usage_matrix(cp, rt, xz_margin);
+		route_net_batch(m, batch, n_batch, cm, threads);
+		for (int i = 0; i < n_batch; i++)
+			routings_net_changed(rt, batch[i]);
+
+		// commit in order, sending nets that conflict with those
+		// before them back to be routed again
+		struct usage_matrix *committed = create_empty_usage_matrix(m->origin, m->d, m->xz_margin);
+		for (int i = 0; i < n_batch; i++) {
+			if (new_segments_conflict(committed, batch[i], old[i])) {
+				rip_up_new_segments(batch[i], old[i]);
+				routings_net_changed(rt, batch[i]);
+				pending[n_pending++] = batch[i];
+			} else {
+				mark_new_segments(committed, batch[i], old[i]);
+			}
+		}
+
+		free_usage_matrix(committed);
+		free_usage_matrix(m);
+	}
+
+	free(old);
+	free(batch);
+	free(pending);
+}
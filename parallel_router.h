@@ -0,0 +1,13 @@
+#ifndef __PARALLEL_ROUTER_H__
+#define __PARALLEL_ROUTER_H__
+
+#include "placer.h"
+#include "base_router.h"
+#include "congestion.h"
+#include "usage_matrix.h"
+
+int select_net_batch(struct routed_net **, int *, struct routed_net **);
+void route_net_batch(struct usage_matrix *, struct routed_net **, int, struct congestion_map *, int);
+void reroute_nets(struct cell_placements *, struct routings *, struct routed_net **, int, int, struct congestion_map *, int);
+
+#endif /* __PARALLEL_ROUTER_H__ */
@@ -0,0 +1,386 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global_router.h"
+#include "maze_router.h"
+#include "pattern_router.h"
+#include "usage_matrix.h"
+#include "util.h"
+
+/* PATTERN ROUTER
+
+   most connections can be made with a plain L or Z between a block of one
+   group and a block of another. before any search is started, each group is
+   paired with the nearest blocks of the other groups, and for each pair a
+   fixed set of shapes is laid out: both L's, up to PATTERN_Z_SPLITS Z's
+   each way, and each of these again with its legs along z raised onto the
+   cross layer, where that is their preferred direction. every step of a
+   shape is checked with the rules mri_visit applies, and the cheapest legal
+   shape (costed as the maze would cost it) is joined as a segment. groups
+   that no shape could join are left to the line probes or the maze.
+
+   as with the line probes, the net's own segments are taken out of the
+   usage matrix first, and a shape may not pass through a block of the net. */
+
+// pairs of blocks tried for each group, nearest first
+#define PATTERN_PAIRS 8
+
+// Z shapes tried each way, their middle legs spread evenly between the ends
+#define PATTERN_Z_SPLITS 3
+
+// the layer legs along z are raised to
+#define PATTERN_CROSS_LAYER 3
+
+struct pattern_leg {
+	enum movement mv;
+	int len;
+	int y;
+};
+
+struct pattern_pair {
+	int dist;
+	struct coordinate a, b;
+};
+
+struct pattern_search {
+	struct maze_route_instance *mri;
+	struct routing_group *rg;
+
+	// backtraces of the shape being checked, from BT_START at its first block
+	unsigned char *bt;
+
+	// the cheapest legal shape so far
+	unsigned int best_cost;
+	struct coordinate best_a, best_b;
+	int best_n;
+	enum movement *best;
+
+	// room for the steps of any shape between the pair being tried
+	int size;
+	enum movement *steps;
+};
+
+// turn legs into single steps, adding the vias between layers: at the
+// corner when the leg before ends with two steps straight, otherwise two
+// steps into the leg; the via back to to_y is two steps before the end, so
+// that it does not land beside the block reached. returns the number of
+// steps, or -1 if the layers cannot be changed this way
+static int lay_shape(struct pattern_leg *legs, int n_legs, int y, int to_y, enum movement *steps)
+{
+	int n = 0;
+
+	for (int i = 0; i < n_legs; i++) {
+		int len = legs[i].len;
+		if (legs[i].y != y) {
+			if (abs(legs[i].y - y) != 3)
+				return -1;
+
+			enum movement via = legs[i].y > y ? GO_UP : GO_DOWN;
+			if (i > 0 && legs[i-1].len >= 2) {
+				steps[n++] = via;
+			} else {
+				if (len < 3)
+					return -1;
+				steps[n++] = legs[i].mv;
+				steps[n++] = legs[i].mv;
+				steps[n++] = via;
+				len -= 2;
+			}
+			y = legs[i].y;
+		}
+
+		for (int k = 0; k < len; k++)
+			steps[n++] = legs[i].mv;
+	}
+
+	if (y != to_y) {
+		if (abs(to_y - y) != 3 || n < 2 || steps[n-1] != steps[n-2])
+			return -1;
+
+		enum movement last = steps[n-1];
+		steps[n-2] = to_y > y ? GO_UP : GO_DOWN;
+		steps[n-1] = last;
+		steps[n++] = last;
+	}
+
+	return n;
+}
+
+// clear the labels of a shape from a
+static void unlabel_shape(struct pattern_search *ps, struct coordinate a, enum movement *steps, int n)
+{
+	struct usage_matrix *m = ps->mri->m;
+
+	ps->bt[usage_idx(m, a)] = BT_NONE;
+	for (int i = 0; i < n - 1; i++) {
+		a = disp_movement(a, steps[i]);
+		if (!in_usage_bounds(m, a))
+			return;
+		ps->bt[usage_idx(m, a)] = BT_NONE;
+	}
+}
+
+// walk the shape from a to b, labelling its blocks; returns its cost, or
+// UINT_MAX if some step would be a violation. on return *c is the last
+// block labelled, which is beside b if the shape is legal
+static unsigned int check_shape(struct pattern_search *ps, struct coordinate a, struct coordinate b, enum movement *steps, int n, struct coordinate *c)
+{
+	struct maze_route_instance *mri = ps->mri;
+	struct usage_matrix *m = mri->m;
+	unsigned int cost = 0;
+
+	*c = a;
+	ps->bt[usage_idx(m, a)] = BT_START;
+	for (int s = 0; s < n; s++) {
+		enum movement mv = steps[s];
+		enum backtrace bt = movement_to_backtrace(mv);
+		struct coordinate cc = disp_movement(*c, mv);
+
+		if (!in_usage_bounds(m, cc))
+			return UINT_MAX;
+
+		if (mri->corridor && !corridor_contains(mri->corridor, cc))
+			return UINT_MAX;
+
+		int ii = usage_idx(m, cc);
+		int last = s == n - 1;
+
+		// a shape may not pass a block of the net, nor cross itself, nor
+		// come too close to other nets or cells on the way, nor join the
+		// other group where it does (the maze keeps such a join only if
+		// nothing better turns up)
+		if (!last && (mri->group[ii] || ps->bt[ii] != BT_NONE))
+			return UINT_MAX;
+		if (usage_matrix_violated(m, cc))
+			return UINT_MAX;
+
+		if (mri_via_violated(mri, NULL, ps->bt, *c, mv))
+			return UINT_MAX;
+
+		enum backtrace my_bt = ps->bt[usage_idx(m, *c)];
+		cost += mri_movement_cost(mri, my_bt, *c, mv);
+		if (mri->cm)
+			cost += congestion_history(mri->cm, cc);
+
+		if (last) {
+			assert(coordinate_equal(cc, b));
+			break;
+		}
+
+		ps->bt[ii] = bt;
+		*c = cc;
+	}
+
+	return cost;
+}
+
+// lay out legs between a and b, on their own layers or raised, keeping the
+// cheapest legal shape
+static void try_shape(struct pattern_search *ps, struct coordinate a, struct coordinate b, struct pattern_leg *legs, int n_legs)
+{
+	// flat, then with the legs along z on the cross layer
+	for (int raised = 0; raised < 2; raised++) {
+		int xy = a.y != PATTERN_CROSS_LAYER ? a.y : b.y != PATTERN_CROSS_LAYER ? b.y : 0;
+		int changed = 0;
+		for (int i = 0; i < n_legs; i++) {
+			int y = raised && (legs[i].mv & (GO_NORTH | GO_SOUTH)) ? PATTERN_CROSS_LAYER : raised ? xy : a.y;
+			changed |= y != a.y;
+			legs[i].y = y;
+		}
+
+		if (raised && !changed)
+			continue;
+
+		int n = lay_shape(legs, n_legs, a.y, b.y, ps->steps);
+		if (n <= 0)
+			continue;
+
+		struct coordinate c;
+		unsigned int cost = check_shape(ps, a, b, ps->steps, n, &c);
+		unlabel_shape(ps, a, ps->steps, n);
+
+		if (cost < ps->best_cost) {
+			ps->best_cost = cost;
+			ps->best_a = a;
+			ps->best_b = b;
+			ps->best_n = n;
+			memcpy(ps->best, ps->steps, n * sizeof(enum movement));
+		}
+	}
+}
+
+// try every shape between a and b
+static void try_pair(struct pattern_search *ps, struct coordinate a, struct coordinate b)
+{
+	int dx = b.x - a.x, dz = b.z - a.z;
+	int adx = abs(dx), adz = abs(dz);
+	enum movement mx = dx > 0 ? GO_EAST : GO_WEST, mz = dz > 0 ? GO_SOUTH : GO_NORTH;
+
+	if (adx + adz == 0)
+		return;
+
+	int need = adx + adz + 8;
+	if (need > ps->size) {
+		ps->size = need;
+		ps->steps = realloc(ps->steps, need * sizeof(enum movement));
+		ps->best = realloc(ps->best, need * sizeof(enum movement));
+	}
+
+	if (adx == 0 || adz == 0) {
+		struct pattern_leg straight[] = {{adx ? mx : mz, adx + adz, 0}};
+		try_shape(ps, a, b, straight, 1);
+		return;
+	}
+
+	struct pattern_leg xz[] = {{mx, adx, 0}, {mz, adz, 0}};
+	struct pattern_leg zx[] = {{mz, adz, 0}, {mx, adx, 0}};
+	try_shape(ps, a, b, xz, 2);
+	try_shape(ps, a, b, zx, 2);
+
+	for (int j = 1, k0 = 0, k1 = 0; j <= PATTERN_Z_SPLITS; j++) {
+		int k = adx * j / (PATTERN_Z_SPLITS + 1);
+		if (k > k0 && k < adx) {
+			struct pattern_leg zig[] = {{mx, k, 0}, {mz, adz, 0}, {mx, adx - k, 0}};
+			try_shape(ps, a, b, zig, 3);
+			k0 = k;
+		}
+
+		k = adz * j / (PATTERN_Z_SPLITS + 1);
+		if (k > k1 && k < adz) {
+			struct pattern_leg zag[] = {{mz, k, 0}, {mx, adx, 0}, {mz, adz - k, 0}};
+			try_shape(ps, a, b, zag, 3);
+			k1 = k;
+		}
+	}
+}
+
+// the PATTERN_PAIRS nearest pairs of a block rg starts from and one another
+// group starts from, nearest first; returns how many there are
+static int nearest_pairs(struct maze_route_instance *mri, struct routing_group *rg, struct pattern_pair *pairs)
+{
+	struct usage_matrix *m = mri->m;
+	int n_own = 0, n_other = 0, size = 64;
+	struct coordinate *own = malloc(size * sizeof(struct coordinate));
+	struct coordinate *other = malloc(size * sizeof(struct coordinate));
+
+	for (int y = 0; y < m->d.y; y++) {
+		for (int z = 0; z < m->d.z; z++) {
+			for (int x = 0; x < m->d.x; x++) {
+				struct coordinate c = coordinate_add(m->origin, (struct coordinate){y, z, x});
+				int i = usage_idx(m, c);
+				struct routing_group *owner = mri_group_at(mri, i);
+				if (!owner || owner->parent != owner || mri->bt[i] != BT_START)
+					continue;
+
+				if (max(n_own, n_other) >= size) {
+					size *= 2;
+					own = realloc(own, size * sizeof(struct coordinate));
+					other = realloc(other, size * sizeof(struct coordinate));
+				}
+
+				if (owner == rg)
+					own[n_own++] = c;
+				else
+					other[n_other++] = c;
+			}
+		}
+	}
+
+	int n_pairs = 0;
+	for (int i = 0; i < n_own; i++) {
+		for (int j = 0; j < n_other; j++) {
+			struct coordinate d = coordinate_sub(other[j], own[i]);
+			struct pattern_pair p = {abs(d.x) + abs(d.y) + abs(d.z), own[i], other[j]};
+			if (n_pairs == PATTERN_PAIRS && p.dist >= pairs[n_pairs-1].dist)
+				continue;
+
+			// insert in order, dropping the farthest if full
+			int k = n_pairs < PATTERN_PAIRS ? n_pairs++ : n_pairs - 1;
+			for (; k > 0 && pairs[k-1].dist > p.dist; k--)
+				pairs[k] = pairs[k-1];
+			pairs[k] = p;
+		}
+	}
+
+	free(own);
+	free(other);
+
+	return n_pairs;
+}
+
+// join rg to another group with the cheapest legal shape between the
+// nearest pairs of their blocks; returns 0 if there is none
+static int pattern_join(struct pattern_search *ps, struct routing_group *rg)
+{
+	struct maze_route_instance *mri = ps->mri;
+	struct pattern_pair pairs[PATTERN_PAIRS];
+	int n_pairs = nearest_pairs(mri, rg, pairs);
+
+	ps->rg = rg;
+	ps->best_cost = UINT_MAX;
+	for (int i = 0; i < n_pairs; i++)
+		try_pair(ps, pairs[i].a, pairs[i].b);
+
+	if (ps->best_cost == UINT_MAX)
+		return 0;
+
+	struct coordinate c;
+	check_shape(ps, ps->best_a, ps->best_b, ps->best, ps->best_n, &c);
+	struct routing_group *visited_rg = mri_group_at(mri, usage_idx(mri->m, ps->best_b));
+	mri_merge(mri, rg, ps->bt, c, visited_rg, ps->best_b);
+	unlabel_shape(ps, ps->best_a, ps->best, ps->best_n);
+
+	return 1;
+}
+
+// join as many groups of rn within window w (which is modified) as simple
+// shapes allow, keeping the segments made; returns 1 if every group was
+// joined
+int pattern_route_window(struct usage_matrix *w, struct routed_net *rn, struct congestion_map *cm, struct corridor *corridor, struct maze_route_stats *stats)
+{
+	usage_unmark_net(w, rn);
+	struct maze_route_instance mri = create_maze_route_instance(w, rn, cm);
+	mri.corridor = corridor;
+
+	struct pattern_search ps = {&mri, NULL, calloc(USAGE_SIZE(w), sizeof(unsigned char)), UINT_MAX, {0, 0, 0}, {0, 0, 0}, 0, NULL, 0, NULL};
+
+	// groups no shape could join; groups made by joining come after them
+	int n_stuck = 0;
+	unsigned char *stuck = NULL;
+
+	int joined = 1;
+	while (joined && mri.remaining_groups > 1) {
+		joined = 0;
+		for (int i = 0; i < mri.n_groups && !joined; i++) {
+			struct routing_group *rg = mri.rgs[i];
+			if (rg->parent != rg || (i < n_stuck && stuck[i]))
+				continue;
+
+			joined = pattern_join(&ps, rg);
+			if (joined) {
+				stats->pattern_joins++;
+			} else {
+				if (i >= n_stuck) {
+					stuck = realloc(stuck, mri.n_groups * sizeof(unsigned char));
+					memset(&stuck[n_stuck], 0, mri.n_groups - n_stuck);
+					n_stuck = mri.n_groups;
+				}
+				stuck[i] = 1;
+			}
+		}
+	}
+
+	int routed = mri.remaining_groups == 1;
+	stats->pattern_left += mri.remaining_groups - 1;
+	stats->merges += mri.stats.merges;
+
+	free(stuck);
+	free(ps.bt);
+	free(ps.steps);
+	free(ps.best);
+	free_mri(mri);
+
+	return routed;
+}
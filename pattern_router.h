@@ -0,0 +1,10 @@
+#ifndef __PATTERN_ROUTER_H__
+#define __PATTERN_ROUTER_H__
+
+#include "base_router.h"
+#include "maze_router.h"
+#include "usage_matrix.h"
+
+int pattern_route_window(struct usage_matrix *, struct routed_net *, struct congestion_map *, struct corridor *, struct maze_route_stats *);
+
+#endif /* __PATTERN_ROUTER_H__ */
@@ -62,29 +62,24 @@ static void recenter_unconstrained_placements(struct cell_placements *cp, struct
 
 		p->placement = coordinate_sub(p->placement, disp);
 	}
+
+	// move the extents of every cell along, then put back those kept left
+	extent_shift(&cp->cells, coordinate_neg(disp));
+	extent_shift(&cp->unconstrained, coordinate_neg(disp));
+	for (i = 0; i < cp->n_placements; i++)
+		if (cp->placements[i].constraints & CONSTR_KEEP_LEFT)
+			placement_moved(cp, i);
 }
 
+/* like compute_placement_dimensions, but ignoring the width of cells kept
+   right */
 static struct dimensions compute_unconstrained_placement_dimensions(struct cell_placements *cp)
 {
-	int i;
-	struct dimensions d = {0, 0, 0};
+	struct dimensions d = compute_placement_dimensions(cp);
 
-	for (i = 0; i < cp->n_placements; i++) {
-		struct placement p = cp->placements[i];
-
-		struct coordinate c = p.placement;
-		struct dimensions pd = p.cell->dimensions[p.turns];
-
-		int cell_x = c.x + pd.x + 1;
-		int cell_y = c.y + pd.y + 1;
-		int cell_z  = c.z + pd.z + 1;
-
-		if (!(p.constraints & CONSTR_KEEP_RIGHT))
-			d.x = max(cell_x, d.x);
-
-		d.y = max(cell_y, d.y);
-		d.z = max(cell_z, d.z);
-	}
+	d.x = 0;
+	if (!extent_empty(&cp->unconstrained))
+		d.x = max(extent_br(&cp->unconstrained).x + 1, 0);
 
 	return d;
 }
@@ -96,9 +91,11 @@ void placements_reconstrain(struct cell_placements *cp)
 		struct placement *p = &(cp->placements[i]);
 		if (p->constraints & CONSTR_KEEP_LEFT) {
 			p->placement.x = 0;
+			placement_moved(cp, i);
 		} else if (p->constraints & CONSTR_KEEP_RIGHT) {
 			int len = p->cell->dimensions[p->turns].x;
 			p->placement.x = d.x + len + EDGE_MARGIN;
+			placement_moved(cp, i);
 		}
 	}
 }
@@ -195,6 +192,8 @@ static enum placement_method generate(struct cell_placements *placements,
 			struct coordinate tmp = cell_a->placement;
 			cell_a->placement = cell_b->placement;
 			cell_b->placement = tmp;
+			placement_moved(placements, cell_a_idx);
+			placement_moved(placements, cell_b_idx);
 
 			// printf("[placer] interchange %d (%d, %d, %d) with %d (%d, %d, %d)\n",
 			//	cell_a_idx, cell_a->placement.y, cell_a->placement.z, cell_a->placement.x,
@@ -215,6 +214,7 @@ static enum placement_method generate(struct cell_placements *placements,
 		// int dx = random() % (window_width * 2) - window_width;
 		// printf("[placer] displace %d by dz = %d, dx = %d\n", cell_a_idx, dz, dx);
 		cell_a->placement.z += dz;
+		placement_moved(placements, cell_a_idx);
 		// printf("[generate] suggest displacement dz=%d, dx=%d\n", dz, dx);
 
 		if (cell_a->constraints & CONSTR_KEEP_LEFT) {
@@ -226,6 +226,7 @@ static enum placement_method generate(struct cell_placements *placements,
 		} else {
 			cell_a->placement.x += dx;
 		}
+		placement_moved(placements, cell_a_idx);
 
 		return PLACER_METHOD_DISPLACE;
 	} else {
@@ -233,6 +234,7 @@ static enum placement_method generate(struct cell_placements *placements,
 		// printf("[placer] rotate\n");
 		if (!(cell_a->constraints & CONSTR_NO_ROTATE)) {
 			cell_a->turns = (cell_a->turns + 1) % 4;
+			placement_moved(placements, cell_a_idx);
 			return PLACER_METHOD_REORIENT;
 		}
 		return PLACER_METHOD_NONE;
@@ -262,6 +264,9 @@ struct cell_placements *copy_placements(struct cell_placements *old_placements)
 		memcpy(p->nets, old_placements->placements[i].nets, sizeof(net_t) * p->cell->n_pins);
 	}
 
+	extent_tracker_copy(&new_placements->cells, &old_placements->cells);
+	extent_tracker_copy(&new_placements->unconstrained, &old_placements->unconstrained);
+
 	return new_placements;
 }
 
@@ -271,10 +276,37 @@ void placements_displace(struct cell_placements *cp, struct coordinate disp)
 	for (int i = 0; i < cp->n_placements; i++) {
 		cp->placements[i].placement = coordinate_add(cp->placements[i].placement, disp);
 	}
+
+	extent_shift(&cp->cells, disp);
+	extent_shift(&cp->unconstrained, disp);
+}
+
+// bring the extents of placement i up to date after it has been moved or
+// turned
+void placement_moved(struct cell_placements *cp, int i)
+{
+	struct placement *p = &cp->placements[i];
+	struct dimensions pd = p->cell->dimensions[p->turns];
+	struct coordinate br = coordinate_add(p->placement, (struct coordinate){pd.y, pd.z, pd.x});
+
+	extent_set(&cp->cells, i, p->placement, br);
+	if (!(p->constraints & CONSTR_KEEP_RIGHT))
+		extent_set(&cp->unconstrained, i, p->placement, br);
+}
+
+// start keeping the extents of every placement
+void placements_track_extents(struct cell_placements *cp)
+{
+	extent_tracker_init(&cp->cells, cp->n_placements);
+	extent_tracker_init(&cp->unconstrained, cp->n_placements);
+	for (int i = 0; i < cp->n_placements; i++)
+		placement_moved(cp, i);
 }
 
 void free_cell_placements(struct cell_placements *placements)
 {
+	extent_tracker_free(&placements->cells);
+	extent_tracker_free(&placements->unconstrained);
 	free(placements->placements);
 	free(placements);
 }
@@ -282,23 +314,15 @@ void free_cell_placements(struct cell_placements *placements)
 /* based on the current placements, how large is the design? */
 struct dimensions compute_placement_dimensions(struct cell_placements *cp)
 {
-	int i;
 	struct dimensions d = {0, 0, 0};
+	if (extent_empty(&cp->cells))
+		return d;
 
-	for (i = 0; i < cp->n_placements; i++) {
-		struct placement p = cp->placements[i];
-
-		struct coordinate c = p.placement;
-		struct dimensions pd = p.cell->dimensions[p.turns];
-
-		int cell_x = c.x + pd.x + 1;
-		int cell_y = c.y + pd.y + 1;
-		int cell_z  = c.z + pd.z + 1;
-
-		d.x = max(cell_x, d.x);
-		d.y = max(cell_y, d.y);
-		d.z = max(cell_z, d.z);
-	}
+	/* one past the bottom-right most point */
+	struct coordinate br = extent_br(&cp->cells);
+	d.y = max(br.y + 1, 0);
+	d.z = max(br.z + 1, 0);
+	d.x = max(br.x + 1, 0);
 
 	return d;
 }
@@ -1016,6 +1040,8 @@ struct cell_placements *placer_initial_place(struct blif *blif, struct cell_libr
 
 	assert(n_normal_placed == n_normal);
 
+	placements_track_extents(cp);
+
 	return cp;
 }
 
@@ -3,6 +3,7 @@
 
 #include "blif.h"
 #include "cell.h"
+#include "extent.h"
 
 #define CONSTR_NONE       0
 #define CONSTR_NO_ROTATE  (1L << 0)
@@ -36,6 +37,11 @@ struct cell_placements {
 	unsigned long n_placements;
 
 	int n_nets;
+
+	// extents of the cells, and of those not kept right, following every
+	// move made through placement_moved
+	struct extent_tracker cells;
+	struct extent_tracker unconstrained;
 };
 
 struct net_pin_map {
@@ -53,6 +59,8 @@ struct cell_placements *simulated_annealing_placement(struct cell_placements *,
 struct cell_placements *copy_placements(struct cell_placements *);
 void placements_displace(struct cell_placements *, struct coordinate disp);
 void placements_reconstrain(struct cell_placements *);
+void placements_track_extents(struct cell_placements *);
+void placement_moved(struct cell_placements *, int);
 void free_cell_placements(struct cell_placements *);
 
 struct cell_placements *placer_initial_place(struct blif *, struct cell_library *);
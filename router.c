@@ -2,8 +2,14 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
 
 #include "segment.h"
+#include "congestion.h"
+#include "parallel_router.h"
+#include "global_router.h"
 #include "placer.h"
 #include "router.h"
 #include "heap.h"
@@ -12,6 +18,9 @@
 #include "dumb_router.h"
 #include "util.h"
 #include "extract.h"
+#include "logger.h"
+#include "eco.h"
+#include "usage_matrix.h"
 
 static struct coordinate check_offsets[] = {
 	{0, 0, 0}, // here
@@ -35,15 +44,92 @@ static void router_sigint_handler(int a)
 	interrupt_routing = 1;
 }
 
+/* LIMITS
+
+   a run may be given a time limit (which also bounds optimization) and a
+   limit on the iterations of the routing stage. when routing stops at
+   either with violations left, the best routings seen so far are put back,
+   so there is still something to show for the run. */
+
+static time_t route_start;
+static int route_time_limit;      // seconds; 0 for no limit
+static int route_iteration_limit; // 0 for no limit
+
+// the limit that stopped routing, or NULL if none has
+static const char *route_limit_reached;
+
+// whether nets are reconnected around the segments ripped out of them
+// before being rerouted anywhere else
+static int route_local_repair;
+
+static int route_time_expired(void)
+{
+	if (route_time_limit > 0 && difftime(time(NULL), route_start) >= route_time_limit)
+		route_limit_reached = "time";
+
+	return route_limit_reached != NULL;
+}
+
+static int route_iterations_exhausted(int iterations)
+{
+	if (route_iteration_limit > 0 && iterations >= route_iteration_limit)
+		route_limit_reached = "iteration";
+
+	return route_time_expired();
+}
+
+/* EFFORT
+
+   the search effort (see struct maze_route_stats) spent in each iteration
+   of routing and optimization is kept, along with the score and violations
+   the iteration reported, so that it can be written out next to the
+   routings by report_routing_effort. */
+
+struct route_iteration {
+	const char *stage; // "rip-up", "negotiated" or "optimize"
+	int iteration;
+	int score, violations;
+	unsigned long usec; // wall time taken by the iteration
+	struct maze_route_stats effort;
+};
+
+static struct route_iteration *route_iterations;
+static int n_route_iterations;
+
+// the totals and time when the current iteration began
+static struct maze_route_stats iteration_stats;
+static unsigned long iteration_start;
+
+static void begin_route_iteration(void)
+{
+	iteration_stats = maze_router_stats();
+	iteration_start = wall_usec();
+}
+
+static void end_route_iteration(const char *stage, int iteration, int score, int violations)
+{
+	route_iterations = realloc(route_iterations, (n_route_iterations + 1) * sizeof(struct route_iteration));
+	struct route_iteration *ri = &route_iterations[n_route_iterations++];
+	ri->stage = stage;
+	ri->iteration = iteration;
+	ri->score = score;
+	ri->violations = violations;
+	ri->usec = wall_usec() - iteration_start;
+	ri->effort = maze_router_stats_since(&iteration_stats);
+}
+
 void print_routed_segment(struct routed_segment *rseg)
 {
 	assert(rseg->n_backtraces >= 0);
 	struct coordinate c = rseg->seg.end;
 	printf("(%d, %d, %d) ", c.y, c.z, c.x);
 
-	for (int i = 0; i < rseg->n_backtraces; i++) {
-		c = disp_backtrace(c, rseg->bt[i]);
-		printf("(%d, %d, %d) ", c.y, c.z, c.x);
+	for (int i = 0; i < rseg->n_runs; i++) {
+		struct coordinate step = backtrace_step(rseg->runs[i].bt);
+		for (int j = 0; j < rseg->runs[i].len; j++) {
+			c = coordinate_add(c, step);
+			printf("(%d, %d, %d) ", c.y, c.z, c.x);
+		}
 	}
 
 	printf("\n");
@@ -67,6 +153,13 @@ void print_routings(struct routings *rt)
 
 void free_routings(struct routings *rt)
 {
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
+		free_corridor(rt->routed_nets[i].corridor);
+		free_steiner_tree(rt->routed_nets[i].steiner);
+		net_pool_release(&rt->routed_nets[i].pool);
+	}
+	extent_tracker_free(&rt->extents);
+	free_routing_usage(rt->usage);
 	free(rt->routed_nets);
 	free(rt);
 }
@@ -79,6 +172,7 @@ struct routings *copy_routings(struct routings *old_rt)
 	new_rt->n_routed_nets = old_rt->n_routed_nets;
 	new_rt->routed_nets = malloc((new_rt->n_routed_nets + 1) * sizeof(struct routed_net));
 	new_rt->npm = old_rt->npm;
+	new_rt->usage = NULL;
 
 	/* for each routed_net in routings */
 	for (net_t i = 1; i < new_rt->n_routed_nets + 1; i++) {
@@ -125,19 +219,33 @@ struct routings *copy_routings(struct routings *old_rt)
 
 void routings_displace(struct routings *rt, struct coordinate disp)
 {
+	extent_shift(&rt->extents, disp);
+
+	// the usage matrix is laid where the design stood
+	free_routing_usage(rt->usage);
+	rt->usage = NULL;
+
 	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
 		struct routed_net *rn = &(rt->routed_nets[i]);
 
 		// move start/end segments
-		for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next) {
-			struct routed_segment *rseg = &rsh->rseg;
-			rseg->seg.start = coordinate_add(rseg->seg.start, disp);
-			rseg->seg.end = coordinate_add(rseg->seg.end, disp);
-		}
+		for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next)
+			path_displace(&rsh->rseg, disp);
 
 		for (int j = 0; j < rn->n_pins; j++)
 			rn->pins[j].coordinate = coordinate_add(rn->pins[j].coordinate, disp);
 
+		if (rn->corridor)
+			rn->corridor->origin = coordinate_add(rn->corridor->origin, disp);
+
+		if (rn->steiner)
+			steiner_tree_displace(rn->steiner, disp);
+
+		if (rn->repair) {
+			rn->repair_tl = coordinate_add(rn->repair_tl, disp);
+			rn->repair_br = coordinate_add(rn->repair_br, disp);
+		}
+
 		/* displace pins separately, as segments refer to them possibly more than once */
 		for (int j = 0; j < rt->npm->n_pins_for_net[i]; j++) {
 			struct placed_pin *p = &(rt->npm->pins[i][j]);
@@ -179,16 +287,23 @@ void routed_net_add_segment_node(struct routed_net *rn, struct routed_segment_he
 
 /* net scoring routines */
 
+// history cost added to an overused block after each negotiated-congestion iteration
+#define HISTORY_INCREMENT 2
+
 static int max_net_score = -1;
 static int min_net_score = -1;
 static int total_nets = 0;
 
-static int count_routings_violations(struct cell_placements *cp, struct routings *rt, FILE *log)
+// if cm is given, every block found in violation (and the block it collides
+// with) accrues history cost for negotiated-congestion routing; if
+// net_violations is given, it receives the number of blocks in violation on
+// each net
+static int count_routings_violations(struct cell_placements *cp, struct routings *rt, struct congestion_map *cm, int *net_violations)
 {
 	total_nets = 0;
 	max_net_score = min_net_score = -1;
 
-	/* ensure no coordinate is < 0 */
+	/* the matrix starts at the top-left most point of the design */
 	struct coordinate tlcp = placements_top_left_most_point(cp);
 	struct coordinate tlrt = routings_top_left_most_point(rt);
 	struct coordinate top_left_most = coordinate_piecewise_min(tlcp, tlrt);
@@ -197,9 +312,11 @@ static int count_routings_violations(struct cell_placements *cp, struct routings
 	printf("[count_routings_violations] tlrt x: %d, y: %d, z: %d\n", tlrt.x, tlrt.y, tlrt.z);
 	printf("[count_routings_violations] top_left_most x: %d, y: %d, z: %d\n", top_left_most.x, top_left_most.y, top_left_most.z);
 	*/
-	assert(top_left_most.x >= 0 && top_left_most.y >= 0 && top_left_most.z >= 0);
+	assert(top_left_most.y >= 0);
 
-	struct dimensions d = dimensions_piecewise_max(compute_placement_dimensions(cp), compute_routings_dimensions(rt));
+	struct coordinate o = {0, top_left_most.z, top_left_most.x};
+	struct coordinate end = design_end_point(cp, rt);
+	struct dimensions d = {end.y, end.z - o.z, end.x - o.x};
 
 	int usage_size = d.y * d.z * d.x;
 	unsigned char *matrix = malloc(usage_size * sizeof(unsigned char));
@@ -215,13 +332,13 @@ static int count_routings_violations(struct cell_placements *cp, struct routings
 		int cell_y = c.y + pd.y;
 		int cell_z = c.z + pd.z;
 
-		int z1 = max(0, c.z), z2 = min(d.z, cell_z);
-		int x1 = max(0, c.x), x2 = min(d.x, cell_x);
+		int z1 = max(o.z, c.z), z2 = min(o.z + d.z, cell_z);
+		int x1 = max(o.x, c.x), x2 = min(o.x + d.x, cell_x);
 
 		for (int y = c.y; y < cell_y; y++) {
 			for (int z = z1; z < z2; z++) {
 				for (int x = x1; x < x2; x++) {
-					int idx = y * d.z * d.x + z * d.x + x;
+					int idx = y * d.z * d.x + (z - o.z) * d.x + (x - o.x);
 
 					matrix[idx]++;
 				}
@@ -236,24 +353,34 @@ static int count_routings_violations(struct cell_placements *cp, struct routings
 		struct routed_net *rnet = &(rt->routed_nets[i]);
 		int score = 0;
 
+		if (net_violations)
+			net_violations[i] = 0;
+
 		for (struct routed_segment_head *rsh = rnet->routed_segments; rsh; rsh = rsh->next, total_nets++) {
 			int segment_violations = 0;
 
 			struct routed_segment *rseg = &rsh->rseg;
 			struct coordinate c = rseg->seg.end;
+			struct coordinate step = {0, 0, 0};
 
-			for (int k = 0; k < rseg->n_backtraces; k++) {
-				c = disp_backtrace(c, rseg->bt[k]);
+			for (int k = 0, r = 0, run_left = 0; k < rseg->n_backtraces; k++) {
+				if (!run_left) {
+					step = backtrace_step(rseg->runs[r].bt);
+					run_left = rseg->runs[r++].len;
+				}
+				c = coordinate_add(c, step);
+				run_left--;
 				// printf("[crv] c = (%d, %d, %d)\n", c.y, c.z, c.x);
-				assert(c.y >= 0 && c.z >= 0 && c.x >= 0 && c.y <= d.y && c.z <= d.z && c.x <= d.x);
+				assert(c.y >= 0 && c.z >= o.z && c.x >= o.x && c.y <= d.y && c.z - o.z <= d.z && c.x - o.x <= d.x);
 
 				int block_in_violation = 0;
 				for (int m = 0; m < sizeof(check_offsets) / sizeof(struct coordinate); m++) {
 					struct coordinate cc = coordinate_add(c, check_offsets[m]);
+					struct coordinate rc = coordinate_sub(cc, o);
 					// printf("[crv] cc = (%d, %d, %d)\n", cc.y, cc.z, cc.x);
 
 					// ignore if checking out of bounds
-					if (cc.y < 0 || cc.y >= d.y || cc.z < 0 || cc.z >= d.z || cc.x < 0 || cc.x >= d.x) {
+					if (rc.y < 0 || rc.y >= d.y || rc.z < 0 || rc.z >= d.z || rc.x < 0 || rc.x >= d.x) {
 						// printf("[crv] oob\n");
 						continue;
 					}
@@ -274,20 +401,25 @@ static int count_routings_violations(struct cell_placements *cp, struct routings
 							continue;
 					}
 
-					int idx = (cc.y * d.z * d.x) + (cc.z * d.x) + cc.x;
+					int idx = (rc.y * d.z * d.x) + (rc.z * d.x) + rc.x;
 
 					// do not mark or it will collide with itself
 					if (matrix[idx]) {
 						block_in_violation++;
+						if (cm) {
+							congestion_add_history(cm, c, HISTORY_INCREMENT);
+							congestion_add_history(cm, cc, HISTORY_INCREMENT);
+						}
 						// printf("[crv] violation\n");
-						fprintf(log, "[violation] by net %d, seg %p at (%d, %d, %d) with (%d, %d, %d)\n",
-						              i, (void *)rseg, c.y, c.z, c.x, cc.y, cc.z, cc.x);
+						LOG(LOG_VIOLATION_BLOCK, i, (void *)rseg, c.y, c.z, c.x, cc.y, cc.z, cc.x);
 					}
 				}
 
 				if (block_in_violation) {
 					segment_violations++;
 					total_violations++;
+					if (net_violations)
+						net_violations[i]++;
 				}
 			}
 
@@ -296,7 +428,7 @@ static int count_routings_violations(struct cell_placements *cp, struct routings
 			int segment_score = segment_violations * 1000 + rseg->n_backtraces;
 			rseg->score = segment_score;
 			score += segment_score;
-			fprintf(log, "[crv] net %d seg %p score = %d\n", i, (void *)rseg, segment_score);
+			LOG(LOG_CRV_SEGMENT, i, (void *)rseg, segment_score);
 		}
 
 		/* second loop actually marks segment in matrix */
@@ -304,15 +436,19 @@ static int count_routings_violations(struct cell_placements *cp, struct routings
 			struct routed_segment *rseg = &rsh->rseg;
 			struct coordinate c = rseg->seg.end;
 
-			for (int k = 0; k < rseg->n_backtraces; k++) {
-				c = disp_backtrace(c, rseg->bt[k]);
-				assert(c.y >= 0 && c.z >= 0 && c.x >= 0 && c.y <= d.y && c.z <= d.z && c.x <= d.x);
-				int idx = (c.y * d.z * d.x) + (c.z * d.x) + c.x;
-				matrix[idx]++;
-
-				if (c.y - 1 > 0) {
-					idx = (c.y - 1) * d.z * d.x + c.z * d.x + c.x;
+			// a run is a constant stride through the matrix
+			for (int r = 0; r < rseg->n_runs; r++) {
+				struct coordinate step = backtrace_step(rseg->runs[r].bt);
+				int stride = (step.y * d.z * d.x) + (step.z * d.x) + step.x;
+				int idx = (c.y * d.z * d.x) + ((c.z - o.z) * d.x) + (c.x - o.x);
+				for (int k = 0; k < rseg->runs[r].len; k++) {
+					c = coordinate_add(c, step);
+					idx += stride;
+					assert(c.y >= 0 && c.z >= o.z && c.x >= o.x && c.y <= d.y && c.z - o.z <= d.z && c.x - o.x <= d.x);
 					matrix[idx]++;
+
+					if (c.y - 1 > 0)
+						matrix[idx - d.z * d.x]++;
 				}
 			}
 
@@ -358,9 +494,12 @@ void print_routing_congestion(struct routings *rt)
 	for (net_t i = 1; i < rt->n_routed_nets; i++) {
 		for (struct routed_segment_head *rsh = rt->routed_nets[i].routed_segments; rsh; rsh = rsh->next) {
 			struct coordinate c = rsh->rseg.seg.end;
-			for (int k = 0; k < rsh->rseg.n_backtraces; k++) {
-				c = disp_backtrace(c, rsh->rseg.bt[k]);
-				mark_routing_congestion(c, d, congestion, visited);
+			for (int r = 0; r < rsh->rseg.n_runs; r++) {
+				struct coordinate step = backtrace_step(rsh->rseg.runs[r].bt);
+				for (int k = 0; k < rsh->rseg.runs[r].len; k++) {
+					c = coordinate_add(c, step);
+					mark_routing_congestion(c, d, congestion, visited);
+				}
 			}
 
 			memset(visited, 0, sizeof(unsigned char) * d.x * d.z);
@@ -427,54 +566,52 @@ void rip_up_segment(struct routed_segment *rseg)
 {
 	struct routed_net *rn = rseg->net;
 
-	// find all references of this segment in rn->adjacencies
-	// and disconnect them
-	struct routed_segment_adjacency *rsa, *prsa;
-	for (prsa = rsa = rn->adjacencies; rsa; ) {
-		if (rsa->parent == rseg || (rsa->child_type == SEGMENT && rsa->child.rseg == rseg)) {
-			if (rsa == rn->adjacencies) {
-				rn->adjacencies = rsa->next;
-				free(rsa);
-				rsa = rn->adjacencies;
-			} else {
-				prsa->next = rsa->next;
-				free(rsa);
-				rsa = prsa->next;
-			}
-		} else {
-			prsa = rsa;
-			rsa = rsa->next;
-		}
-	}
+	remove_adjacencies(rn, rseg);
 
-	assert(rseg->bt);
-	free(rseg->bt);
-	rseg->bt = NULL;
+	net_pool_free_runs(&rn->pool, rseg->runs, rseg->n_runs);
+	rseg->runs = NULL;
+	rseg->n_runs = 0;
 	rseg->n_backtraces = 0;
 	struct segment zero = {{0, 0, 0}, {0, 0, 0}};
 	rseg->seg = zero;
+	path_compute_bounds(rseg);
 	rseg->score = 0;
 }
 
-void rip_up_rsh(struct routed_segment_head *next)
+// have the net of rseg, which is about to be ripped up, reconnected
+// around it first
+static void mark_for_repair(struct routed_segment *rseg)
 {
-	struct routed_segment_head *curr;
-	while (next) {
-		curr = next;
-		next = next->next;
-		rip_up_segment(&curr->rseg);
-		free(curr);
+	struct routed_net *rn = rseg->net;
+
+	if (rn->repair) {
+		rn->repair_tl = coordinate_piecewise_min(rn->repair_tl, rseg->tl);
+		rn->repair_br = coordinate_piecewise_max(rn->repair_br, rseg->br);
+	} else {
+		rn->repair_tl = rseg->tl;
+		rn->repair_br = rseg->br;
+		rn->repair = 1;
 	}
 }
 
-// rips up all rsas starting from here
-void rip_up_rsa(struct routed_segment_adjacency *next)
+// rip up the segments of rn added since its segment list started at old
+void rip_up_new_segments(struct routed_net *rn, struct routed_segment_head *old)
 {
-	struct routed_segment_adjacency *curr;
+	while (rn->routed_segments != old) {
+		struct routed_segment_head *rsh = remove_rsh(&rn->routed_segments->rseg);
+		rip_up_segment(&rsh->rseg);
+		net_pool_free_rsh(&rn->pool, rsh);
+	}
+}
+
+void rip_up_rsh(struct routed_segment_head *next)
+{
+	struct routed_segment_head *curr;
 	while (next) {
 		curr = next;
 		next = next->next;
-		free(curr);
+		rip_up_segment(&curr->rseg);
+		net_pool_free_rsh(&curr->rseg.net->pool, curr);
 	}
 }
 
@@ -487,7 +624,7 @@ int rseg_score_cmp(const void *a, const void *b)
 	return bb->score - aa->score;
 }
 
-static struct rip_up_set natural_selection(struct routings *rt, FILE *log)
+static struct rip_up_set natural_selection(struct routings *rt)
 {
 	int rip_up_count = 0;
 	int rip_up_size = 4;
@@ -497,11 +634,12 @@ static struct rip_up_set natural_selection(struct routings *rt, FILE *log)
 	int bias = score_range / 8;
 	int random_range = bias * 10;
 
-	fprintf(log, "[natural_selection] adjusted_score = score - %d (min net score) + %d (bias)\n", min_net_score, bias);
-	fprintf(log, "[natural_selection] net   seg                rip   rand(%5d)   adj. score\n", score_range);
-	fprintf(log, "[natural_selection] ---   ----------------   ---   -----------   ----------\n");
+	LOG(LOG_NATURAL_SELECTION_HEADER, min_net_score, bias, score_range);
 
 	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
+		if (rt->routed_nets[i].fixed)
+			continue;
+
 		for (struct routed_segment_head *rsh = rt->routed_nets[i].routed_segments; rsh; rsh = rsh->next) {
 			struct routed_segment *rseg = &rsh->rseg;
 			if (!segment_routed(rseg))
@@ -511,9 +649,7 @@ static struct rip_up_set natural_selection(struct routings *rt, FILE *log)
 			int adjusted_score = rseg->score - min_net_score + bias;
 
 			if (r < adjusted_score) {
-				if (log)
-					// fprintf(log, "[natural_selection] ripping up net %d (rand(%d) = %d < %d)\n", i, random_range, r, adjusted_score);
-					fprintf(log, "[natural_selection] %3d   %p    X         %5d   %5d\n", i, (void *)rseg, r, adjusted_score);
+				LOG(LOG_NATURAL_SELECTION_RIP, i, (void *)rseg, r, adjusted_score);
 #ifdef NATURAL_SELECTION_DEBUG
 				printf("[natural_selection] ripping up net %2d, segment %p (rand(%d) = %d < %d)\n", i, rseg, random_range, r, adjusted_score);
 #endif
@@ -527,9 +663,7 @@ static struct rip_up_set natural_selection(struct routings *rt, FILE *log)
 #ifdef NATURAL_SELECTION_DEBUG
 				printf("[natural_selection] leaving intact net %2d, segment %p (rand(%d) = %d >= %d)\n", i, rseg, random_range, r, adjusted_score);
 #endif
-				if (log)
-					fprintf(log, "[natural_selection] %3d   %p               %5d   %5d\n", i, (void *)rseg, r, adjusted_score);
-					// fprintf(log, "[natural_selection] leaving net %d intact (rand(%d) = %d >= %d)\n", i, random_range, r, adjusted_score);
+				LOG(LOG_NATURAL_SELECTION_KEEP, i, (void *)rseg, r, adjusted_score);
 			}
 		}
 	}
@@ -539,15 +673,19 @@ static struct rip_up_set natural_selection(struct routings *rt, FILE *log)
 	return rus;
 }
 
-static struct routings *initial_route(struct blif *blif, struct net_pin_map *npm)
+static struct routings *initial_route(struct blif *blif, struct net_pin_map *npm, enum net_router net_router)
 {
 	struct routings *rt = malloc(sizeof(struct routings));
 	rt->n_routed_nets = npm->n_nets;
 	rt->routed_nets = calloc(rt->n_routed_nets + 1, sizeof(struct routed_net));
 	rt->npm = npm;
+	rt->usage = NULL;
 
-	for (net_t i = 1; i < npm->n_nets + 1; i++)
+	for (net_t i = 1; i < npm->n_nets + 1; i++) {
 		dumb_route(&rt->routed_nets[i], blif, npm, i);
+		rt->routed_nets[i].router = net_router;
+	}
+	routings_track_extents(rt);
 
 	return rt;
 }
@@ -558,11 +696,8 @@ void assert_in_bounds(struct routed_net *rn)
 	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next) {
 		struct routed_segment *rseg = &rsh->rseg;
 		if (segment_routed(rseg)) {
-			struct coordinate c = rseg->seg.end;
-			for (int j = 0; j < rseg->n_backtraces; j++) {
-				c = disp_backtrace(c, rseg->bt[j]);
-				assert(c.y >= 0 && c.z >= 0 && c.x >= 0 && c.y < arbitrary_max && c.z < arbitrary_max && c.x < arbitrary_max);
-			}
+			struct coordinate tl = rseg->tl, br = rseg->br;
+			assert(tl.y >= 0 && tl.z > -arbitrary_max && tl.x > -arbitrary_max && br.y < arbitrary_max && br.z < arbitrary_max && br.x < arbitrary_max);
 		}
 	}
 }
@@ -584,12 +719,161 @@ int score_routings(struct routings *rt)
 	return total;
 }
 
+// one pass of optimize_routings over every net, in random order, rerouting
+// batches of nets concurrently; each new route is then judged on its own
+// against the routings as they stand, exactly as in the sequential pass
+static int optimize_routings_parallel(struct cell_placements *cp, struct routings *rt, int threads, int *score, int *violations)
+{
+	int n_nets = rt->n_routed_nets;
+	struct routed_net **pending = malloc(n_nets * sizeof(struct routed_net *));
+	struct routed_net **batch = malloc(n_nets * sizeof(struct routed_net *));
+	struct routed_segment_head **stashed_rsh = malloc(n_nets * sizeof(struct routed_segment_head *));
+	struct routed_segment_adjacency **stashed_rsa = malloc(n_nets * sizeof(struct routed_segment_adjacency *));
+
+	// shuffle the nets
+	for (int i = 0; i < n_nets; i++)
+		pending[i] = &rt->routed_nets[i + 1];
+	for (int i = n_nets - 1; i > 0; i--) {
+		int j = random() % (i + 1);
+		struct routed_net *t = pending[i];
+		pending[i] = pending[j];
+		pending[j] = t;
+	}
+	int n_pending = 0;
+	for (int i = 0; i < n_nets; i++)
+		if (!pending[i]->fixed)
+			pending[n_pending++] = pending[i];
+
+	int had_change = 0;
+	while (n_pending > 0 && !interrupt_routing && !route_time_expired()) {
+		int n_batch = select_net_batch(pending, &n_pending, batch);
+
+		// route the whole batch against the routings without it
+		for (int i = 0; i < n_batch; i++) {
+			stashed_rsh[i] = batch[i]->routed_segments;
+			stashed_rsa[i] = batch[i]->adjacencies;
+			batch[i]->routed_segments = NULL;
+			batch[i]->adjacencies = NULL;
+			routings_net_changed(rt, batch[i]);
+		}
+
+		struct usage_matrix *m = create_usage_matrix(cp, rt, 2);
+		route_net_batch(m, batch, n_batch, NULL, threads);
+		free_usage_matrix(m);
+
+		// put the old routes back, keeping the new ones aside
+		for (int i = 0; i < n_batch; i++) {
+			struct routed_segment_head *new_rsh = batch[i]->routed_segments;
+			struct routed_segment_adjacency *new_rsa = batch[i]->adjacencies;
+			batch[i]->routed_segments = stashed_rsh[i];
+			batch[i]->adjacencies = stashed_rsa[i];
+			stashed_rsh[i] = new_rsh;
+			stashed_rsa[i] = new_rsa;
+			routings_net_changed(rt, batch[i]);
+		}
+
+		// try each new route in turn
+		for (int i = 0; i < n_batch; i++) {
+			struct routed_net *rn = batch[i];
+			struct routed_segment_head *old_rsh = rn->routed_segments;
+			struct routed_segment_adjacency *old_rsa = rn->adjacencies;
+			rn->routed_segments = stashed_rsh[i];
+			rn->adjacencies = stashed_rsa[i];
+			routings_net_changed(rt, rn);
+			assert_in_bounds(rn);
+
+			int new_violations = count_routings_violations(cp, rt, NULL, NULL);
+			int new_score = score_routings(rt);
+
+			if (new_violations < *violations || (new_violations == *violations && new_score < *score)) {
+				rip_up_rsh(old_rsh);
+				*score = new_score;
+				*violations = new_violations;
+				had_change++;
+			} else {
+				rip_up_rsh(rn->routed_segments);
+				rn->routed_segments = old_rsh;
+				rn->adjacencies = old_rsa;
+				routings_net_changed(rt, rn);
+			}
+		}
+	}
+
+	free(stashed_rsa);
+	free(stashed_rsh);
+	free(batch);
+	free(pending);
+
+	return had_change;
+}
+
+static void rip_up_net(struct routings *, struct routed_net *);
+static void copy_net_routes(struct routed_net *, struct routed_net *);
+
+// the segments of rn found in violation when the routings were last counted
+static int segments_in_violation(struct routed_net *rn)
+{
+	// a segment scores 1000 for each of its blocks in violation
+	int n_segments = 0;
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next)
+		n_segments += rsh->rseg.score >= 1000;
+
+	return n_segments;
+}
+
+// rip up the segments of rn in violation and reconnect the net around
+// them, keeping the rest of its tree; the new routes are kept only if they
+// lower the violations or score, as when rerouting the whole net. returns
+// 1 if they were kept
+static int repair_net(struct cell_placements *cp, struct routings *rt, struct routed_net *rn, int *score, int *violations)
+{
+	struct routed_net old;
+	copy_net_routes(rn, &old);
+
+	struct routed_segment_head **prev = &rn->routed_segments;
+	while (*prev) {
+		struct routed_segment_head *rsh = *prev;
+		if (rsh->rseg.score < 1000) {
+			prev = &rsh->next;
+			continue;
+		}
+
+		mark_for_repair(&rsh->rseg);
+		*prev = rsh->next;
+		rsh->next = NULL;
+		rip_up_segment(&rsh->rseg);
+		net_pool_free_rsh(&rn->pool, rsh);
+	}
+	routings_net_changed(rt, rn);
+
+	maze_reroute(cp, rt, rn, 2, NULL);
+	assert_in_bounds(rn);
+	rn->repair = 0;
+
+	int new_violations = count_routings_violations(cp, rt, NULL, NULL);
+	int new_score = score_routings(rt);
+
+	if (new_violations < *violations || (new_violations == *violations && new_score < *score)) {
+		net_pool_release(&old.pool);
+		*score = new_score;
+		*violations = new_violations;
+		return 1;
+	}
+
+	rip_up_net(rt, rn);
+	rn->routed_segments = old.routed_segments;
+	rn->adjacencies = old.adjacencies;
+	rn->pool = old.pool;
+
+	return 0;
+}
+
 // perform all rounds of optimizations. it cannot introduce new violations
 // if we started with violations, make sure those go to zero (although
 // with this, it may or may not happen)
 // if we start with zero violations, make sure introducing new violations
 // are not permitted
-static void optimize_routings(struct cell_placements *cp, struct routings *rt, FILE *log)
+static void optimize_routings(struct cell_placements *cp, struct routings *rt, int threads)
 {
 	char *rerouted = calloc(rt->n_routed_nets + 1, sizeof(char));
 	int n_rerouted = 0;
@@ -599,8 +883,10 @@ static void optimize_routings(struct cell_placements *cp, struct routings *rt, F
 	signal(SIGINT, router_sigint_handler);
 	int old_score = score_routings(rt);
 	int had_change;
-	int violations = count_routings_violations(cp, rt, log);
+	int violations = count_routings_violations(cp, rt, NULL, NULL);
 	do {
+		begin_route_iteration();
+
 		had_change = 0;
 		// clear out rerouted
 		for (net_t i = 1; i < rt->n_routed_nets + 1; i++)
@@ -608,23 +894,42 @@ static void optimize_routings(struct cell_placements *cp, struct routings *rt, F
 
 		// try rerouting all nets, randomly
 		n_rerouted = 0;
-		while (n_rerouted < rt->n_routed_nets && !interrupt_routing) {
+		if (threads > 1) {
+			had_change = optimize_routings_parallel(cp, rt, threads, &old_score, &violations);
+			n_rerouted = rt->n_routed_nets;
+		}
+		while (n_rerouted < rt->n_routed_nets && !interrupt_routing && !route_time_expired()) {
 			net_t i = (random() % rt->n_routed_nets) + 1;
 			if (rerouted[i])
 				continue;
 
 			struct routed_net *rn = &rt->routed_nets[i];
+			if (rn->fixed) {
+				rerouted[i]++;
+				n_rerouted++;
+				continue;
+			}
+
+			// a net in violation is first repaired around the segments in
+			// violation, and only rerouted whole if that does not help
+			if (route_local_repair && segments_in_violation(rn) &&
+			    repair_net(cp, rt, rn, &old_score, &violations)) {
+				had_change++;
+				rerouted[i]++;
+				n_rerouted++;
+				continue;
+			}
 
-			recenter(cp, rt, 2);
 			struct routed_segment_head *old_rsh = rn->routed_segments;
 			struct routed_segment_adjacency *old_rsa = rn->adjacencies;
 			rn->routed_segments = NULL;
 			rn->adjacencies = NULL;
+			routings_net_changed(rt, rn);
 
-			maze_reroute(cp, rt, rn, 2);
+			maze_reroute(cp, rt, rn, 2, NULL);
 			assert_in_bounds(rn);
 
-			int new_violations = count_routings_violations(cp, rt, log);
+			int new_violations = count_routings_violations(cp, rt, NULL, NULL);
 			int new_score = score_routings(rt);
 
 			// if we had more than zero violations and we reduce the violation count, accept it no matter what;
@@ -639,6 +944,7 @@ static void optimize_routings(struct cell_placements *cp, struct routings *rt, F
 				rip_up_rsh(rn->routed_segments);
 				rn->routed_segments = old_rsh;
 				rn->adjacencies = old_rsa;
+				routings_net_changed(rt, rn);
 			}
 
 			// printf("[optimizing] net %d: %d violations (should be none)\n", i, violations);
@@ -650,13 +956,13 @@ static void optimize_routings(struct cell_placements *cp, struct routings *rt, F
 
 		printf("\r[optimize] Iterations: %4d, Score: %d, Changed nets: %d, Violations: %d",
 		       iterations + 1, old_score, had_change, violations);
-		fprintf(log, "\n[optimize] Iterations: %4d, Score: %d, Changed nets: %d, Violations: %d\n",
-		             iterations + 1, old_score, had_change, violations);
+		LOG(LOG_OPTIMIZE_ITERATION, iterations + 1, old_score, had_change, violations);
 		fflush(stdout);
-		fflush(log);
+		log_flush();
 
+		end_route_iteration("optimize", iterations + 1, old_score, violations);
 		iterations++;
-	} while ((violations > 0 || had_change) && !interrupt_routing);
+	} while ((violations > 0 || had_change) && !interrupt_routing && !route_time_expired());
 	signal(SIGINT, SIG_DFL);
 
 	free(rerouted);
@@ -675,110 +981,595 @@ void print_rsa(struct routed_net *rn)
 	}
 }
 
-/* main route subroutine */
-struct routings *route(struct blif *blif, struct cell_placements *cp)
+// rip up every segment and adjacency of a net, all of which are in its pool
+static void rip_up_net(struct routings *rt, struct routed_net *rn)
 {
-	struct pin_placements *pp = placer_place_pins(cp);
-	struct net_pin_map *npm = placer_create_net_pin_map(pp);
+	net_pool_release(&rn->pool);
+	rn->routed_segments = NULL;
+	rn->adjacencies = NULL;
+	routings_net_changed(rt, rn);
+}
 
-	struct routings *rt = initial_route(blif, npm);
-	// print_routings(rt);
-	recenter(cp, rt, 2);
+// the segments and adjacencies of every net at some point in routing
+struct routings_snapshot {
+	int violations;
+	int score;
+
+	// only the routed_segments, adjacencies and pool of each are used
+	struct routed_net *nets;
+};
+
+// copy the segments of rn, in order, and its adjacencies (pointing at the
+// copies instead of the originals) into the pool of copy
+static void copy_net_routes(struct routed_net *rn, struct routed_net *copy)
+{
+	int n_segments = 0;
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next)
+		n_segments++;
+
+	struct routed_segment **old = malloc(n_segments * sizeof(struct routed_segment *));
+	struct routed_segment **new = malloc(n_segments * sizeof(struct routed_segment *));
+
+	net_pool_init(&copy->pool);
+	copy->adjacencies = NULL;
+
+	struct routed_segment_head **tail = &copy->routed_segments;
+	int k = 0;
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next, k++) {
+		struct routed_segment_head *rsh_copy = net_pool_alloc_rsh(&copy->pool);
+		rsh_copy->rseg = rsh->rseg;
+		rsh_copy->rseg.up = rsh_copy->rseg.children = NULL;
+		rsh_copy->rseg.runs = net_pool_alloc_runs(&copy->pool, rsh->rseg.n_runs);
+		memcpy(rsh_copy->rseg.runs, rsh->rseg.runs, rsh->rseg.n_runs * sizeof(struct path_run));
+
+		old[k] = &rsh->rseg;
+		new[k] = &rsh_copy->rseg;
+		*tail = rsh_copy;
+		tail = &rsh_copy->next;
+	}
+	*tail = NULL;
+
+	for (struct routed_segment_adjacency *rsa = rn->adjacencies; rsa; rsa = rsa->next) {
+		struct routed_segment *parent = NULL, *child = NULL;
+		for (k = 0; k < n_segments; k++) {
+			if (rsa->parent == old[k])
+				parent = new[k];
+			if (rsa->child_type == SEGMENT && rsa->child.rseg == old[k])
+				child = new[k];
+		}
+
+		if (rsa->child_type == SEGMENT)
+			add_adjacent_segment(copy, parent, child, rsa->at);
+		else
+			add_adjacent_pin(copy, parent, rsa->child.pin);
+	}
+
+	free(new);
+	free(old);
+}
+
+static void free_routings_snapshot(struct routings_snapshot *snap, struct routings *rt)
+{
+	if (!snap->nets)
+		return;
+
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++)
+		net_pool_release(&snap->nets[i].pool);
+	free(snap->nets);
+	snap->nets = NULL;
+}
+
+// take a snapshot of rt if it has fewer violations than the one in snap
+// (or as many, but a lower score)
+static void keep_best_routings(struct routings_snapshot *snap, struct routings *rt, int violations, int score)
+{
+	if (snap->nets && (violations > snap->violations || (violations == snap->violations && score >= snap->score)))
+		return;
+
+	free_routings_snapshot(snap, rt);
 
+	snap->violations = violations;
+	snap->score = score;
+	snap->nets = malloc((rt->n_routed_nets + 1) * sizeof(struct routed_net));
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++)
+		copy_net_routes(&rt->routed_nets[i], &snap->nets[i]);
+}
+
+// replace the routings of every net with those in snap, which is emptied;
+// each net takes over the pool of its copy
+static void restore_routings(struct routings_snapshot *snap, struct routings *rt)
+{
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
+		struct routed_net *rn = &rt->routed_nets[i];
+		rip_up_net(rt, rn);
+
+		rn->routed_segments = snap->nets[i].routed_segments;
+		rn->adjacencies = snap->nets[i].adjacencies;
+		rn->pool = snap->nets[i].pool;
+	}
+
+	free(snap->nets);
+	snap->nets = NULL;
+}
+
+// when a limit has stopped routing with violations left, put back the best
+// routings seen if they are better than where routing stopped; returns the
+// number of violations left
+static int settle_on_best_routings(struct routings_snapshot *best, struct cell_placements *cp, struct routings *rt, int violations)
+{
+	if (violations > 0 && route_limit_reached && best->nets &&
+	    (best->violations < violations || (best->violations == violations && best->score < score_routings(rt)))) {
+		restore_routings(best, rt);
+		violations = count_routings_violations(cp, rt, NULL, NULL);
+	}
+
+	free_routings_snapshot(best, rt);
+
+	return violations;
+}
+
+// iterations of routing after which nets kept from a previous run (see
+// eco.c) give up their routes if they are still in violation
+#define FIXED_NET_PATIENCE 16
+
+// let the nets kept from a previous run that are in violation be rerouted,
+// once no other net in violation is left to move out of their way (or
+// moving them has not worked for long enough); returns how many were let go
+static int release_fixed_nets(struct routings *rt, int iterations)
+{
+	int others = 0;
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++)
+		others += !rt->routed_nets[i].fixed && segments_in_violation(&rt->routed_nets[i]);
+
+	if (others && iterations < FIXED_NET_PATIENCE)
+		return 0;
+
+	int released = 0;
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
+		struct routed_net *rn = &rt->routed_nets[i];
+		if (rn->fixed && segments_in_violation(rn)) {
+			rn->fixed = 0;
+			released++;
+		}
+	}
+
+	if (released)
+		printf("\n[router] Rerouting %d nets kept from the previous run\n", released);
+
+	return released;
+}
+
+// resolve violations by ripping up segments chosen by natural_selection()
+// and rerouting their nets, until there are no violations left (or a limit
+// is reached)
+static int natural_selection_route(struct cell_placements *cp, struct routings *rt, int threads)
+{
 	int iterations = 0;
 	int violations;
 	int routings_score = 0;
-
-	interrupt_routing = 0;
-	signal(SIGINT, router_sigint_handler);
-	FILE *log = fopen("router.log", "w");
-
-	violations = count_routings_violations(cp, rt, log);
+	struct routings_snapshot best = {0, 0, NULL};
 
 	printf("\n");
-	while ((violations = count_routings_violations(cp, rt, log)) > 0 && !interrupt_routing) {
+	while ((violations = count_routings_violations(cp, rt, NULL, NULL)) > 0 && !interrupt_routing) {
 		routings_score = score_routings(rt);
 
+		keep_best_routings(&best, rt, violations, routings_score);
+		if (route_iterations_exhausted(iterations))
+			break;
+
+		release_fixed_nets(rt, iterations);
+
+		begin_route_iteration();
+
 		// sort segments for rip-up by highest score
-		struct rip_up_set rus = natural_selection(rt, log);
+		struct rip_up_set rus = natural_selection(rt);
 		qsort(rus.rip_up, rus.n_ripped, sizeof(struct routed_segment *), rseg_score_cmp);
 		struct routed_net **nets_ripped = calloc(rus.n_ripped, sizeof(struct routed_net *));
 
 		printf("\r[router] Iterations: %4d, Score: %d, Violations: %d, Segments to re-route: %d",
 		       iterations + 1, routings_score, violations, rus.n_ripped);
-		fprintf(log, "\n[router] Iterations: %4d, Score: %d, Violations: %d, Segments to re-route: %d\n",
-		             iterations + 1, routings_score, violations, rus.n_ripped);
+		LOG(LOG_ROUTER_ITERATION, iterations + 1, routings_score, violations, rus.n_ripped);
 		fflush(stdout);
-		fflush(log);
 
 		// rip up all segments in rip-up set
 		for (int i = 0; i < rus.n_ripped; i++) {
-			fprintf(log, "[router] Ripping up net %d, segment %p (score %d)\n",
-			             rus.rip_up[i]->net->net, (void *)rus.rip_up[i], rus.rip_up[i]->score);
+			LOG(LOG_ROUTER_RIP_UP, rus.rip_up[i]->net->net, (void *)rus.rip_up[i], rus.rip_up[i]->score);
 			nets_ripped[i] = rus.rip_up[i]->net;
+			if (route_local_repair)
+				mark_for_repair(rus.rip_up[i]);
 
 			// remove segment from rt
 			struct routed_segment_head *rsh = remove_rsh(rus.rip_up[i]);
 			rip_up_segment(&rsh->rseg);
-			free(rsh);
+			net_pool_free_rsh(&rsh->rseg.net->pool, rsh);
+			routings_net_changed(rt, nets_ripped[i]);
 		}
 
-		// individually reroute all net instances that have had rip-ups occur
+		// reroute all net instances that have had rip-ups occur, once each
+		int n_to_reroute = 0;
 		for (int i = 0; i < rus.n_ripped; i++) {
 			struct routed_net *net_to_reroute = nets_ripped[i];
 			if (!net_to_reroute)
 				continue;
 
-			fprintf(log, "[router] Rerouting net %d\n", net_to_reroute->net);
-			fflush(log);
-
-			recenter(cp, rt, 2);
-			maze_reroute(cp, rt, net_to_reroute, 2);
+			LOG(LOG_ROUTER_REROUTE, net_to_reroute->net);
 
 			// prevent subsequent reroutings of this net
 			for (int j = i + 1; j < rus.n_ripped; j++)
 				if (nets_ripped[j] == net_to_reroute)
 					nets_ripped[j] = NULL;
 
-			// printf("[maze_reroute] Rerouted net %d\n", net_to_reroute->net);
-			// print_routed_net(net_to_reroute);
-			assert_in_bounds(net_to_reroute);
+			nets_ripped[n_to_reroute++] = net_to_reroute;
+		}
+		log_flush();
+
+		reroute_nets(cp, rt, nets_ripped, n_to_reroute, 2, NULL, threads);
+
+		// print_routed_net(net_to_reroute);
+		for (int i = 0; i < n_to_reroute; i++) {
+			assert_in_bounds(nets_ripped[i]);
+			nets_ripped[i]->repair = 0;
 		}
 		free(rus.rip_up);
+		free(nets_ripped);
 		rus.n_ripped = 0;
 
-		recenter(cp, rt, 2);
-
+		end_route_iteration("rip-up", iterations + 1, routings_score, violations);
 		iterations++;
 	}
 
+	violations = settle_on_best_routings(&best, cp, rt, violations);
+	if (violations > 0)
+		routings_score = score_routings(rt);
+
 	// print information about routing one last time
 	printf("\r[router] Iterations: %4d, Score: %d, Violations: %d\n",
 	       iterations + 1, routings_score, violations);
-	fprintf(log, "\n[router] Iterations: %4d, Score: %d, Violations: %d\n",
-		     iterations + 1, routings_score, violations);
+	LOG(LOG_ROUTER_FINAL, iterations + 1, routings_score, violations);
 	fflush(stdout);
-	fflush(log);
+	log_flush();
+
+	return violations;
+}
+
+// the present-congestion factor starts low, so that nets first route
+// nearly independently, and grows every iteration until sharing a block
+// costs more than any detour
+#define PRESENT_FACTOR_INITIAL 0.5
+#define PRESENT_FACTOR_GROWTH 1.5
+#define PRESENT_FACTOR_MAX 1000.0
+
+// negotiated-congestion (PathFinder) routing: every iteration, rip up and
+// reroute every net with costs that include the history of each block's
+// overuse and the present congestion, until no violations remain
+static int negotiated_congestion_route(struct cell_placements *cp, struct routings *rt, int threads)
+{
+	struct congestion_map *cm = create_congestion_map(PRESENT_FACTOR_INITIAL);
+
+	struct routed_net **pending = malloc(rt->n_routed_nets * sizeof(struct routed_net *));
+	struct routed_net **batch = malloc(rt->n_routed_nets * sizeof(struct routed_net *));
+
+	int iterations = 0;
+	int violations = count_routings_violations(cp, rt, cm, NULL);
+	struct routings_snapshot best = {0, 0, NULL};
+
+	printf("\n");
+	while (violations > 0 && !interrupt_routing) {
+		keep_best_routings(&best, rt, violations, score_routings(rt));
+		if (route_iterations_exhausted(iterations))
+			break;
+
+		release_fixed_nets(rt, iterations);
+
+		begin_route_iteration();
+
+		if (threads <= 1) {
+			for (net_t i = 1; i < rt->n_routed_nets + 1 && !interrupt_routing; i++) {
+				struct routed_net *rn = &rt->routed_nets[i];
+				if (rn->n_pins <= 1 || rn->fixed)
+					continue;
+
+				rip_up_net(rt, rn);
+
+				maze_reroute(cp, rt, rn, 2, cm);
+				assert_in_bounds(rn);
+			}
+		} else {
+			// reroute nets that are far apart from each other together;
+			// conflicts between them are left to the next iteration
+			int n_pending = 0;
+			for (net_t i = 1; i < rt->n_routed_nets + 1; i++)
+				if (rt->routed_nets[i].n_pins > 1 && !rt->routed_nets[i].fixed)
+					pending[n_pending++] = &rt->routed_nets[i];
+
+			while (n_pending > 0 && !interrupt_routing) {
+				int n_batch = select_net_batch(pending, &n_pending, batch);
+				for (int i = 0; i < n_batch; i++)
+					rip_up_net(rt, batch[i]);
+
+				struct usage_matrix *m = create_usage_matrix(cp, rt, 2);
+				route_net_batch(m, batch, n_batch, cm, threads);
+				free_usage_matrix(m);
+
+				for (int i = 0; i < n_batch; i++) {
+					routings_net_changed(rt, batch[i]);
+					assert_in_bounds(batch[i]);
+				}
+			}
+		}
+
+		violations = count_routings_violations(cp, rt, cm, NULL);
+
+		printf("\r[negotiate] Iterations: %4d, Score: %d, Violations: %d, Present factor: %.2f",
+		       iterations + 1, score_routings(rt), violations, cm->present_factor);
+		LOG(LOG_NEGOTIATE_ITERATION, iterations + 1, score_routings(rt), violations, cm->present_factor);
+		fflush(stdout);
+		log_flush();
+
+		end_route_iteration("negotiated", iterations + 1, score_routings(rt), violations);
+
+		cm->present_factor *= PRESENT_FACTOR_GROWTH;
+		if (cm->present_factor > PRESENT_FACTOR_MAX)
+			cm->present_factor = PRESENT_FACTOR_MAX;
+		iterations++;
+	}
+	printf("\n");
+
+	violations = settle_on_best_routings(&best, cp, rt, violations);
+
+	free(batch);
+	free(pending);
+	free_congestion_map(cm);
+
+	return violations;
+}
+
+/* main route subroutine; status says whether the routings returned are legal */
+struct routings *route(struct blif *blif, struct cell_placements *cp, struct routing_options *opts, enum routing_status *status)
+{
+	route_start = time(NULL);
+	route_time_limit = opts->time_limit;
+	route_iteration_limit = opts->iteration_limit;
+	route_limit_reached = NULL;
+	route_local_repair = opts->local_repair;
+
+	struct pin_placements *pp = placer_place_pins(cp);
+	struct net_pin_map *npm = placer_create_net_pin_map(pp);
+
+	// routing works where the placer left the design, in a frame that stays
+	// put however far the routings spread; the design is only moved to
+	// non-negative coordinates once routing is done
+	struct routings *rt = initial_route(blif, npm, opts->net_router);
+	// print_routings(rt);
+
+	if (opts->previous)
+		eco_restore_routings(rt, blif, opts->previous, opts->fixed_nets);
+
+	if (opts->global_route)
+		global_route(cp, rt, 2);
+
+	maze_router_reset_stats();
+	free(route_iterations);
+	route_iterations = NULL;
+	n_route_iterations = 0;
+
+	interrupt_routing = 0;
+	signal(SIGINT, router_sigint_handler);
+
+	int violations;
+	switch (opts->mode) {
+	case ROUTING_NEGOTIATED:
+		violations = negotiated_congestion_route(cp, rt, opts->threads);
+		break;
+	case ROUTING_RIP_UP:
+	default:
+		violations = natural_selection_route(cp, rt, opts->threads);
+		break;
+	}
 
 	signal(SIGINT, SIG_DFL);
 
-	// optimize routing by replacing a net wholesale and rerouting it
-	printf("\n[router] Solution found! Optimizing...\n");
-	fprintf(log, "\n[router] Solution found! Optimizing...\n");
+	if (violations > 0 && route_limit_reached) {
+		// optimization would not stop until the violations were gone
+		*status = ROUTING_INCOMPLETE;
+		printf("\n[router] Stopped at the %s limit with %d violations left, keeping the best routings found\n",
+		       route_limit_reached, violations);
+		LOG(LOG_ROUTER_LIMIT, route_limit_reached, violations);
+	} else {
+		// optimize routing by replacing a net wholesale and rerouting it
+		printf("\n[router] Solution found! Optimizing...\n");
+		LOG(LOG_ROUTER_SOLVED);
 
-	optimize_routings(cp, rt, log);
+		optimize_routings(cp, rt, opts->threads);
+
+		*status = ROUTING_COMPLETE;
+		if (route_limit_reached) {
+			*status = ROUTING_UNOPTIMIZED;
+			printf("\n[router] Stopped optimizing at the %s limit\n", route_limit_reached);
+			LOG(LOG_ROUTER_OPTIMIZE_LIMIT, route_limit_reached);
+		}
+	}
 
 	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
 		// printf("net %d (%s)\n", i, get_net_name(blif, i));
 		// print_rsa(&rt->routed_nets[i]);
 	}
 
-	printf("[router] Routing complete!\n");
+	if (*status != ROUTING_INCOMPLETE)
+		printf("[router] Routing complete!\n");
+
+	struct maze_route_stats ms = maze_router_stats();
+	printf("[router] Nets routed: %lu, in %.2f s; moves considered: %lu (%lu breaking the rules)\n",
+	       ms.reroutes, ms.usec / 1e6, ms.visits, ms.violations);
+	printf("[router] Maze router heap pops: %lu, pushes: %lu, decrease-keys: %lu, merges: %lu, entries discarded on merge: %lu\n",
+	       ms.pops, ms.pushes, ms.decrease_keys, ms.merges, ms.discarded);
+	printf("[router] Maze router search windows: %lu, average size: %lu blocks\n",
+	       ms.windows, ms.windows ? ms.window_cells / ms.windows : 0);
+	if (opts->global_route)
+		printf("[router] Nets that left their global routing corridor: %lu\n", ms.corridor_escapes);
+	printf("[router] Patterns joined %lu groups (%lu left to the maze)\n", ms.pattern_joins, ms.pattern_left);
+	if (opts->local_repair)
+		printf("[router] Local repairs: %lu (%lu fell back to rerouting the whole net)\n", ms.repairs, ms.repair_fallbacks);
+	if (ms.line_routed || ms.line_failed)
+		printf("[router] Line probes routed %lu nets (%lu left to the maze), labelling %lu blocks\n",
+		       ms.line_routed, ms.line_failed, ms.line_cells);
 	// print_routings(rt);
-	fclose(log);
+	log_flush();
+
+	recenter(cp, rt, 2);
 
 	free_pin_placements(pp);
 	// free_net_pin_map(npm); // screws with extract in vis_png
 
 	return rt;
 }
+
+/* take the routings sr (written with the placements cp) in place of
+   routing cp; returns NULL if a net of the design is not in sr. status is
+   ROUTING_INCOMPLETE if the routings have violations left */
+struct routings *load_serialized_routings(struct blif *blif, struct cell_placements *cp, struct serialized_routings *sr, enum routing_status *status)
+{
+	// each path has to lead from the end of its segment back to its start
+	for (int j = 0; j < sr->n_nets; j++) {
+		for (int s = 0; s < sr->nets[j].n_segments; s++) {
+			struct serialized_segment *ss = &sr->nets[j].segments[s];
+			struct coordinate c = ss->end;
+			for (int k = 0; k < ss->n_backtraces; k++)
+				if (ss->bt[k] != BT_START)
+					c = disp_backtrace(c, ss->bt[k]);
+
+			if (!coordinate_equal(c, ss->start)) {
+				printf("[router] a path of net %s does not lead back to its start\n", sr->nets[j].name);
+				return NULL;
+			}
+		}
+	}
+
+	struct pin_placements *pp = placer_place_pins(cp);
+	struct net_pin_map *npm = placer_create_net_pin_map(pp);
+	struct routings *rt = initial_route(blif, npm, NET_ROUTER_MAZE);
+
+	unsigned char *fixed = malloc(rt->n_routed_nets + 1);
+	memset(fixed, 1, rt->n_routed_nets + 1);
+	eco_restore_routings(rt, blif, sr, fixed);
+	free(fixed);
+
+	int missing = 0;
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
+		struct routed_net *rn = &rt->routed_nets[i];
+		if (!rn->fixed) {
+			printf("[router] net %s is not in the routings\n", get_net_name(blif, i));
+			missing++;
+		}
+		rn->fixed = 0;
+	}
+
+	if (missing) {
+		free_routings(rt);
+		free_pin_placements(pp);
+		return NULL;
+	}
+
+	// routings of another placement can reach anywhere; keep to those that
+	// stay within a design's width of the cells
+	struct coordinate ctl = extent_tl(&cp->cells), cbr = extent_br(&cp->cells);
+	struct coordinate rtl = ctl, rbr = cbr;
+	struct extent_tracker *re = routings_extents(rt);
+	if (!extent_empty(re)) {
+		rtl = extent_tl(re);
+		rbr = extent_br(re);
+	}
+
+	int slack = cbr.z - ctl.z > cbr.x - ctl.x ? cbr.z - ctl.z : cbr.x - ctl.x;
+	if (ctl.y < 0 || rtl.y < 0 || rbr.y > cbr.y + slack ||
+	    rtl.z < ctl.z - slack || rtl.x < ctl.x - slack || rbr.z > cbr.z + slack || rbr.x > cbr.x + slack) {
+		printf("[router] the routings are nowhere near the placements\n");
+		free_routings(rt);
+		free_pin_placements(pp);
+		return NULL;
+	}
+
+	int violations = count_routings_violations(cp, rt, NULL, NULL);
+	*status = violations > 0 ? ROUTING_INCOMPLETE : ROUTING_COMPLETE;
+	if (violations > 0)
+		printf("[router] the routings have %d violations\n", violations);
+
+	recenter(cp, rt, 2);
+
+	free_pin_placements(pp);
+
+	return rt;
+}
+
+// write, as YAML, how many blocks of each net are in violation, listing
+// only nets that have any
+void report_routing_violations(FILE *f, struct cell_placements *cp, struct routings *rt, struct blif *blif)
+{
+	int *net_violations = calloc(rt->n_routed_nets + 1, sizeof(int));
+	int total = count_routings_violations(cp, rt, NULL, net_violations);
+
+	fprintf(f, "violations: %d\n", total);
+	fprintf(f, "nets:\n");
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
+		if (!net_violations[i])
+			continue;
+
+		fprintf(f, "  %s:\n", get_net_name(blif, i));
+		fprintf(f, "    blocks: %d\n", net_violations[i]);
+		fprintf(f, "    segments: %d\n", segments_in_violation(&rt->routed_nets[i]));
+	}
+
+	free(net_violations);
+}
+
+static void write_effort_json(FILE *f, struct maze_route_stats *s)
+{
+	fprintf(f, "\"reroutes\": %lu, \"usec\": %lu, \"pops\": %lu, \"visits\": %lu, \"violations\": %lu, "
+	           "\"pushes\": %lu, \"decrease_keys\": %lu, \"merges\": %lu, \"discarded\": %lu, "
+	           "\"windows\": %lu, \"window_cells\": %lu, \"pattern_joins\": %lu, \"pattern_left\": %lu, "
+	           "\"line_routed\": %lu, \"line_failed\": %lu, \"line_cells\": %lu, "
+	           "\"corridor_escapes\": %lu, \"repairs\": %lu, \"repair_fallbacks\": %lu",
+	        s->reroutes, s->usec, s->pops, s->visits, s->violations,
+	        s->pushes, s->decrease_keys, s->merges, s->discarded,
+	        s->windows, s->window_cells, s->pattern_joins, s->pattern_left,
+	        s->line_routed, s->line_failed, s->line_cells,
+	        s->corridor_escapes, s->repairs, s->repair_fallbacks);
+}
+
+// write, as JSON, the search effort of the last call to route: in total,
+// for each iteration of routing and optimization, and for each net, along
+// with the net's final score and segment count
+void report_routing_effort(FILE *f, struct routings *rt, struct blif *blif)
+{
+	struct maze_route_stats total = maze_router_stats();
+	fprintf(f, "{\"total\": {");
+	write_effort_json(f, &total);
+	fprintf(f, "},\n \"iterations\": [\n");
+	for (int i = 0; i < n_route_iterations; i++) {
+		struct route_iteration *ri = &route_iterations[i];
+		fprintf(f, "  {\"stage\": \"%s\", \"iteration\": %d, \"score\": %d, \"violations_left\": %d, \"iteration_usec\": %lu, ",
+		        ri->stage, ri->iteration, ri->score, ri->violations, ri->usec);
+		write_effort_json(f, &ri->effort);
+		fprintf(f, "}%s\n", i < n_route_iterations - 1 ? "," : "");
+	}
+	fprintf(f, " ],\n \"nets\": [\n");
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
+		struct routed_net *rn = &rt->routed_nets[i];
+		int n_segments = 0;
+		for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next)
+			n_segments++;
+
+		fprintf(f, "  {\"name\": \"");
+		for (char *n = get_net_name(blif, i); *n; n++) {
+			if (*n == '\\' || *n == '"')
+				fputc('\\', f);
+			fputc(*n, f);
+		}
+		fprintf(f, "\", \"net\": %u, \"pins\": %d, \"segments\": %d, \"score\": %d, ",
+		        i, rn->n_pins, n_segments, score_net(rn));
+		struct maze_route_stats ns = maze_router_net_stats(i);
+		write_effort_json(f, &ns);
+		fprintf(f, "}%s\n", i < rt->n_routed_nets ? "," : "");
+	}
+	fprintf(f, " ]}\n");
+}
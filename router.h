@@ -1,17 +1,66 @@
 #ifndef __ROUTER_H__
 #define __ROUTER_H__
 
+#include <stdio.h>
+
 #include "blif.h"
 #include "placer.h"
 #include "base_router.h"
 
-struct routings *route(struct blif *, struct cell_placements *);
+enum routing_mode {
+	ROUTING_RIP_UP,    // rip up segments by natural selection until legal
+	ROUTING_NEGOTIATED // negotiated congestion (PathFinder)
+};
+
+struct serialized_routings;
+
+struct routing_options {
+	enum routing_mode mode;
+
+	// number of nets that may be rerouted concurrently
+	int threads;
+
+	// the search used for every net
+	enum net_router net_router;
+
+	// whether to assign nets corridors by global routing first
+	int global_route;
+
+	// seconds routing (and optimization) may take, or 0 for no limit
+	int time_limit;
+
+	// iterations the routing stage may take, or 0 for no limit
+	int iteration_limit;
+
+	// whether to reconnect a net around the segments ripped out of it,
+	// keeping the rest of its tree, before rerouting it anywhere else
+	int local_repair;
+
+	// routings of a previous run, and the nets (by net_t) that keep their
+	// routes from it (see eco.c), or NULL to route every net
+	struct serialized_routings *previous;
+	unsigned char *fixed_nets;
+};
+
+enum routing_status {
+	ROUTING_COMPLETE,    // no violations, and fully optimized
+	ROUTING_UNOPTIMIZED, // no violations, but the time limit cut optimization short
+	ROUTING_INCOMPLETE   // a limit was reached with violations left; the best routings seen are returned
+};
+
+struct routings *route(struct blif *, struct cell_placements *, struct routing_options *, enum routing_status *);
+struct routings *load_serialized_routings(struct blif *, struct cell_placements *, struct serialized_routings *, enum routing_status *);
+void report_routing_violations(FILE *, struct cell_placements *, struct routings *, struct blif *);
+void report_routing_effort(FILE *, struct routings *, struct blif *);
 struct routings *copy_routings(struct routings *);
 struct dimensions compute_routings_dimensions(struct routings *);
 void free_routings(struct routings *);
 
 int segment_routed(struct routed_segment *);
 void routed_net_add_segment_node(struct routed_net *, struct routed_segment_head *);
+struct routed_segment_head *remove_rsh(struct routed_segment *);
+void rip_up_segment(struct routed_segment *);
+void rip_up_new_segments(struct routed_net *, struct routed_segment_head *);
 
 void routings_displace(struct routings *, struct coordinate);
 
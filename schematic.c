@@ -0,0 +1,409 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "extract.h"
+#include "nbt.h"
+#include "schematic.h"
+
+/* SCHEMATICS
+
+   an extraction is written as a Sponge schematic (version 2), the format
+   WorldEdit and most other tools load: gzip-compressed NBT holding the
+   dimensions, a palette of block states, and the index into the palette of
+   every block, as varints in the same y, z, x order as the extraction.
+
+   cells and routes are described with the block ids and data values of
+   Minecraft before 1.13, which only the flattening map of later versions
+   relates to block states; the few blocks Dewey places are mapped here.
+   redstone dust is given the connections the game would draw for it, since
+   tools paste blocks as they are without letting them update. */
+
+// Minecraft 1.16.5, the first version with dust that connects to nothing
+// by default
+#define SCHEMATIC_DATA_VERSION 2586
+
+/* block states */
+
+#define AIR 0
+#define REDSTONE_DUST 55
+#define LEVER 69
+#define UNLIT_REDSTONE_TORCH 75
+#define REDSTONE_TORCH 76
+#define UNLIT_REDSTONE_REPEATER 93
+#define REDSTONE_REPEATER 94
+#define UNLIT_REDSTONE_COMPARATOR 149
+#define REDSTONE_COMPARATOR 150
+#define REDSTONE_BLOCK 152
+
+// horizontal directions, in the order the connections of dust are listed
+enum side { SIDE_NORTH, SIDE_SOUTH, SIDE_EAST, SIDE_WEST, N_SIDES };
+static const char *side_names[N_SIDES] = {"north", "south", "east", "west"};
+static const int side_dz[N_SIDES] = {-1, 1, 0, 0};
+static const int side_dx[N_SIDES] = {0, 0, 1, -1};
+
+// pistons face any way, by data & 0x7
+static const char *facings[] = {"down", "up", "north", "south", "west", "east"};
+
+// repeaters and comparators face toward their input, by data & 0x3
+static const char *diode_facings[] = {"south", "west", "north", "east"};
+
+// blocks that take a single state, by id
+static const char *plain_blocks[256] = {
+	[0] = "air",
+	[1] = "stone",
+	[2] = "grass_block",
+	[3] = "dirt",
+	[4] = "cobblestone",
+	[5] = "oak_planks",
+	[7] = "bedrock",
+	[12] = "sand",
+	[13] = "gravel",
+	[20] = "glass",
+	[24] = "sandstone",
+	[41] = "gold_block",
+	[42] = "iron_block",
+	[45] = "bricks",
+	[49] = "obsidian",
+	[57] = "diamond_block",
+	[80] = "snow_block",
+	[82] = "clay",
+	[87] = "netherrack",
+	[89] = "glowstone",
+	[152] = "redstone_block",
+	[155] = "quartz_block",
+	[165] = "slime_block",
+	[169] = "sea_lantern",
+	[173] = "coal_block"
+};
+
+static const char *wool_colors[16] = {
+	"white", "orange", "magenta", "light_blue", "yellow", "lime", "pink", "gray",
+	"light_gray", "cyan", "purple", "blue", "brown", "green", "red", "black"
+};
+
+// write the state of block b with data d into s (of n), for any block but
+// dust (see dust_connections); returns 0 for a block with no known state
+static int block_state(char *s, size_t n, block_t b, data_t d)
+{
+	switch (b) {
+	case LEVER: {
+		// 0 and 7 hang from the ceiling, 1-4 from a wall, and 5 and 6
+		// stand on the floor; the axis of those two is all that matters
+		static const char *faces[] = {"ceiling", "wall", "wall", "wall", "wall", "floor", "floor", "ceiling"};
+		static const char *lever_facings[] = {"east", "east", "west", "south", "north", "north", "east", "north"};
+		snprintf(s, n, "minecraft:lever[face=%s,facing=%s,powered=%s]",
+		         faces[d & 0x7], lever_facings[d & 0x7], d & 0x8 ? "true" : "false");
+		return 1;
+	}
+	case UNLIT_REDSTONE_TORCH:
+	case REDSTONE_TORCH: {
+		// up=5, north=4, south=3, west=2, east=1, as in cell_library.c
+		static const char *torch_facings[] = {NULL, "east", "west", "south", "north"};
+		const char *lit = b == REDSTONE_TORCH ? "true" : "false";
+		if (d >= 1 && d <= 4)
+			snprintf(s, n, "minecraft:redstone_wall_torch[facing=%s,lit=%s]", torch_facings[d], lit);
+		else
+			snprintf(s, n, "minecraft:redstone_torch[lit=%s]", lit);
+		return 1;
+	}
+	case UNLIT_REDSTONE_REPEATER:
+	case REDSTONE_REPEATER:
+		snprintf(s, n, "minecraft:repeater[delay=%d,facing=%s,locked=false,powered=%s]",
+		         ((d >> 2) & 0x3) + 1, diode_facings[d & 0x3], b == REDSTONE_REPEATER ? "true" : "false");
+		return 1;
+	case UNLIT_REDSTONE_COMPARATOR:
+	case REDSTONE_COMPARATOR:
+		snprintf(s, n, "minecraft:comparator[facing=%s,mode=%s,powered=%s]",
+		         diode_facings[d & 0x3], d & 0x4 ? "subtract" : "compare", d & 0x8 || b == REDSTONE_COMPARATOR ? "true" : "false");
+		return 1;
+	case 29: // sticky piston
+	case 33: // piston
+		if ((d & 0x7) > 5)
+			return 0;
+		snprintf(s, n, "minecraft:%s[extended=%s,facing=%s]",
+		         b == 29 ? "sticky_piston" : "piston", d & 0x8 ? "true" : "false", facings[d & 0x7]);
+		return 1;
+	case 35:
+		snprintf(s, n, "minecraft:%s_wool", wool_colors[d & 0xf]);
+		return 1;
+	case 123:
+	case 124:
+		snprintf(s, n, "minecraft:redstone_lamp[lit=%s]", b == 124 ? "true" : "false");
+		return 1;
+	default:
+		if (!plain_blocks[b])
+			return 0;
+		snprintf(s, n, "minecraft:%s", plain_blocks[b]);
+		return 1;
+	}
+}
+
+static block_t block_at(struct extraction *e, int y, int z, int x)
+{
+	data_t d;
+	return extraction_get(e, (struct coordinate){y, z, x}, &d);
+}
+
+static data_t data_at(struct extraction *e, int y, int z, int x)
+{
+	data_t d;
+	extraction_get(e, (struct coordinate){y, z, x}, &d);
+	return d;
+}
+
+// whether dust runs over a block into dust below or above it
+static int is_solid(block_t b)
+{
+	switch (b) {
+	case AIR:
+	case REDSTONE_DUST:
+	case LEVER:
+	case UNLIT_REDSTONE_TORCH:
+	case REDSTONE_TORCH:
+	case UNLIT_REDSTONE_REPEATER:
+	case REDSTONE_REPEATER:
+	case UNLIT_REDSTONE_COMPARATOR:
+	case REDSTONE_COMPARATOR:
+	case 20: // glass
+	case 165: // slime
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+// whether dust next to (y, z, x), on side s, turns toward it
+static int dust_joins(struct extraction *e, int y, int z, int x, enum side s)
+{
+	block_t b = block_at(e, y, z, x);
+	switch (b) {
+	case REDSTONE_DUST:
+	case LEVER:
+	case UNLIT_REDSTONE_TORCH:
+	case REDSTONE_TORCH:
+	case REDSTONE_BLOCK:
+		return 1;
+	case UNLIT_REDSTONE_REPEATER:
+	case REDSTONE_REPEATER: {
+		// only from in front or behind
+		int along_z = (data_at(e, y, z, x) & 0x1) == 0;
+		return along_z == (s == SIDE_NORTH || s == SIDE_SOUTH);
+	}
+	case UNLIT_REDSTONE_COMPARATOR:
+	case REDSTONE_COMPARATOR:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+enum dust_side { DUST_NONE, DUST_SIDE, DUST_UP };
+static const char *dust_side_names[] = {"none", "side", "up"};
+
+// the connections of the dust at (y, z, x), by side
+static void dust_connections(struct extraction *e, int y, int z, int x, enum dust_side *conn)
+{
+	int n_joined = 0;
+	int covered = is_solid(block_at(e, y + 1, z, x));
+	for (int s = 0; s < N_SIDES; s++) {
+		int nz = z + side_dz[s], nx = x + side_dx[s];
+		conn[s] = DUST_NONE;
+		if (dust_joins(e, y, nz, nx, s))
+			conn[s] = DUST_SIDE;
+		else if (!covered && block_at(e, y + 1, nz, nx) == REDSTONE_DUST)
+			conn[s] = DUST_UP;
+		else if (!is_solid(block_at(e, y, nz, nx)) && block_at(e, y - 1, nz, nx) == REDSTONE_DUST)
+			conn[s] = DUST_SIDE;
+		n_joined += conn[s] != DUST_NONE;
+	}
+
+	// dust joined on one side runs straight through; dust joined to
+	// nothing is a cross, which is how it powered every side before 1.16
+	if (n_joined == 1) {
+		for (int s = 0; s < N_SIDES; s++)
+			if (conn[s] != DUST_NONE)
+				conn[s ^ 1] = conn[s ^ 1] == DUST_NONE ? DUST_SIDE : conn[s ^ 1];
+	} else if (n_joined == 0) {
+		for (int s = 0; s < N_SIDES; s++)
+			conn[s] = DUST_SIDE;
+	}
+}
+
+/* the palette */
+
+struct palette {
+	int n, sz;
+	char **states;
+
+	// the entry of each block and data value, and of each way dust can be
+	// connected, once known; -1 before
+	int by_block[256 * 256];
+	int by_dust[3 * 3 * 3 * 3];
+};
+
+static int palette_add(struct palette *pal, const char *state)
+{
+	if (pal->n == pal->sz) {
+		pal->sz *= 2;
+		pal->states = realloc(pal->states, pal->sz * sizeof(char *));
+	}
+
+	pal->states[pal->n] = malloc(strlen(state) + 1);
+	strcpy(pal->states[pal->n], state);
+	return pal->n++;
+}
+
+static int palette_entry(struct palette *pal, struct extraction *e, int y, int z, int x, int *unknown)
+{
+	data_t d;
+	block_t b = extraction_get(e, (struct coordinate){y, z, x}, &d);
+	char state[128];
+
+	if (b == REDSTONE_DUST) {
+		enum dust_side conn[N_SIDES];
+		dust_connections(e, y, z, x, conn);
+		int key = ((conn[0] * 3 + conn[1]) * 3 + conn[2]) * 3 + conn[3];
+		if (pal->by_dust[key] < 0) {
+			int len = snprintf(state, sizeof(state), "minecraft:redstone_wire[");
+			for (int s = 0; s < N_SIDES; s++)
+				len += snprintf(state + len, sizeof(state) - len, "%s=%s,", side_names[s], dust_side_names[conn[s]]);
+			snprintf(state + len, sizeof(state) - len, "power=0]");
+			pal->by_dust[key] = palette_add(pal, state);
+		}
+		return pal->by_dust[key];
+	}
+
+	int key = b * 256 + d;
+	if (pal->by_block[key] < 0) {
+		if (!block_state(state, sizeof(state), b, d)) {
+			printf("[schematic] no block state known for block %d:%d, writing air\n", b, d);
+			snprintf(state, sizeof(state), "minecraft:air");
+			(*unknown)++;
+		}
+
+		// unknown blocks, as air, may share an entry with air
+		for (int i = 0; i < pal->n; i++) {
+			if (strcmp(pal->states[i], state) == 0) {
+				pal->by_block[key] = i;
+				return i;
+			}
+		}
+		pal->by_block[key] = palette_add(pal, state);
+	}
+
+	return pal->by_block[key];
+}
+
+// write extraction e to path as a gzip-compressed Sponge schematic;
+// returns 0 if it cannot be written
+int write_schematic(const char *path, struct extraction *e)
+{
+	struct dimensions d = e->dimensions;
+	if (d.x > UINT16_MAX || d.y > UINT16_MAX || d.z > UINT16_MAX) {
+		printf("[schematic] a design of %d x %d x %d blocks is too large for a schematic\n", d.x, d.y, d.z);
+		return 0;
+	}
+
+	struct palette *pal = malloc(sizeof(struct palette));
+	pal->n = 0;
+	pal->sz = 16;
+	pal->states = malloc(pal->sz * sizeof(char *));
+	memset(pal->by_block, -1, sizeof(pal->by_block));
+	memset(pal->by_dust, -1, sizeof(pal->by_dust));
+
+	// air comes first, so that the sections of the extraction with nothing
+	// in them are written as runs of zeroes
+	static const unsigned char air[EXTRACTION_SECTION_SIZE] = {0};
+	palette_add(pal, "minecraft:air");
+	pal->by_block[AIR] = 0;
+
+	// the palette entry of every block, as varints
+	int unknown = 0;
+	int size = d.y * d.z * d.x;
+	struct dimensions ns = e->n_sections;
+	struct nbt_buffer blocks;
+	nbt_buffer_init(&blocks, size + 16);
+	for (int y = 0; y < d.y; y++) {
+		for (int z = 0; z < d.z; z++) {
+			struct extraction_section **row = &e->sections[((y >> EXTRACTION_SECTION_BITS) * ns.z + (z >> EXTRACTION_SECTION_BITS)) * ns.x];
+			for (int x = 0; x < d.x; x++) {
+				if (!row[x >> EXTRACTION_SECTION_BITS]) {
+					int n = EXTRACTION_SECTION_SIZE - (x & (EXTRACTION_SECTION_SIZE - 1));
+					n = d.x - x < n ? d.x - x : n;
+					nbt_put(&blocks, air, n);
+					x += n - 1;
+					continue;
+				}
+
+				unsigned int v = palette_entry(pal, e, y, z, x, &unknown);
+				while (v >= 0x80) {
+					nbt_byte(&blocks, (v & 0x7f) | 0x80);
+					v >>= 7;
+				}
+				nbt_byte(&blocks, v);
+			}
+		}
+	}
+
+	struct nbt_buffer nb;
+	nbt_buffer_init(&nb, blocks.n + 4096);
+	nbt_tag(&nb, TAG_COMPOUND, "Schematic");
+
+	nbt_tag(&nb, TAG_INT, "Version");
+	nbt_int(&nb, 2);
+	nbt_tag(&nb, TAG_INT, "DataVersion");
+	nbt_int(&nb, SCHEMATIC_DATA_VERSION);
+
+	nbt_tag(&nb, TAG_SHORT, "Width");
+	nbt_short(&nb, d.x);
+	nbt_tag(&nb, TAG_SHORT, "Height");
+	nbt_short(&nb, d.y);
+	nbt_tag(&nb, TAG_SHORT, "Length");
+	nbt_short(&nb, d.z);
+
+	nbt_tag(&nb, TAG_INT_ARRAY, "Offset");
+	nbt_int(&nb, 3);
+	for (int i = 0; i < 3; i++)
+		nbt_int(&nb, 0);
+
+	nbt_tag(&nb, TAG_INT, "PaletteMax");
+	nbt_int(&nb, pal->n);
+	nbt_tag(&nb, TAG_COMPOUND, "Palette");
+	for (int i = 0; i < pal->n; i++) {
+		nbt_tag(&nb, TAG_INT, pal->states[i]);
+		nbt_int(&nb, i);
+	}
+	nbt_byte(&nb, TAG_END);
+
+	nbt_tag(&nb, TAG_BYTE_ARRAY, "BlockData");
+	nbt_int(&nb, blocks.n);
+	nbt_put(&nb, blocks.b, blocks.n);
+
+	nbt_tag(&nb, TAG_LIST, "BlockEntities");
+	nbt_byte(&nb, TAG_COMPOUND);
+	nbt_int(&nb, 0);
+
+	nbt_byte(&nb, TAG_END);
+
+	int ok = 0;
+	gzFile f = gzopen(path, "wb");
+	if (f) {
+		ok = gzwrite(f, nb.b, nb.n) == (int)nb.n;
+		ok = gzclose(f) == Z_OK && ok;
+	}
+
+	if (unknown)
+		printf("[schematic] %d kinds of block were written as air\n", unknown);
+
+	for (int i = 0; i < pal->n; i++)
+		free(pal->states[i]);
+	free(pal->states);
+	free(pal);
+	free(blocks.b);
+	free(nb.b);
+
+	return ok;
+}
@@ -0,0 +1,8 @@
+#ifndef __SCHEMATIC_H__
+#define __SCHEMATIC_H__
+
+#include "extract.h"
+
+int write_schematic(const char *, struct extraction *);
+
+#endif /* __SCHEMATIC_H__ */
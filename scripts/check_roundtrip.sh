@@ -0,0 +1,43 @@
+#!/bin/bash
+# check that a run's placements and routings read back whole, in YAML and
+# in binary: starting from them (with --from-placement and --from-routing,
+# or with --eco) extracts the same blocks. run from the directory holding
+# dewey and quan.yaml
+
+BLIF=examples/counter.blif
+
+if [ "$1" != "" ]; then
+	BLIF=$1
+fi
+
+OUT=$(mktemp -d)
+trap 'rm -rf ${OUT}' EXIT
+
+run() {
+	name=$1; shift
+	if ! ./dewey -o ${OUT}/${name} "$@" ${BLIF} > ${OUT}/${name}.log; then
+		echo "[check_roundtrip] ${name}: dewey failed, see below"
+		tail -5 ${OUT}/${name}.log
+		exit 1
+	fi
+}
+
+same() {
+	if ! cmp -s ${OUT}/first/extraction.yaml ${OUT}/$1/extraction.yaml; then
+		echo "[check_roundtrip] $1: extraction differs from the first run"
+		exit 1
+	fi
+	echo "[check_roundtrip] $1: ok"
+}
+
+run first
+run eco --eco=${OUT}/first
+same eco
+run yaml --from-placement=${OUT}/first/placements.yaml --from-routing=${OUT}/first/routings.yaml
+same yaml
+run binary -f binary --from-placement=${OUT}/first/placements.yaml --from-routing=${OUT}/first/routings.yaml
+same binary
+run from_binary --from-placement=${OUT}/binary/placements.bin --from-routing=${OUT}/binary/routings.bin
+same from_binary
+run eco_binary --eco=${OUT}/binary
+same eco_binary
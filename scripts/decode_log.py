@@ -0,0 +1,117 @@
+#!/usr/bin/env python
+
+# Turn a binary log written by dewey (router.log) into text, one event per
+# line. The log describes its own events (see logger.c), so this script does
+# not need to be changed when events are added.
+#
+# Usage: decode_log.py <router.log> [module[:level],...]
+#   with modules or levels given, only the events they select are printed
+
+from __future__ import print_function
+
+import re
+import struct
+import sys
+
+LEVELS = ["off", "info", "debug", "trace"]
+CONVERSION = re.compile(r"%([-+ #0-9.]*)(l?)([dupfs%])")
+
+
+class Reader(object):
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+        self.order = "<"
+
+    def done(self):
+        return self.pos >= len(self.data)
+
+    def take(self, fmt):
+        fmt = self.order + fmt
+        size = struct.calcsize(fmt)
+        if self.pos + size > len(self.data):
+            raise EOFError()
+        v = struct.unpack_from(fmt, self.data, self.pos)
+        self.pos += size
+        return v[0] if len(v) == 1 else v
+
+    def string(self):
+        n = self.take("H")
+        if self.pos + n > len(self.data):
+            raise EOFError()
+        s = self.data[self.pos:self.pos + n].decode("utf-8", "replace")
+        self.pos += n
+        return s
+
+
+def read_header(r):
+    if r.data[:8] != b"DEWEYLOG":
+        sys.exit("not a dewey log")
+    r.pos = 8
+    if r.take("I") != 0x01020304:
+        r.order = ">"
+
+    modules = [r.string() for _ in range(r.take("H"))]
+    events = []
+    for _ in range(r.take("H")):
+        module, level = r.take("H"), r.take("H")
+        events.append((module, level, r.string()))
+    return modules, events
+
+
+def parse_selection(spec, modules):
+    # the level up to which each module is printed
+    if spec is None:
+        return [len(LEVELS)] * len(modules)
+
+    selected = [0] * len(modules)
+    for part in spec.split(","):
+        name, _, level = part.partition(":")
+        level = LEVELS.index(level) if level else len(LEVELS)
+        for i, m in enumerate(modules):
+            if name in ("all", m):
+                selected[i] = level
+    return selected
+
+
+def format_event(r, fmt):
+    def convert(m):
+        flags, is_long, conv = m.groups()
+        if conv == "%":
+            return "%"
+        if conv in "du":
+            v = r.take("Q" if is_long else ("I" if conv == "u" else "i"))
+            return ("%" + flags + "d") % v
+        if conv == "p":
+            return ("%" + flags + "s") % ("0x%x" % r.take("Q"))
+        if conv == "f":
+            return ("%" + flags + "f") % r.take("d")
+        return ("%" + flags + "s") % r.string()
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: %s <router.log> [module[:level],...]" % sys.argv[0])
+        sys.exit(1)
+
+    with open(sys.argv[1], "rb") as f:
+        r = Reader(f.read())
+
+    modules, events = read_header(r)
+    selected = parse_selection(sys.argv[2] if len(sys.argv) > 2 else None, modules)
+
+    try:
+        while not r.done():
+            module, level, fmt = events[r.take("H")]
+            line = format_event(r, fmt)
+            if level <= selected[module]:
+                print(line)
+    except EOFError:
+        # the run was cut short before its last records were written out
+        print("[decode_log] log ends in the middle of a record", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
 
 #include "segment.h"
 #include "cell.h"
@@ -131,3 +132,234 @@ void free_segments(struct segments *s)
 	free(s->segments);
 	free(s);
 }
+
+/* rectilinear Steiner trees */
+
+// up to this many terminals, every set of Hanan grid points (of which an
+// optimal tree needs at most n - 2) is tried; beyond it, Steiner points are
+// added one at a time while each shortens the tree (iterated 1-Steiner)
+#define STEINER_EXACT_TERMINALS 5
+
+// beyond this many terminals, the tree is just the minimum spanning tree
+#define STEINER_MAX_TERMINALS 32
+
+struct steiner_scratch {
+	int *dist;
+	int *from;
+	char *in;
+};
+
+// Prim's algorithm over the first n points, in O(n^2); returns the length,
+// and fills edges (if given) in the order the points joined the tree
+static int steiner_mst(struct coordinate *pts, int n, struct steiner_edge *edges, struct steiner_scratch *s)
+{
+	if (n <= 1)
+		return 0;
+
+	for (int i = 0; i < n; i++) {
+		s->dist[i] = distance_cityblock(pts[0], pts[i]);
+		s->from[i] = 0;
+		s->in[i] = 0;
+	}
+	s->in[0] = 1;
+
+	int length = 0;
+	for (int k = 1; k < n; k++) {
+		int next = -1;
+		for (int i = 0; i < n; i++)
+			if (!s->in[i] && (next < 0 || s->dist[i] < s->dist[next]))
+				next = i;
+
+		s->in[next] = 1;
+		length += s->dist[next];
+		if (edges)
+			edges[k - 1] = (struct steiner_edge){s->from[next], next};
+
+		for (int i = 0; i < n; i++) {
+			int d = distance_cityblock(pts[next], pts[i]);
+			if (!s->in[i] && d < s->dist[i]) {
+				s->dist[i] = d;
+				s->from[i] = next;
+			}
+		}
+	}
+
+	return length;
+}
+
+static int coordinate_int_cmp(const void *a, const void *b)
+{
+	return *(int *)a - *(int *)b;
+}
+
+// the points of the Hanan grid (lines in x and z through every terminal)
+// that are not terminals themselves
+static int hanan_candidates(struct coordinate *terminals, int n, struct coordinate *out)
+{
+	int *xs = malloc(n * sizeof(int)), *zs = malloc(n * sizeof(int));
+	for (int i = 0; i < n; i++) {
+		xs[i] = terminals[i].x;
+		zs[i] = terminals[i].z;
+	}
+	qsort(xs, n, sizeof(int), coordinate_int_cmp);
+	qsort(zs, n, sizeof(int), coordinate_int_cmp);
+
+	int n_out = 0;
+	for (int i = 0; i < n; i++) {
+		if (i > 0 && xs[i] == xs[i - 1])
+			continue;
+		for (int j = 0; j < n; j++) {
+			if (j > 0 && zs[j] == zs[j - 1])
+				continue;
+
+			struct coordinate c = {terminals[0].y, zs[j], xs[i]};
+			int is_terminal = 0;
+			for (int k = 0; k < n && !is_terminal; k++)
+				is_terminal = terminals[k].x == c.x && terminals[k].z == c.z;
+
+			if (!is_terminal)
+				out[n_out++] = c;
+		}
+	}
+
+	free(xs);
+	free(zs);
+	return n_out;
+}
+
+// try every subset of candidates (from `next` on) of up to `left` more
+// points on top of the n points in pts, keeping the shortest tree in best
+static void steiner_exact(struct coordinate *pts, int n, struct coordinate *cands, int n_cands, int next, int left,
+		struct coordinate *best, int *n_best, int *best_length, struct steiner_scratch *s)
+{
+	int length = steiner_mst(pts, n, NULL, s);
+	if (length < *best_length) {
+		*best_length = length;
+		*n_best = n;
+		memcpy(best, pts, n * sizeof(struct coordinate));
+	}
+
+	if (!left)
+		return;
+
+	for (int i = next; i < n_cands; i++) {
+		pts[n] = cands[i];
+		steiner_exact(pts, n + 1, cands, n_cands, i + 1, left - 1, best, n_best, best_length, s);
+	}
+}
+
+// drop Steiner points joined to fewer than three others, which never make
+// the tree shorter
+static int steiner_prune(struct coordinate *pts, int n_terminals, int n, struct steiner_edge *edges, struct steiner_scratch *s)
+{
+	int pruned;
+	do {
+		pruned = 0;
+		steiner_mst(pts, n, edges, s);
+		for (int i = n - 1; i >= n_terminals; i--) {
+			int degree = 0;
+			for (int e = 0; e < n - 1; e++)
+				degree += (edges[e].a == i) + (edges[e].b == i);
+
+			if (degree <= 2) {
+				pts[i] = pts[--n];
+				pruned = 1;
+				break;
+			}
+		}
+	} while (pruned);
+
+	return n;
+}
+
+// iterated 1-Steiner: add whichever Hanan point shortens the tree most,
+// until none does
+static int steiner_iterated(struct coordinate *pts, int n_terminals, struct coordinate *cands, int n_cands, struct steiner_edge *edges, struct steiner_scratch *s)
+{
+	int n = n_terminals;
+	int length = steiner_mst(pts, n, NULL, s);
+
+	while (n < 2 * n_terminals - 2) {
+		int best = -1, best_length = length;
+		for (int i = 0; i < n_cands; i++) {
+			int taken = 0;
+			for (int k = n_terminals; k < n && !taken; k++)
+				taken = coordinate_equal(pts[k], cands[i]);
+			if (taken)
+				continue;
+
+			pts[n] = cands[i];
+			int l = steiner_mst(pts, n + 1, NULL, s);
+			if (l < best_length) {
+				best_length = l;
+				best = i;
+			}
+		}
+
+		if (best < 0)
+			break;
+
+		pts[n++] = cands[best];
+		n = steiner_prune(pts, n_terminals, n, edges, s);
+		length = steiner_mst(pts, n, NULL, s);
+	}
+
+	return n;
+}
+
+struct steiner_tree *create_steiner_tree(struct coordinate *terminals, int n_terminals)
+{
+	int max_points = n_terminals > 2 ? 2 * n_terminals - 2 : n_terminals;
+
+	struct steiner_tree *st = malloc(sizeof(struct steiner_tree));
+	st->n_terminals = n_terminals;
+	st->points = malloc(max_points * sizeof(struct coordinate));
+	st->edges = malloc(max_points * sizeof(struct steiner_edge));
+	memcpy(st->points, terminals, n_terminals * sizeof(struct coordinate));
+	st->n_points = n_terminals;
+
+	struct steiner_scratch s = {malloc(max_points * sizeof(int)), malloc(max_points * sizeof(int)), malloc(max_points)};
+
+	if (n_terminals >= 3 && n_terminals <= STEINER_MAX_TERMINALS) {
+		struct coordinate *cands = malloc(n_terminals * n_terminals * sizeof(struct coordinate));
+		int n_cands = hanan_candidates(terminals, n_terminals, cands);
+
+		if (n_terminals <= STEINER_EXACT_TERMINALS) {
+			struct coordinate *pts = malloc(max_points * sizeof(struct coordinate));
+			memcpy(pts, terminals, n_terminals * sizeof(struct coordinate));
+
+			int best_length = INT_MAX;
+			steiner_exact(pts, n_terminals, cands, n_cands, 0, n_terminals - 2, st->points, &st->n_points, &best_length, &s);
+			st->n_points = steiner_prune(st->points, n_terminals, st->n_points, st->edges, &s);
+			free(pts);
+		} else {
+			st->n_points = steiner_iterated(st->points, n_terminals, cands, n_cands, st->edges, &s);
+		}
+
+		free(cands);
+	}
+
+	st->length = steiner_mst(st->points, st->n_points, st->edges, &s);
+
+	free(s.dist);
+	free(s.from);
+	free(s.in);
+
+	return st;
+}
+
+void steiner_tree_displace(struct steiner_tree *st, struct coordinate disp)
+{
+	for (int i = 0; i < st->n_points; i++)
+		st->points[i] = coordinate_add(st->points[i], disp);
+}
+
+void free_steiner_tree(struct steiner_tree *st)
+{
+	if (!st)
+		return;
+
+	free(st->points);
+	free(st->edges);
+	free(st);
+}
@@ -40,4 +40,27 @@ void mst_union(struct mst_ubr_node *, struct mst_ubr_node *);
 struct segments *create_mst(struct coordinate *, int);
 void free_segments(struct segments *);
 
+// a rectilinear Steiner tree over some terminals (in x and z; every point
+// takes the y of the first terminal)
+struct steiner_edge {
+	int a, b; // indices into points
+};
+
+struct steiner_tree {
+	// the terminals, in the order given, then the Steiner points
+	int n_terminals;
+	int n_points;
+	struct coordinate *points;
+
+	// n_points - 1 edges, each joining a point to those before it in
+	// the order the tree was grown from the first terminal
+	struct steiner_edge *edges;
+
+	int length;
+};
+
+struct steiner_tree *create_steiner_tree(struct coordinate *, int);
+void steiner_tree_displace(struct steiner_tree *, struct coordinate);
+void free_steiner_tree(struct steiner_tree *);
+
 #endif /* __SEGMENT_H__ */
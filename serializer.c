@@ -1,11 +1,27 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <yaml.h>
 
 #include "placer.h"
 #include "blif.h"
 #include "serializer.h"
 #include "base_router.h"
 
+// write s as a double-quoted YAML scalar, so that names such as count[0]
+// are not taken for flow sequences when read back
+static void serialize_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fputc('\\', f);
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
 static void serialize_placement(FILE *f, struct placement *p, struct blif *blif)
 {
 	struct coordinate c = p->placement;
@@ -16,8 +32,10 @@ static void serialize_placement(FILE *f, struct placement *p, struct blif *blif)
 	fprintf(f, "    placement: (%d, %d, %d)\n", c.y, c.z, c.x);
 	fprintf(f, "    turns: %d\n", t);
 	fprintf(f, "    nets: [");
-	for (int i = 0; i < p->cell->n_pins; i++)
-		fprintf(f, "%s%s", get_net_name(blif, p->nets[i]), i != p->cell->n_pins - 1 ? ", " : "");
+	for (int i = 0; i < p->cell->n_pins; i++) {
+		serialize_string(f, get_net_name(blif, p->nets[i]));
+		fprintf(f, "%s", i != p->cell->n_pins - 1 ? ", " : "");
+	}
 	fprintf(f, "]\n");
 	fprintf(f, "    constraints: 0x%lx\n", p->constraints);
 	fprintf(f, "    margin: %d\n", p->margin);
@@ -59,8 +77,9 @@ static void serialize_routing(FILE *f, struct routed_net *rn)
 		struct coordinate s = rseg.seg.start, e = rseg.seg.end;
 		fprintf(f, "  - (%d, %d, %d) -> (%d, %d, %d):\n", s.y, s.z, s.x, e.y, e.z, e.x);
 		fprintf(f, "    backtrace: [");
-		for (int i = 0; i < rseg.n_backtraces; i++)
-			fprintf(f, "%c%s", serialize_backtrace(rseg.bt[i]), i < rseg.n_backtraces - 1 ? ", " : "");
+		for (int i = 0, k = 0; i < rseg.n_runs; i++)
+			for (int j = 0; j < rseg.runs[i].len; j++, k++)
+				fprintf(f, "%c%s", serialize_backtrace(rseg.runs[i].bt), k < rseg.n_backtraces - 1 ? ", " : "");
 		fprintf(f, "]\n");
 	}
 }
@@ -76,28 +95,818 @@ void serialize_routings(FILE *f, struct routings *rt, struct blif *blif)
 	}
 }
 
+// the blocks (or, with data set, the data) of e, in (y, z, x) order, as a
+// flow sequence; sections of air are written a row at a time
+static void serialize_extraction_values(FILE *f, struct extraction *e, int data)
+{
+	static const char air[] = ",0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0";
+	struct dimensions d = e->dimensions;
+	struct dimensions ns = e->n_sections;
+
+	int first = 1;
+	fprintf(f, "[");
+	for (int y = 0; y < d.y; y++) {
+		for (int z = 0; z < d.z; z++) {
+			struct extraction_section **row = &e->sections[((y >> EXTRACTION_SECTION_BITS) * ns.z + (z >> EXTRACTION_SECTION_BITS)) * ns.x];
+			for (int x = 0; x < d.x; x += EXTRACTION_SECTION_SIZE) {
+				int n = d.x - x < EXTRACTION_SECTION_SIZE ? d.x - x : EXTRACTION_SECTION_SIZE;
+				if (!row[x >> EXTRACTION_SECTION_BITS]) {
+					fwrite(air + first, 1, 2 * n - first, f);
+					first = 0;
+					continue;
+				}
+
+				for (int k = 0; k < n; k++) {
+					data_t da;
+					block_t b = extraction_get(e, (struct coordinate){y, z, x + k}, &da);
+					fprintf(f, first ? "%d" : ",%d", data ? da : b);
+					first = 0;
+				}
+			}
+		}
+	}
+	fprintf(f, "]\n");
+}
+
 void serialize_extraction(FILE *f, struct extraction *e)
 {
 	struct dimensions d = e->dimensions;
 
 	fprintf(f, "extraction:\n");
 	fprintf(f, "  dimensions: [%d, %d, %d]\n", d.y, d.z, d.x);
-	fprintf(f, "  blocks: [");
-	for (int i = 0; i < d.y * d.z * d.x; i++) {
-		fprintf(f, "%d", e->blocks[i]);
+	fprintf(f, "  blocks: ");
+	serialize_extraction_values(f, e, 0);
+	fprintf(f, "  data: ");
+	serialize_extraction_values(f, e, 1);
+}
+
+/* DESERIALIZATION
+
+   placements.yaml and routings.yaml are small enough to load whole, so they
+   are read back as libyaml documents and walked node by node. */
+
+static yaml_node_t *node_at(yaml_document_t *doc, yaml_node_item_t i)
+{
+	return yaml_document_get_node(doc, i);
+}
+
+static char *scalar(yaml_node_t *n)
+{
+	if (!n || n->type != YAML_SCALAR_NODE)
+		return NULL;
+
+	return (char *)n->data.scalar.value;
+}
+
+// the value of the single key of the top-level mapping (e.g., "placements:"),
+// which must be a mapping; NULL if the document is not like that
+static yaml_node_t *load_top_level(yaml_document_t *doc, FILE *f, const char *key)
+{
+	yaml_parser_t parser;
+	yaml_parser_initialize(&parser);
+	yaml_parser_set_input_file(&parser, f);
+	int loaded = yaml_parser_load(&parser, doc);
+	yaml_parser_delete(&parser);
+
+	if (!loaded) {
+		printf("[serializer] could not parse %s\n", key);
+		return NULL;
+	}
+
+	yaml_node_t *root = yaml_document_get_root_node(doc);
+	if (!root || root->type != YAML_MAPPING_NODE ||
+	    root->data.mapping.pairs.top - root->data.mapping.pairs.start != 1) {
+		printf("[serializer] expected a single %s mapping\n", key);
+		return NULL;
+	}
+
+	yaml_node_pair_t *pair = root->data.mapping.pairs.start;
+	char *k = scalar(node_at(doc, pair->key));
+	yaml_node_t *value = node_at(doc, pair->value);
+	if (!k || strcmp(k, key) != 0 || !value || value->type != YAML_MAPPING_NODE) {
+		printf("[serializer] expected a single %s mapping\n", key);
+		return NULL;
+	}
+
+	return value;
+}
+
+static int read_coordinate(char *s, struct coordinate *c)
+{
+	return s && sscanf(s, "(%d, %d, %d)", &c->y, &c->z, &c->x) == 3;
+}
+
+static int read_placement(yaml_document_t *doc, yaml_node_pair_t *pair, struct serialized_placement *sp)
+{
+	sp->cell = NULL;
+	sp->turns = 0;
+	sp->n_nets = 0;
+	sp->nets = NULL;
+	sp->constraints = CONSTR_NONE;
+	sp->margin = 0;
+
+	char *name = scalar(node_at(doc, pair->key));
+	yaml_node_t *value = node_at(doc, pair->value);
+	if (!name || !value || value->type != YAML_MAPPING_NODE)
+		return 0;
+
+	// the key is cell@library
+	size_t len = strcspn(name, "@");
+	sp->cell = malloc(len + 1);
+	memcpy(sp->cell, name, len);
+	sp->cell[len] = '\0';
+
+	int have_placement = 0;
+	for (yaml_node_pair_t *p = value->data.mapping.pairs.start; p < value->data.mapping.pairs.top; p++) {
+		char *k = scalar(node_at(doc, p->key));
+		yaml_node_t *v = node_at(doc, p->value);
+		if (!k || !v)
+			continue;
+
+		if (strcmp(k, "placement") == 0) {
+			have_placement = read_coordinate(scalar(v), &sp->placement);
+		} else if (strcmp(k, "turns") == 0 && scalar(v)) {
+			sp->turns = strtoul(scalar(v), NULL, 0);
+		} else if (strcmp(k, "constraints") == 0 && scalar(v)) {
+			sp->constraints = strtoul(scalar(v), NULL, 0);
+		} else if (strcmp(k, "margin") == 0 && scalar(v)) {
+			sp->margin = strtoul(scalar(v), NULL, 0);
+		} else if (strcmp(k, "nets") == 0 && v->type == YAML_SEQUENCE_NODE) {
+			int n = v->data.sequence.items.top - v->data.sequence.items.start;
+			sp->nets = malloc(n * sizeof(char *));
+			for (yaml_node_item_t *i = v->data.sequence.items.start; i < v->data.sequence.items.top; i++) {
+				char *net = scalar(node_at(doc, *i));
+				sp->nets[sp->n_nets++] = strdup(net ? net : "");
+			}
+		}
+	}
+
+	return have_placement;
+}
+
+// read placements written by serialize_placements; NULL if they cannot be
+// read
+struct serialized_placements *deserialize_placements(FILE *f)
+{
+	yaml_document_t doc;
+	yaml_node_t *placements = load_top_level(&doc, f, "placements");
+	if (!placements) {
+		yaml_document_delete(&doc);
+		return NULL;
+	}
+
+	struct serialized_placements *sp = malloc(sizeof(struct serialized_placements));
+	int n = placements->data.mapping.pairs.top - placements->data.mapping.pairs.start;
+	sp->placements = malloc(n * sizeof(struct serialized_placement));
+	sp->n_placements = 0;
+
+	for (yaml_node_pair_t *pair = placements->data.mapping.pairs.start; pair < placements->data.mapping.pairs.top; pair++) {
+		struct serialized_placement *p = &sp->placements[sp->n_placements];
+		if (read_placement(&doc, pair, p)) {
+			sp->n_placements++;
+		} else {
+			printf("[serializer] skipping a placement that could not be read\n");
+			for (int i = 0; i < p->n_nets; i++)
+				free(p->nets[i]);
+			free(p->nets);
+			free(p->cell);
+		}
+	}
+
+	yaml_document_delete(&doc);
+
+	return sp;
+}
+
+static enum backtrace deserialize_backtrace(char c)
+{
+	switch (c) {
+	case 'U':
+		return BT_UP;
+	case 'D':
+		return BT_DOWN;
+	case 'N':
+		return BT_NORTH;
+	case 'W':
+		return BT_WEST;
+	case 'E':
+		return BT_EAST;
+	case 'S':
+		return BT_SOUTH;
+	default:
+		return BT_START;
+	}
+}
+
+// a segment is written as "start -> end" and, at the same indentation, its
+// backtrace, so that it reads as one mapping of both (with the first key
+// left without a value); a backtrace nested under the first key is taken too
+static int read_segment(yaml_document_t *doc, yaml_node_t *n, struct serialized_segment *ss)
+{
+	ss->n_backtraces = 0;
+	ss->bt = NULL;
+
+	if (!n || n->type != YAML_MAPPING_NODE || n->data.mapping.pairs.top == n->data.mapping.pairs.start)
+		return 0;
+
+	yaml_node_pair_t *pair = n->data.mapping.pairs.start;
+	char *k = scalar(node_at(doc, pair->key));
+	struct coordinate s, e;
+	if (!k || sscanf(k, "(%d, %d, %d) -> (%d, %d, %d)", &s.y, &s.z, &s.x, &e.y, &e.z, &e.x) != 6)
+		return 0;
+	ss->start = s;
+	ss->end = e;
+
+	yaml_node_t *v = node_at(doc, pair->value);
+	if (!v || v->type != YAML_MAPPING_NODE)
+		v = n;
+
+	for (yaml_node_pair_t *p = v->data.mapping.pairs.start; p < v->data.mapping.pairs.top; p++) {
+		char *pk = scalar(node_at(doc, p->key));
+		yaml_node_t *bts = node_at(doc, p->value);
+		if (!pk || strcmp(pk, "backtrace") != 0 || !bts || bts->type != YAML_SEQUENCE_NODE)
+			continue;
+
+		int nb = bts->data.sequence.items.top - bts->data.sequence.items.start;
+		ss->bt = malloc(nb * sizeof(enum backtrace));
+		for (yaml_node_item_t *i = bts->data.sequence.items.start; i < bts->data.sequence.items.top; i++) {
+			char *b = scalar(node_at(doc, *i));
+			ss->bt[ss->n_backtraces++] = deserialize_backtrace(b ? b[0] : '_');
+		}
+	}
+
+	return 1;
+}
+
+// read routings written by serialize_routings; NULL if they cannot be read
+struct serialized_routings *deserialize_routings(FILE *f)
+{
+	yaml_document_t doc;
+	yaml_node_t *routings = load_top_level(&doc, f, "routings");
+	if (!routings) {
+		yaml_document_delete(&doc);
+		return NULL;
+	}
+
+	struct serialized_routings *sr = malloc(sizeof(struct serialized_routings));
+	int n = routings->data.mapping.pairs.top - routings->data.mapping.pairs.start;
+	sr->nets = malloc(n * sizeof(struct serialized_net));
+	sr->n_nets = 0;
+
+	for (yaml_node_pair_t *pair = routings->data.mapping.pairs.start; pair < routings->data.mapping.pairs.top; pair++) {
+		char *name = scalar(node_at(&doc, pair->key));
+		yaml_node_t *segments = node_at(&doc, pair->value);
+		if (!name)
+			continue;
+
+		struct serialized_net *sn = &sr->nets[sr->n_nets++];
+		sn->name = strdup(name);
+		sn->n_segments = 0;
+		sn->segments = NULL;
+
+		// a net without segments is written with an empty value
+		if (!segments || segments->type != YAML_SEQUENCE_NODE)
+			continue;
+
+		int ns = segments->data.sequence.items.top - segments->data.sequence.items.start;
+		sn->segments = malloc(ns * sizeof(struct serialized_segment));
+		for (yaml_node_item_t *i = segments->data.sequence.items.start; i < segments->data.sequence.items.top; i++) {
+			struct serialized_segment *ss = &sn->segments[sn->n_segments];
+			if (read_segment(&doc, node_at(&doc, *i), ss))
+				sn->n_segments++;
+			else
+				free(ss->bt);
+		}
+	}
+
+	yaml_document_delete(&doc);
+
+	return sr;
+}
+
+void free_serialized_placements(struct serialized_placements *sp)
+{
+	for (int i = 0; i < sp->n_placements; i++) {
+		for (int j = 0; j < sp->placements[i].n_nets; j++)
+			free(sp->placements[i].nets[j]);
+		free(sp->placements[i].nets);
+		free(sp->placements[i].cell);
+	}
+	free(sp->placements);
+	free(sp);
+}
+
+void free_serialized_routings(struct serialized_routings *sr)
+{
+	for (int i = 0; i < sr->n_nets; i++) {
+		for (int j = 0; j < sr->nets[i].n_segments; j++)
+			free(sr->nets[i].segments[j].bt);
+		free(sr->nets[i].segments);
+		free(sr->nets[i].name);
+	}
+	free(sr->nets);
+	free(sr);
+}
+
+// read the integers of the sequence that follows into v (of up to n),
+// returning how many there were, or -1 if there is no sequence
+static int read_int_sequence(yaml_parser_t *parser, int *v, int n)
+{
+	yaml_event_t event;
+	if (!yaml_parser_parse(parser, &event))
+		return -1;
+
+	int is_sequence = event.type == YAML_SEQUENCE_START_EVENT;
+	yaml_event_delete(&event);
+	if (!is_sequence)
+		return -1;
+
+	int count = 0;
+	for (;;) {
+		if (!yaml_parser_parse(parser, &event))
+			return -1;
+
+		if (event.type == YAML_SEQUENCE_END_EVENT) {
+			yaml_event_delete(&event);
+			return count;
+		}
+
+		if (event.type != YAML_SCALAR_EVENT || count >= n) {
+			yaml_event_delete(&event);
+			return -1;
+		}
+
+		v[count++] = atoi((char *)event.data.scalar.value);
+		yaml_event_delete(&event);
+	}
+}
+
+// read the blocks (or, with data set, the data) of e that follow, in (y, z,
+// x) order, returning how many there were, or -1 if there is no sequence
+static int read_extraction_values(yaml_parser_t *parser, struct extraction *e, int data)
+{
+	yaml_event_t event;
+	if (!yaml_parser_parse(parser, &event))
+		return -1;
+
+	int is_sequence = event.type == YAML_SEQUENCE_START_EVENT;
+	yaml_event_delete(&event);
+	if (!is_sequence)
+		return -1;
+
+	struct dimensions d = e->dimensions;
+	int size = d.y * d.z * d.x;
+	int count = 0;
+	for (;;) {
+		if (!yaml_parser_parse(parser, &event))
+			return -1;
+
+		if (event.type == YAML_SEQUENCE_END_EVENT) {
+			yaml_event_delete(&event);
+			return count;
+		}
+
+		if (event.type != YAML_SCALAR_EVENT || count >= size) {
+			yaml_event_delete(&event);
+			return -1;
+		}
+
+		int v = atoi((char *)event.data.scalar.value);
+		yaml_event_delete(&event);
+
+		// air stays unset, so that only sections with blocks are made
+		if (v) {
+			struct coordinate c = {count / d.x / d.z, count / d.x % d.z, count % d.x};
+			data_t da;
+			block_t b = extraction_get(e, c, &da);
+			if (data)
+				extraction_set(e, c, b, v);
+			else
+				extraction_set(e, c, v, da);
+		}
+		count++;
+	}
+}
+
+/* read an extraction written by serialize_extraction; NULL if it cannot be
+   read. the block arrays can hold millions of entries, so they are read
+   as a stream of events rather than loaded as a document */
+struct extraction *deserialize_extraction(FILE *f)
+{
+	yaml_parser_t parser;
+	yaml_parser_initialize(&parser);
+	yaml_parser_set_input_file(&parser, f);
+
+	struct extraction *e = NULL;
+	int size = -1, have_blocks = 0, have_data = 0;
+
+	yaml_event_t event;
+	int done = 0, failed = 0;
+	while (!done && !failed) {
+		if (!yaml_parser_parse(&parser, &event)) {
+			failed = 1;
+			break;
+		}
+
+		if (event.type == YAML_STREAM_END_EVENT) {
+			done = 1;
+		} else if (event.type == YAML_SCALAR_EVENT) {
+			char *key = (char *)event.data.scalar.value;
+			if (strcmp(key, "dimensions") == 0) {
+				int d[3];
+				if (e || read_int_sequence(&parser, d, 3) != 3 || d[0] < 0 || d[1] < 0 || d[2] < 0) {
+					failed = 1;
+				} else {
+					e = new_extraction((struct dimensions){d[0], d[1], d[2]});
+					size = d[0] * d[1] * d[2];
+				}
+			} else if (strcmp(key, "blocks") == 0 || strcmp(key, "data") == 0) {
+				// the dimensions come first
+				int is_blocks = key[0] == 'b';
+				if (size < 0 || read_extraction_values(&parser, e, !is_blocks) != size) {
+					failed = 1;
+				} else {
+					have_blocks |= is_blocks;
+					have_data |= !is_blocks;
+				}
+			}
+		}
 
-		if (i + 1 < d.y * d.z * d.x)
-			fprintf(f, ",");
-		else
-			fprintf(f, "]\n");
+		yaml_event_delete(&event);
 	}
 
-	fprintf(f, "  data: [");
-	for (int i = 0; i < d.y * d.z * d.x; i++) {
-		fprintf(f, "%d", e->data[i]);
-		if (i + 1 < d.y * d.z * d.x)
-			fprintf(f, ",");
-		else
-			fprintf(f, "]\n");
+	yaml_parser_delete(&parser);
+
+	if (failed || !have_blocks || !have_data) {
+		printf("[serializer] could not read the extraction\n");
+		if (e)
+			free_extraction(e);
+		return NULL;
+	}
+
+	return e;
+}
+
+/* BINARY PLACEMENTS AND ROUTINGS
+
+   YAML is slow to write, and slower to read back, for large designs, so
+   placements and routings can also be written in binary:
+     "DEWEYPLC" (or "DEWEYRTE"), and a uint32 version;
+   for placements, the number of nets and each net's name, then the number
+   of placements and, for each, its logic cell's name, its placement (y, z
+   and x as int32), turns (uint8), constraints and margin (uint32), and the
+   number of its nets (uint16) with each net (uint32, into the names);
+   for routings, the number of nets and, for each, its name and number of
+   segments; each segment is its start and end (int32 y, z, x each), and
+   its path from end to start as a number of runs, each a backtrace (uint8,
+   as the letter written in YAML) and its length (uint32).
+   strings are a uint16 length and their bytes; everything is little-endian.
+   a version is only ever added to, so a reader refuses versions newer than
+   its own. */
+
+#define BINARY_VERSION 1
+#define BINARY_MAGIC_LEN 8
+#define PLACEMENTS_MAGIC "DEWEYPLC"
+#define ROUTINGS_MAGIC "DEWEYRTE"
+
+// more steps than the paths of any design that fits in a world, all told;
+// each step read takes memory, however few bytes the file spends on it
+#define BINARY_MAX_STEPS (1 << 24)
+
+static void put_u8(FILE *f, uint8_t v)
+{
+	fputc(v, f);
+}
+
+static void put_u16(FILE *f, uint16_t v)
+{
+	unsigned char b[2] = {v & 0xff, v >> 8};
+	fwrite(b, 1, 2, f);
+}
+
+static void put_u32(FILE *f, uint32_t v)
+{
+	unsigned char b[4] = {v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, v >> 24};
+	fwrite(b, 1, 4, f);
+}
+
+static void put_string(FILE *f, const char *s)
+{
+	size_t len = strlen(s);
+	put_u16(f, len);
+	fwrite(s, 1, len, f);
+}
+
+static void put_coordinate(FILE *f, struct coordinate c)
+{
+	put_u32(f, c.y);
+	put_u32(f, c.z);
+	put_u32(f, c.x);
+}
+
+static void put_header(FILE *f, const char *magic)
+{
+	fwrite(magic, 1, BINARY_MAGIC_LEN, f);
+	put_u32(f, BINARY_VERSION);
+}
+
+void serialize_placements_binary(FILE *f, struct cell_placements *cp, struct blif *blif)
+{
+	put_header(f, PLACEMENTS_MAGIC);
+
+	put_u32(f, blif->n_nets - 1);
+	for (net_t i = 1; i < blif->n_nets; i++)
+		put_string(f, get_net_name(blif, i));
+
+	put_u32(f, cp->n_placements);
+	for (int i = 0; i < cp->n_placements; i++) {
+		struct placement *p = &cp->placements[i];
+		put_string(f, p->cell->name);
+		put_coordinate(f, p->placement);
+		put_u8(f, p->turns);
+		put_u32(f, p->constraints);
+		put_u32(f, p->margin);
+		put_u16(f, p->cell->n_pins);
+		for (int k = 0; k < p->cell->n_pins; k++)
+			put_u32(f, p->nets[k] - 1);
+	}
+}
+
+void serialize_routings_binary(FILE *f, struct routings *rt, struct blif *blif)
+{
+	put_header(f, ROUTINGS_MAGIC);
+
+	put_u32(f, rt->n_routed_nets);
+	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
+		struct routed_net *rn = &rt->routed_nets[i];
+		put_string(f, get_net_name(blif, i));
+
+		int n_segments = 0;
+		for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next)
+			n_segments++;
+		put_u32(f, n_segments);
+
+		for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next) {
+			struct routed_segment *rseg = &rsh->rseg;
+			put_coordinate(f, rseg->seg.start);
+			put_coordinate(f, rseg->seg.end);
+			put_u32(f, rseg->n_runs);
+			for (int r = 0; r < rseg->n_runs; r++) {
+				put_u8(f, serialize_backtrace(rseg->runs[r].bt));
+				put_u32(f, rseg->runs[r].len);
+			}
+		}
+	}
+}
+
+// a whole binary file, read into memory, and how far it has been read
+struct binary_reader {
+	unsigned char *b;
+	size_t n, pos;
+	int failed;
+};
+
+static int read_whole_file(FILE *f, struct binary_reader *r)
+{
+	size_t sz = 4096;
+	r->b = malloc(sz);
+	r->n = 0;
+	r->pos = 0;
+	r->failed = 0;
+
+	size_t got;
+	while ((got = fread(r->b + r->n, 1, sz - r->n, f)) > 0) {
+		r->n += got;
+		if (r->n == sz) {
+			sz *= 2;
+			r->b = realloc(r->b, sz);
+		}
+	}
+
+	return !ferror(f);
+}
+
+static const unsigned char *take(struct binary_reader *r, size_t n)
+{
+	if (r->failed || n > r->n - r->pos) {
+		r->failed = 1;
+		return NULL;
+	}
+
+	const unsigned char *p = r->b + r->pos;
+	r->pos += n;
+	return p;
+}
+
+static uint32_t take_le(struct binary_reader *r, int n)
+{
+	const unsigned char *p = take(r, n);
+	uint32_t v = 0;
+	for (int i = n - 1; p && i >= 0; i--)
+		v = v << 8 | p[i];
+	return v;
+}
+
+static char *take_string(struct binary_reader *r)
+{
+	size_t len = take_le(r, 2);
+	const unsigned char *p = take(r, len);
+	char *s = malloc(len + 1);
+	if (p)
+		memcpy(s, p, len);
+	s[p ? len : 0] = '\0';
+	return s;
+}
+
+static struct coordinate take_coordinate(struct binary_reader *r)
+{
+	struct coordinate c;
+	c.y = (int32_t)take_le(r, 4);
+	c.z = (int32_t)take_le(r, 4);
+	c.x = (int32_t)take_le(r, 4);
+	return c;
+}
+
+// a count of things each at least size bytes long, which must all fit in
+// what is left to read
+static int take_count(struct binary_reader *r, size_t size)
+{
+	uint32_t n = take_le(r, 4);
+	if (r->failed || n > (r->n - r->pos) / size || n > INT32_MAX) {
+		r->failed = 1;
+		return 0;
+	}
+
+	return n;
+}
+
+// check the magic and version of r; 0 if it is not a binary file of this
+// kind that can be read
+static int take_header(struct binary_reader *r, const char *magic, const char *what)
+{
+	const unsigned char *m = take(r, BINARY_MAGIC_LEN);
+	if (!m || memcmp(m, magic, BINARY_MAGIC_LEN) != 0) {
+		printf("[serializer] not binary %s\n", what);
+		return 0;
+	}
+
+	uint32_t version = take_le(r, 4);
+	if (r->failed || version > BINARY_VERSION) {
+		printf("[serializer] %s are of version %u, newer than this dewey reads (%u)\n", what, version, BINARY_VERSION);
+		return 0;
+	}
+
+	return 1;
+}
+
+// read placements written by serialize_placements_binary; NULL if they
+// cannot be read
+struct serialized_placements *deserialize_placements_binary(FILE *f)
+{
+	struct binary_reader r;
+	if (!read_whole_file(f, &r) || !take_header(&r, PLACEMENTS_MAGIC, "placements")) {
+		free(r.b);
+		return NULL;
+	}
+
+	int n_names = take_count(&r, 2);
+	char **names = malloc((n_names + 1) * sizeof(char *));
+	for (int i = 0; i < n_names; i++)
+		names[i] = take_string(&r);
+
+	struct serialized_placements *sp = malloc(sizeof(struct serialized_placements));
+	int n = take_count(&r, 25);
+	sp->placements = malloc((n + 1) * sizeof(struct serialized_placement));
+	sp->n_placements = 0;
+
+	for (int i = 0; i < n && !r.failed; i++) {
+		struct serialized_placement *p = &sp->placements[sp->n_placements++];
+		p->cell = take_string(&r);
+		p->placement = take_coordinate(&r);
+		p->turns = take_le(&r, 1);
+		if (p->turns > 3)
+			r.failed = 1;
+		p->constraints = take_le(&r, 4);
+		p->margin = take_le(&r, 4);
+
+		p->n_nets = take_le(&r, 2);
+		p->nets = malloc((p->n_nets + 1) * sizeof(char *));
+		for (int k = 0; k < p->n_nets; k++) {
+			uint32_t net = take_le(&r, 4);
+			const char *name = !r.failed && net < n_names ? names[net] : "";
+			p->nets[k] = malloc(strlen(name) + 1);
+			strcpy(p->nets[k], name);
+		}
+	}
+
+	for (int i = 0; i < n_names; i++)
+		free(names[i]);
+	free(names);
+	free(r.b);
+
+	if (r.failed) {
+		printf("[serializer] binary placements are cut short\n");
+		free_serialized_placements(sp);
+		return NULL;
 	}
+
+	return sp;
+}
+
+// read routings written by serialize_routings_binary; NULL if they cannot
+// be read
+struct serialized_routings *deserialize_routings_binary(FILE *f)
+{
+	struct binary_reader r;
+	if (!read_whole_file(f, &r) || !take_header(&r, ROUTINGS_MAGIC, "routings")) {
+		free(r.b);
+		return NULL;
+	}
+
+	struct serialized_routings *sr = malloc(sizeof(struct serialized_routings));
+	int n = take_count(&r, 6);
+	sr->nets = malloc((n + 1) * sizeof(struct serialized_net));
+	sr->n_nets = 0;
+	long steps = 0;
+
+	for (int i = 0; i < n && !r.failed; i++) {
+		struct serialized_net *sn = &sr->nets[sr->n_nets++];
+		sn->name = take_string(&r);
+
+		int ns = take_count(&r, 28);
+		sn->segments = malloc((ns + 1) * sizeof(struct serialized_segment));
+		sn->n_segments = 0;
+		for (int s = 0; s < ns && !r.failed; s++) {
+			struct serialized_segment *ss = &sn->segments[sn->n_segments++];
+			ss->start = take_coordinate(&r);
+			ss->end = take_coordinate(&r);
+			ss->n_backtraces = 0;
+			ss->bt = NULL;
+
+			int n_runs = take_count(&r, 5);
+			size_t at = r.pos;
+			long total = 0;
+			for (int k = 0; k < n_runs && !r.failed; k++) {
+				take_le(&r, 1);
+				total += take_le(&r, 4);
+			}
+
+			steps += total;
+			if (!r.failed && steps > BINARY_MAX_STEPS) {
+				printf("[serializer] binary routings have more than %d steps\n", BINARY_MAX_STEPS);
+				r.failed = 1;
+			}
+			if (r.failed)
+				break;
+
+			r.pos = at;
+			ss->bt = malloc((total + 1) * sizeof(enum backtrace));
+			for (int k = 0; k < n_runs; k++) {
+				enum backtrace bt = deserialize_backtrace(take_le(&r, 1));
+				uint32_t len = take_le(&r, 4);
+				for (uint32_t j = 0; j < len; j++)
+					ss->bt[ss->n_backtraces++] = bt;
+			}
+		}
+	}
+
+	free(r.b);
+
+	if (r.failed) {
+		if (steps <= BINARY_MAX_STEPS)
+			printf("[serializer] binary routings are cut short\n");
+		free_serialized_routings(sr);
+		return NULL;
+	}
+
+	return sr;
+}
+
+// whether f starts with magic; f is left where it was
+static int starts_with(FILE *f, const char *magic)
+{
+	char m[BINARY_MAGIC_LEN];
+	long at = ftell(f);
+	int is = fread(m, 1, BINARY_MAGIC_LEN, f) == BINARY_MAGIC_LEN && memcmp(m, magic, BINARY_MAGIC_LEN) == 0;
+	fseek(f, at, SEEK_SET);
+
+	return is;
+}
+
+// read placements in either format; NULL if they cannot be read
+struct serialized_placements *load_placements(FILE *f)
+{
+	if (starts_with(f, PLACEMENTS_MAGIC))
+		return deserialize_placements_binary(f);
+
+	return deserialize_placements(f);
+}
+
+// read routings in either format; NULL if they cannot be read
+struct serialized_routings *load_routings(FILE *f)
+{
+	if (starts_with(f, ROUTINGS_MAGIC))
+		return deserialize_routings_binary(f);
+
+	return deserialize_routings(f);
 }
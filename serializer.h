@@ -6,8 +6,61 @@
 #include "base_router.h"
 #include "extract.h"
 
+// placements and routings read back from what serialize_placements and
+// serialize_routings wrote, with cells and nets named rather than resolved
+// against a BLIF
+struct serialized_placement {
+	char *cell; // name of the logic cell
+	struct coordinate placement;
+	unsigned long turns;
+
+	int n_nets;
+	char **nets;
+
+	unsigned long constraints;
+	unsigned int margin;
+};
+
+struct serialized_placements {
+	int n_placements;
+	struct serialized_placement *placements;
+};
+
+struct serialized_segment {
+	struct coordinate start, end;
+
+	// the path from end back to start
+	int n_backtraces;
+	enum backtrace *bt;
+};
+
+struct serialized_net {
+	char *name;
+
+	int n_segments;
+	struct serialized_segment *segments;
+};
+
+struct serialized_routings {
+	int n_nets;
+	struct serialized_net *nets;
+};
+
 void serialize_placements(FILE *, struct cell_placements *, struct blif *);
 void serialize_routings(FILE *, struct routings *, struct blif *);
 void serialize_extraction(FILE *, struct extraction *);
 
+void serialize_placements_binary(FILE *, struct cell_placements *, struct blif *);
+void serialize_routings_binary(FILE *, struct routings *, struct blif *);
+
+struct serialized_placements *deserialize_placements(FILE *);
+struct serialized_routings *deserialize_routings(FILE *);
+struct serialized_placements *deserialize_placements_binary(FILE *);
+struct serialized_routings *deserialize_routings_binary(FILE *);
+struct serialized_placements *load_placements(FILE *);
+struct serialized_routings *load_routings(FILE *);
+void free_serialized_placements(struct serialized_placements *);
+void free_serialized_routings(struct serialized_routings *);
+struct extraction *deserialize_extraction(FILE *);
+
 #endif /* __SERIALIZER_H__ */
@@ -6,15 +6,79 @@
 #include <string.h>
 
 inline int usage_idx(struct usage_matrix *m, struct coordinate c) {
-	return (c.y * m->d.z * m->d.x) + (c.z * m->d.x) + c.x;
+	return ((c.y - m->origin.y) * m->d.z * m->d.x) + ((c.z - m->origin.z) * m->d.x) + (c.x - m->origin.x);
 }
 
-inline void usage_mark(struct usage_matrix *m, struct coordinate c) {
-	m->matrix[usage_idx(m, c)]++;
+// position of c's bit in m->blocked (c relative to m->origin)
+static inline int blocked_word(struct usage_matrix *m, struct coordinate c)
+{
+	return (c.y * m->d.z + c.z) * m->row_words + (c.x >> 6);
+}
+
+static inline uint64_t blocked_bit(struct coordinate c)
+{
+	return (uint64_t)1 << (c.x & 63);
+}
+
+// the blocks (relative to m->origin) whose bits depend on a mark at c are
+// those within one block in x and z, on c's level or the one above
+#define for_dilation(m, c, a) \
+	for (int a##y = max(c.y, 0); a##y <= min(c.y + 1, (int)m->d.y - 1); a##y++) \
+	for (int a##z = max(c.z - 1, 0); a##z <= min(c.z + 1, (int)m->d.z - 1); a##z++) \
+	for (int a##x = max(c.x - 1, 0); a##x <= min(c.x + 1, (int)m->d.x - 1); a##x++)
+
+void usage_mark(struct usage_matrix *m, struct coordinate c)
+{
+	if (m->matrix[usage_idx(m, c)]++)
+		return;
+
+	c = coordinate_sub(c, m->origin);
+	for_dilation(m, c, a) {
+		struct coordinate ac = {ay, az, ax};
+		m->blocked[blocked_word(m, ac)] |= blocked_bit(ac);
+	}
+}
+
+// recompute the bit of block a (relative to m->origin) from the marks
+// around it within m
+static void update_blocked(struct usage_matrix *m, struct coordinate a)
+{
+	int marked = 0;
+	for (int y = max(a.y - 1, 0); y <= a.y && !marked; y++)
+		for (int z = max(a.z - 1, 0); z <= min(a.z + 1, (int)m->d.z - 1) && !marked; z++)
+			for (int x = max(a.x - 1, 0); x <= min(a.x + 1, (int)m->d.x - 1) && !marked; x++)
+				marked = m->matrix[(y * m->d.z + z) * m->d.x + x] != 0;
+
+	uint64_t *w = &m->blocked[blocked_word(m, a)];
+	if (marked)
+		*w |= blocked_bit(a);
+	else
+		*w &= ~blocked_bit(a);
+}
+
+// take back one usage_mark of c
+void usage_unmark(struct usage_matrix *m, struct coordinate c)
+{
+	int idx = usage_idx(m, c);
+	if (!m->matrix[idx] || --m->matrix[idx])
+		return;
+
+	c = coordinate_sub(c, m->origin);
+	for_dilation(m, c, a)
+		update_blocked(m, (struct coordinate){ay, az, ax});
 }
 
 int in_usage_bounds(struct usage_matrix *m, struct coordinate c)
 {
+	return c.x >= m->tl.x && c.x <= m->br.x &&
+	       c.y >= m->tl.y && c.y <= m->br.y &&
+	       c.z >= m->tl.z && c.z <= m->br.z;
+}
+
+// whether c is held in m at all, ring included
+static int in_usage_matrix(struct usage_matrix *m, struct coordinate c)
+{
+	c = coordinate_sub(c, m->origin);
 	return c.x >= 0 && c.x < m->d.x &&
 	       c.y >= 0 && c.y < m->d.y &&
 	       c.z >= 0 && c.z < m->d.z;
@@ -34,11 +98,11 @@ static void tunnel_to_margin(struct placement *p, struct usage_matrix *m)
 	int sx = 0, ex = 0;
 	int sz = p->placement.z - 1, ez = p->placement.z + 1;
 	if (p->constraints & CONSTR_KEEP_LEFT) {
-		sx = 0;
+		sx = m->origin.x;
 		ex = p->placement.x;
 	} else if (p->constraints & CONSTR_KEEP_RIGHT) {
 		sx = p->placement.x;
-		ex = m->d.x;
+		ex = m->origin.x + m->d.x;
 	}
 
 	for (int x = sx; x < ex; x++)
@@ -46,31 +110,48 @@ static void tunnel_to_margin(struct placement *p, struct usage_matrix *m)
 			usage_mark(m, (struct coordinate){0, z, x});
 }
 
-/* create a usage_matrix that marks where blocks from existing cell placements
-   and routed nets occupy the grid. */
-struct usage_matrix *create_usage_matrix(struct cell_placements *cp, struct routings *rt, int xz_margin)
+struct usage_matrix *create_empty_usage_matrix(struct coordinate origin, struct dimensions d, int xz_margin)
+{
+	struct usage_matrix *m = malloc(sizeof(struct usage_matrix));
+	m->d = d;
+	m->origin = origin;
+	m->tl = origin;
+	m->br = (struct coordinate){origin.y + d.y - 1, origin.z + d.z - 1, origin.x + d.x - 1};
+	m->base = origin;
+	m->bounds = d;
+	m->xz_margin = xz_margin;
+	m->matrix = calloc(d.x * d.y * d.z, sizeof(unsigned char));
+	m->row_words = (d.x + 63) / 64;
+	m->blocked = calloc(d.y * d.z * m->row_words, sizeof(uint64_t));
+
+	return m;
+}
+
+// the region create_placement_usage_matrix lays over the design: where it
+// stands, with xz_margin blocks to spare on every side in x and z
+static void usage_region(struct cell_placements *cp, struct routings *rt, int xz_margin, struct coordinate *origin, struct dimensions *d)
 {
 	struct coordinate tlcp = placements_top_left_most_point(cp);
 	struct coordinate tlrt = routings_top_left_most_point(rt);
 	struct coordinate top_left_most = coordinate_piecewise_min(tlcp, tlrt);
 
-	assert(top_left_most.x >= xz_margin && top_left_most.y >= 0 && top_left_most.z >= xz_margin);
+	assert(top_left_most.y >= 0);
 
 	// size the usage matrix and allow for routing on y=0 and y=3
-	struct dimensions d = dimensions_piecewise_max(compute_placement_dimensions(cp), compute_routings_dimensions(rt));
-	assert(d.x > 0 && d.x < 1000 && d.z > 0 && d.z < 1000);
-	d.y = max(d.y, 7);
-	d.z += xz_margin;
-	d.x += xz_margin;
-	// printf("[usage_matrix] size is %dx%dx%d\n", d.y, d.z, d.x);
+	*origin = (struct coordinate){0, top_left_most.z - xz_margin, top_left_most.x - xz_margin};
+	struct coordinate end = design_end_point(cp, rt);
+	*d = (struct dimensions){max(end.y, 7), end.z + xz_margin - origin->z, end.x + xz_margin - origin->x};
+	assert(d->x > 0 && d->x < 1000 && d->z > 0 && d->z < 1000);
+	// printf("[usage_matrix] size is %dx%dx%d\n", d->y, d->z, d->x);
+}
 
-	struct usage_matrix *m = malloc(sizeof(struct usage_matrix));
-	m->d = d;
-	m->xz_margin = xz_margin;
-	m->matrix = malloc(d.x * d.y * d.z * sizeof(unsigned char));
-	memset(m->matrix, 0, d.x * d.y * d.z * sizeof(unsigned char));
+// mark the blocks of the cell placements (as far as they lie within m), and
+// tunnel the top-level pins to its edges
+static void mark_placements(struct usage_matrix *m, struct cell_placements *cp)
+{
+	struct coordinate origin = m->origin;
+	struct dimensions d = m->d;
 
-	/* placements */
 	for (int i = 0; i < cp->n_placements; i++) {
 		struct placement p = cp->placements[i];
 		struct coordinate c = p.placement;
@@ -80,8 +161,8 @@ struct usage_matrix *create_usage_matrix(struct cell_placements *cp, struct rout
 		int cell_y = c.y + pd.y;
 		int cell_z = c.z + pd.z;
 
-		int z1 = max(0, c.z), z2 = min(d.z, cell_z);
-		int x1 = max(0, c.x), x2 = min(d.x, cell_x);
+		int z1 = max(origin.z, c.z), z2 = min(origin.z + d.z, cell_z);
+		int x1 = max(origin.x, c.x), x2 = min(origin.x + d.x, cell_x);
 		int y2 = min(cell_y + 1, d.y);
 
 		for (int y = c.y; y < y2; y++) {
@@ -97,22 +178,47 @@ struct usage_matrix *create_usage_matrix(struct cell_placements *cp, struct rout
 		if (is_toplevel_pin(&p))
 			tunnel_to_margin(&p, m);
 	}
+}
+
+/* create a usage_matrix that marks where blocks from existing cell placements
+   occupy the grid, sized to hold the routed nets as well. the matrix is laid
+   over the design where it stands, with xz_margin blocks to spare on every
+   side in x and z, so nothing has to move when the design grows. */
+struct usage_matrix *create_placement_usage_matrix(struct cell_placements *cp, struct routings *rt, int xz_margin)
+{
+	struct coordinate origin;
+	struct dimensions d;
+	usage_region(cp, rt, xz_margin, &origin, &d);
+
+	struct usage_matrix *m = create_empty_usage_matrix(origin, d, xz_margin);
+	mark_placements(m, cp);
+
+	return m;
+}
 
+/* create a usage_matrix that marks where blocks from existing cell placements
+   and routed nets occupy the grid. */
+struct usage_matrix *create_usage_matrix(struct cell_placements *cp, struct routings *rt, int xz_margin)
+{
+	struct usage_matrix *m = create_placement_usage_matrix(cp, rt, xz_margin);
 
 	/* routings */
 	for (net_t i = 1; i < rt->n_routed_nets + 1; i++) {
 		for (struct routed_segment_head *rsh = rt->routed_nets[i].routed_segments; rsh; rsh = rsh->next) {
 			struct coordinate c = rsh->rseg.seg.end;
-			for (int k = 0; k < rsh->rseg.n_backtraces; k++) {
-				// here
-				c = disp_backtrace(c, rsh->rseg.bt[k]);
-				usage_mark(m, c);
-
-				// below
-				struct coordinate c2 = c;
-				c2.y--;
-				if (in_usage_bounds(m, c2))
-					usage_mark(m, c2);
+			for (int r = 0; r < rsh->rseg.n_runs; r++) {
+				struct coordinate step = backtrace_step(rsh->rseg.runs[r].bt);
+				for (int k = 0; k < rsh->rseg.runs[r].len; k++) {
+					// here
+					c = coordinate_add(c, step);
+					usage_mark(m, c);
+
+					// below
+					struct coordinate c2 = c;
+					c2.y--;
+					if (in_usage_bounds(m, c2))
+						usage_mark(m, c2);
+				}
 			}
 		}
 	}
@@ -120,25 +226,224 @@ struct usage_matrix *create_usage_matrix(struct cell_placements *cp, struct rout
 	return m;
 }
 
-int usage_matrix_violated(struct usage_matrix *m, struct coordinate c)
+// undo the marks create_usage_matrix made for the segments of rn, in the
+// ring of a window too
+void usage_unmark_net(struct usage_matrix *m, struct routed_net *rn)
 {
-	// [yzx]2 DOES include that coordinate
-	int y1 = max(c.y - 1, 0), y2 = min(c.y, m->d.y - 1);
-	int z1 = max(c.z - 1, 0), z2 = min(c.z + 1, m->d.z - 1);
-	int x1 = max(c.x - 1, 0), x2 = min(c.x + 1, m->d.x - 1);
-
-	for (int y = y1; y <= y2; y++) {
-		int dy = y * m->d.z * m->d.x;
-		for (int z = z1; z <= z2; z++) {
-			int dz = z * m->d.x;
-			for (int x = x1; x <= x2; x++) {
-				int idx = dy + dz + x;
-				if (m->matrix[idx])
-					return 1;
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next) {
+		struct coordinate c = rsh->rseg.seg.end;
+		for (int r = 0; r < rsh->rseg.n_runs; r++) {
+			struct coordinate step = backtrace_step(rsh->rseg.runs[r].bt);
+			for (int k = 0; k < rsh->rseg.runs[r].len; k++) {
+				c = coordinate_add(c, step);
+				struct coordinate below = {c.y - 1, c.z, c.x};
+
+				if (in_usage_matrix(m, c))
+					usage_unmark(m, c);
+				if (in_usage_matrix(m, below))
+					usage_unmark(m, below);
 			}
 		}
 	}
+}
 
-	return 0;
+/* copy the part of m between tl and br (inclusive, and clipped to m) into a
+   smaller matrix, to be routed in, along with the ring of one block around
+   it; windows span the full height of m */
+struct usage_matrix *usage_matrix_window(struct usage_matrix *m, struct coordinate tl, struct coordinate br)
+{
+	struct coordinate m_br = {m->origin.y + m->d.y - 1, m->origin.z + m->d.z - 1, m->origin.x + m->d.x - 1};
+	tl = coordinate_piecewise_max(tl, m->tl);
+	br = coordinate_piecewise_min(br, m->br);
+	tl.y = m->tl.y;
+	br.y = m->br.y;
+	assert(tl.z <= br.z && tl.x <= br.x);
+
+	struct usage_matrix *w = malloc(sizeof(struct usage_matrix));
+	*w = *m;
+	w->tl = tl;
+	w->br = br;
+
+	struct coordinate ring = {0, 1, 1};
+	tl = coordinate_piecewise_max(coordinate_sub(tl, ring), m->origin);
+	br = coordinate_piecewise_min(coordinate_add(br, ring), m_br);
+	w->origin = tl;
+	w->d = (struct dimensions){br.y - tl.y + 1, br.z - tl.z + 1, br.x - tl.x + 1};
+	w->matrix = malloc(USAGE_SIZE(w) * sizeof(unsigned char));
+	w->row_words = (w->d.x + 63) / 64;
+	w->blocked = malloc(w->d.y * w->d.z * w->row_words * sizeof(uint64_t));
+
+	for (int y = tl.y; y <= br.y; y++) {
+		for (int z = tl.z; z <= br.z; z++) {
+			struct coordinate row = {y, z, tl.x};
+			memcpy(&w->matrix[usage_idx(w, row)], &m->matrix[usage_idx(m, row)], w->d.x * sizeof(unsigned char));
+
+			// shift the row's bits down to the window's first block
+			struct coordinate mr = coordinate_sub(row, m->origin), wr = coordinate_sub(row, w->origin);
+			uint64_t *src = &m->blocked[blocked_word(m, (struct coordinate){mr.y, mr.z, 0})];
+			uint64_t *dst = &w->blocked[blocked_word(w, wr)];
+			int shift = mr.x & 63, first = mr.x >> 6;
+			for (int i = 0; i < w->row_words; i++) {
+				uint64_t bits = src[first + i] >> shift;
+				if (shift && first + i + 1 < m->row_words)
+					bits |= src[first + i + 1] << (64 - shift);
+				dst[i] = bits;
+			}
+			if (w->d.x & 63)
+				dst[w->row_words - 1] &= ((uint64_t)1 << (w->d.x & 63)) - 1;
+		}
+	}
+
+	return w;
+}
+
+// whether m may be routed in all over the matrix it was cut from
+int usage_matrix_is_full(struct usage_matrix *m)
+{
+	struct dimensions d = {m->br.y - m->tl.y + 1, m->br.z - m->tl.z + 1, m->br.x - m->tl.x + 1};
+	return coordinate_equal(m->tl, m->base) &&
+	       d.y == m->bounds.y && d.z == m->bounds.z && d.x == m->bounds.x;
+}
+
+void free_usage_matrix(struct usage_matrix *m)
+{
+	free(m->blocked);
+	free(m->matrix);
+	free(m);
+}
+
+#define USAGE_SLACK 16
+
+// mark c for nu, if m holds it
+static void net_usage_mark(struct usage_matrix *m, struct net_usage *nu, struct coordinate c)
+{
+	if (!in_usage_matrix(m, c))
+		return;
+
+	usage_mark(m, c);
+	if (nu->n_marked == nu->size) {
+		nu->size = nu->size ? nu->size * 2 : 16;
+		nu->marked = realloc(nu->marked, nu->size * sizeof(struct coordinate));
+	}
+	nu->marked[nu->n_marked++] = c;
+}
+
+// make the marks of create_usage_matrix for the segments of rn, and keep
+// them to be taken back when rn changes
+static void routing_usage_mark_net(struct routing_usage *u, struct routed_net *rn)
+{
+	struct net_usage *nu = &u->nets[rn->net];
+	for (struct routed_segment_head *rsh = rn->routed_segments; rsh; rsh = rsh->next) {
+		struct coordinate c = rsh->rseg.seg.end;
+		for (int r = 0; r < rsh->rseg.n_runs; r++) {
+			struct coordinate step = backtrace_step(rsh->rseg.runs[r].bt);
+			for (int k = 0; k < rsh->rseg.runs[r].len; k++) {
+				c = coordinate_add(c, step);
+				net_usage_mark(u->m, nu, c);
+				net_usage_mark(u->m, nu, (struct coordinate){c.y - 1, c.z, c.x});
+			}
+		}
+	}
+}
+
+static struct routing_usage *create_routing_usage(struct cell_placements *cp, struct routings *rt, int xz_margin, struct coordinate origin, struct dimensions d)
+{
+	struct routing_usage *u = malloc(sizeof(struct routing_usage));
+	u->cp = cp;
+	u->xz_margin = xz_margin;
+
+	struct coordinate s = {0, USAGE_SLACK, USAGE_SLACK};
+	struct dimensions sd = {d.y, d.z + 2 * USAGE_SLACK, d.x + 2 * USAGE_SLACK};
+	u->m = create_empty_usage_matrix(coordinate_sub(origin, s), sd, xz_margin);
+	mark_placements(u->m, cp);
+
+	u->n_nets = rt->n_routed_nets;
+	u->nets = calloc(u->n_nets + 1, sizeof(struct net_usage));
+	u->n_dirty = 0;
+	u->dirty = malloc((u->n_nets + 1) * sizeof(net_t));
+	u->is_dirty = calloc(u->n_nets + 1, sizeof(unsigned char));
+
+	for (net_t i = 1; i < u->n_nets + 1; i++)
+		routing_usage_mark_net(u, &rt->routed_nets[i]);
+
+	return u;
+}
+
+/* the usage matrix create_usage_matrix would make, kept in rt across calls:
+   only the nets changed since the last call (see routings_net_changed) are
+   unmarked and marked again. the matrix belongs to rt, and is only valid
+   until the routings next change; its routable region (tl to br, and the
+   full matrix windows see) is that of create_usage_matrix, and the blocks
+   to spare around it hold nothing but the tunnels of top-level pins. */
+struct usage_matrix *routings_usage(struct cell_placements *cp, struct routings *rt, int xz_margin)
+{
+	struct coordinate origin;
+	struct dimensions d;
+	usage_region(cp, rt, xz_margin, &origin, &d);
+	struct coordinate end = {origin.y + d.y - 1, origin.z + d.z - 1, origin.x + d.x - 1};
+
+	struct routing_usage *u = rt->usage;
+	if (u && (u->cp != cp || u->xz_margin != xz_margin || u->m->d.y != d.y ||
+	          !in_usage_matrix(u->m, origin) || !in_usage_matrix(u->m, end))) {
+		free_routing_usage(u);
+		u = NULL;
+	}
+
+	if (!u) {
+		u = rt->usage = create_routing_usage(cp, rt, xz_margin, origin, d);
+	} else {
+		for (int i = 0; i < u->n_dirty; i++) {
+			net_t n = u->dirty[i];
+			struct net_usage *nu = &u->nets[n];
+			for (int j = 0; j < nu->n_marked; j++)
+				usage_unmark(u->m, nu->marked[j]);
+			nu->n_marked = 0;
+
+			routing_usage_mark_net(u, &rt->routed_nets[n]);
+			u->is_dirty[n] = 0;
+		}
+		u->n_dirty = 0;
+	}
+
+	struct usage_matrix *m = u->m;
+	m->tl = m->base = origin;
+	m->br = end;
+	m->bounds = d;
+
+	return m;
+}
+
+// note that the segments of net n have changed
+void routing_usage_touch(struct routing_usage *u, net_t n)
+{
+	if (u->is_dirty[n])
+		return;
+
+	u->is_dirty[n] = 1;
+	u->dirty[u->n_dirty++] = n;
+}
+
+void free_routing_usage(struct routing_usage *u)
+{
+	if (!u)
+		return;
+
+	for (net_t i = 1; i < u->n_nets + 1; i++)
+		free(u->nets[i].marked);
+	free(u->nets);
+	free(u->dirty);
+	free(u->is_dirty);
+	free_usage_matrix(u->m);
+	free(u);
 }
 
+// whether a block marked in m is within the 3x3 (in x and z) around c, on
+// c's level or the one below
+int usage_matrix_violated(struct usage_matrix *m, struct coordinate c)
+{
+	c = coordinate_sub(c, m->origin);
+	if (c.y < 0 || c.z < 0 || c.x < 0 || c.y >= m->d.y || c.z >= m->d.z || c.x >= m->d.x)
+		return 0;
+
+	return !!(m->blocked[blocked_word(m, c)] & blocked_bit(c));
+}
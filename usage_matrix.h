@@ -1,6 +1,8 @@
 #ifndef __USAGE_MATRIX_H__
 #define __USAGE_MATRIX_H__
 
+#include <stdint.h>
+
 #include "coord.h"
 #include "extract.h"
 #include "placer.h"
@@ -10,8 +12,57 @@
 
 struct usage_matrix {
 	struct dimensions d;
+
+	// coordinate of the first element of the matrix; a window cut from a
+	// larger matrix keeps the coordinate frame of that matrix
+	struct coordinate origin;
+
+	// first and last blocks that may be routed in. a window also holds a
+	// read-only ring of one block around these (where the matrix it was cut
+	// from has one), so that marks just outside of it still count
+	struct coordinate tl, br;
+
+	// first block and dimensions of the full matrix a window was cut from.
+	// the routing session works in a fixed frame, so the full matrix starts
+	// wherever the design (plus its margin) does, negative coordinates included
+	struct coordinate base;
+	struct dimensions bounds;
+
 	int xz_margin;
 	unsigned char *matrix;
+
+	// one bit per block, set where usage_matrix_violated holds: some block
+	// within the 3x3 around it (in x and z), on its level or the one below,
+	// is marked. kept up to date by usage_mark and usage_unmark. each row
+	// (along x) takes row_words words, 64 blocks to a word
+	int row_words;
+	uint64_t *blocked;
+};
+
+// the blocks marked in a routing_usage for one net
+struct net_usage {
+	int n_marked, size;
+	struct coordinate *marked;
+};
+
+// the usage matrix of a routing session, kept in the routings (see
+// routings_usage) and brought up to date as nets are rerouted one after
+// another, rather than built again for each of them. it has USAGE_SLACK
+// blocks to spare around the design, and is only built again when the
+// design grows out of them
+struct routing_usage {
+	struct cell_placements *cp;
+	int xz_margin;
+	struct usage_matrix *m;
+
+	// indexed by net
+	int n_nets;
+	struct net_usage *nets;
+
+	// nets changed since m was last brought up to date
+	int n_dirty;
+	net_t *dirty;
+	unsigned char *is_dirty;
 };
 
 int in_usage_bounds(struct usage_matrix *, struct coordinate);
@@ -19,8 +70,19 @@ int in_usage_bounds(struct usage_matrix *, struct coordinate);
 // produces index corresponding to this coordinate
 int usage_idx(struct usage_matrix *m, struct coordinate c);
 void usage_mark(struct usage_matrix *m, struct coordinate c);
+void usage_unmark(struct usage_matrix *m, struct coordinate c);
 
+struct usage_matrix *create_placement_usage_matrix(struct cell_placements *, struct routings *, int);
 struct usage_matrix *create_usage_matrix(struct cell_placements *, struct routings *, int);
+struct usage_matrix *create_empty_usage_matrix(struct coordinate, struct dimensions, int);
+struct usage_matrix *usage_matrix_window(struct usage_matrix *, struct coordinate, struct coordinate);
+int usage_matrix_is_full(struct usage_matrix *);
+void usage_unmark_net(struct usage_matrix *, struct routed_net *);
+void free_usage_matrix(struct usage_matrix *);
+
+struct usage_matrix *routings_usage(struct cell_placements *, struct routings *, int);
+void routing_usage_touch(struct routing_usage *, net_t);
+void free_routing_usage(struct routing_usage *);
 
 int usage_matrix_violated(struct usage_matrix *, struct coordinate);
 
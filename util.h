@@ -1,6 +1,8 @@
 #ifndef __UTIL_H__
 #define __UTIL_H__
 
+#include <sys/time.h>
+
 // place utility functions
 
 static inline int max(int a, int b)
@@ -13,4 +15,12 @@ static inline int min(int a, int b)
 	return a < b ? a : b;
 }
 
+// wall-clock time, in microseconds since the epoch
+static inline unsigned long wall_usec(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (unsigned long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 #endif /* __UTIL_H__ */
@@ -45,12 +45,12 @@ static void vis_json_placements(FILE *f, struct cell_placements *cp)
 	fprintf(f, "]\n");
 }
 
-static void vis_json_routings(FILE *f, struct blif *blif, struct routings *rt)
+// the nets as they were extracted into e, where the router put them
+static void vis_json_routings(FILE *f, struct blif *blif, struct extraction *e)
 {
-	struct coordinate disp = {0, 0, 0};
 	fprintf(f, "[\n");
-	for (net_t i = 1; i < rt->n_routed_nets; i++) {
-		struct extracted_net *en = extract_net(&rt->routed_nets[i], disp);
+	for (net_t i = 1; i <= e->n_nets; i++) {
+		struct extracted_net *en = &e->nets[i - 1];
 		fprintf(f, "  {\"name\": \"");
 		char *n = get_net_name(blif, i);
 		for (int j = 0; j < strlen(n); j++)
@@ -65,7 +65,7 @@ static void vis_json_routings(FILE *f, struct blif *blif, struct routings *rt)
 				fputc(',', f);
 		}
 		fprintf(f, "]}");
-		if (i < rt->n_routed_nets - 1)
+		if (i < e->n_nets)
 			fputc(',', f);
 		fputc('\n', f);
 	}
@@ -74,9 +74,7 @@ static void vis_json_routings(FILE *f, struct blif *blif, struct routings *rt)
 
 static struct dimensions vis_json_dimensions(struct cell_placements *cp, struct routings *rt)
 {
-	struct coordinate disp = placements_top_left_most_point(cp);
-	if (rt)
-		disp = coordinate_piecewise_min(disp, routings_top_left_most_point(rt));
+	struct coordinate disp = design_top_left_most_point(cp, rt);
 
 	struct dimensions cpd = compute_placement_dimensions(cp);
 	struct dimensions rtd = {0, 0, 0};
@@ -90,16 +88,15 @@ static struct dimensions vis_json_dimensions(struct cell_placements *cp, struct
 	return d;
 }
 
-void vis_json(FILE *f, struct blif *blif, struct cell_placements *cp, struct routings *rt)
+// e is the extraction of cp and rt, whose extracted nets are written out
+void vis_json(FILE *f, struct blif *blif, struct cell_placements *cp, struct routings *rt, struct extraction *e)
 {
 	struct dimensions d = vis_json_dimensions(cp, rt);
-	struct coordinate disp = placements_top_left_most_point(cp);
-	if (rt)
-		disp = coordinate_piecewise_min(disp, routings_top_left_most_point(rt));
+	struct coordinate disp = design_top_left_most_point(cp, rt);
 	fprintf(f, "{\"dimensions\": [%d, %d, %d],\n \"disp\": [%d, %d, %d],\n", PRINT_COORD(d), PRINT_COORD(disp));
 	fprintf(f, " \"placements\":\n");
 	vis_json_placements(f, cp);
 	fprintf(f, ",\n \"routings\":\n");
-	vis_json_routings(f, blif, rt);
+	vis_json_routings(f, blif, e);
 	fprintf(f, "}");
 }
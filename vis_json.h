@@ -1,6 +1,8 @@
 #ifndef __VIS_JSON_H__
 #define __VIS_JSON_H__
 
-void vis_json(FILE *f, struct blif *blif, struct cell_placements *cp, struct routings *rt);
+#include "extract.h"
+
+void vis_json(FILE *f, struct blif *blif, struct cell_placements *cp, struct routings *rt, struct extraction *e);
 
 #endif /* __VIS_JSON_H__ */
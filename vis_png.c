@@ -122,7 +122,7 @@ void vis_png_draw_block(gdImagePtr im, gdImagePtr textures_0, block_t block, int
 
 void vis_png_draw_placements(char *output_dir, struct blif *blif, struct cell_placements *cp, struct routings *rt, int layer)
 {
-	struct extraction *e = extract(cp, rt);
+	struct extraction *e = extract(cp, rt, 1);
 	struct dimensions d = e->dimensions;
 
 	switch (layer) {
@@ -152,17 +152,19 @@ void vis_png_draw_placements(char *output_dir, struct blif *blif, struct cell_pl
 		return;
 	}
 
-	/* draw blocks */
-	for (int y = 0; y < d.y; y++) {
-		for (int z = 0; z < d.z; z++) {
-			for (int x = 0; x < d.x; x++) {
-				int id = e->blocks[y * d.z * d.x + z * d.x + x];
-				int data = e->data[y * d.z * d.x + z * d.x + x];
-				if (y == 0 && id == 55)
-					vis_png_draw_block(im, textures_0, 1, x, z, 0); // underlying stone
-				vis_png_draw_block(im, textures_0, id, x, z, data);
-			}
-		}
+	/* draw blocks, lower layers first; only the sections with blocks in
+	   them are visited */
+	struct extraction_iterator it;
+	struct coordinate c;
+	block_t id;
+	data_t data;
+	extraction_iterator_init(&it);
+	while (extraction_next(e, &it, &c, &id, &data)) {
+		if (c.y >= d.y)
+			continue;
+		if (c.y == 0 && id == 55)
+			vis_png_draw_block(im, textures_0, 1, c.x, c.z, 0); // underlying stone
+		vis_png_draw_block(im, textures_0, id, c.x, c.z, data);
 	}
 	free_extraction(e);
 